@@ -0,0 +1,130 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file async_writer.cpp
+ * @brief Implementation of the asynchronous output writer.
+ ********************************************************************************/
+#include "async_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+/**
+ * @brief Starts the writer thread.
+ * @param s Where the writer thread sends the output.
+ * @param p What to do when the ring is full.
+ * @param capacity The ring size in bytes, rounded up to a power of two.
+ ********************************************************************************/
+async_writer::async_writer(std::streambuf *s, policy p, size_t capacity)
+    : sink(s), pol(p) {
+  size_t size = 4096;
+  while (size < capacity)
+    size *= 2;
+  ring.resize(size);
+  mask = size - 1;
+  worker = std::thread(&async_writer::run, this);
+}
+
+/**
+ * @brief Drains the ring into the sink and stops the writer thread.
+ ********************************************************************************/
+async_writer::~async_writer() {
+  stopping.store(true, std::memory_order_release);
+  worker.join();
+  sink->pubsync();
+}
+
+/**
+ * @brief Queues bytes for the writer thread.
+ *
+ * Under the block policy a write larger than the free space is copied in
+ * pieces as the writer thread makes room. Under the drop policy it is
+ * either queued whole or not at all, so partial lines never show up.
+ *
+ * @param data The bytes to write.
+ * @param n The number of bytes.
+ * @return false if the bytes were dropped.
+ ********************************************************************************/
+bool async_writer::write(const char *data, size_t n) {
+  size_t cap = ring.size();
+  if (pol == drop &&
+      n > cap - (head.load(std::memory_order_relaxed) -
+                 tail.load(std::memory_order_acquire))) {
+    dropped += n;
+    return false;
+  }
+
+  while (n != 0) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t room = cap - (h - tail.load(std::memory_order_acquire));
+    if (room == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    size_t k = std::min(n, room);
+    size_t off = h & mask;
+    size_t first = std::min(k, cap - off);
+    std::memcpy(&ring[off], data, first);
+    std::memcpy(&ring[0], data + first, k - first);
+    head.store(h + k, std::memory_order_release);
+    data += k;
+    n -= k;
+  }
+  return true;
+}
+
+/**
+ * @brief The writer thread: drains the ring until asked to stop.
+ *
+ * Each pass writes everything up to the wrap point in one call. An empty
+ * ring is polled with a short sleep so the producer never has to signal.
+ ********************************************************************************/
+void async_writer::run() {
+  for (;;) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    if (h == t) {
+      if (stopping.load(std::memory_order_acquire) &&
+          head.load(std::memory_order_acquire) == t)
+        return;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+
+    size_t off = t & mask;
+    size_t k = std::min(h - t, ring.size() - off);
+    sink->sputn(&ring[off], k);
+    tail.store(t + k, std::memory_order_release);
+  }
+}
+
+/**
+ * @brief Hands a full buffer to the writer and keeps c.
+ * @param c The character that did not fit, or eof.
+ * @return c, or eof if c was eof.
+ ********************************************************************************/
+async_streambuf::int_type async_streambuf::overflow(int_type c) {
+  sync();
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+  *pptr() = traits_type::to_char_type(c);
+  pbump(1);
+  return c;
+}
+
+/**
+ * @brief Hands everything buffered so far to the writer.
+ * @return 0.
+ ********************************************************************************/
+int async_streambuf::sync() {
+  if (pptr() != pbase())
+    out.write(pbase(), pptr() - pbase());
+  setp(buf, buf + sizeof(buf));
+  return 0;
+}
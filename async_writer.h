@@ -0,0 +1,115 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+/**
+ * @class async_writer
+ * @brief Moves output off the simulator thread through a ring buffer.
+ *
+ * The simulator thread is the only producer and a dedicated writer thread
+ * is the only consumer of a single-producer/single-consumer byte ring.
+ * Neither side takes a lock: each owns one index and publishes it with
+ * release/acquire ordering. The writer thread hands whatever is in the
+ * ring to the sink in as few large writes as possible.
+ *
+ * When the ring is full the producer either waits for room (block) or
+ * throws the write away and counts it (drop).
+ ********************************************************************************/
+class async_writer {
+public:
+  enum policy { block, drop };
+
+  static constexpr size_t default_capacity = 16 * 1024 * 1024;
+
+  /**
+   * @brief Starts the writer thread.
+   * @param sink Where the writer thread sends the output. Nothing else may
+   * use it until this object is destroyed.
+   * @param p What to do when the ring is full.
+   * @param capacity The ring size in bytes, rounded up to a power of two.
+   ****************************************************************************/
+  async_writer(std::streambuf *sink, policy p,
+               size_t capacity = default_capacity);
+
+  /**
+   * @brief Drains the ring into the sink and stops the writer thread.
+   ****************************************************************************/
+  ~async_writer();
+
+  async_writer(const async_writer &) = delete;
+  async_writer &operator=(const async_writer &) = delete;
+
+  /**
+   * @brief Queues bytes for the writer thread.
+   *
+   * Only ever called from one thread.
+   *
+   * @param data The bytes to write.
+   * @param n The number of bytes.
+   * @return false if the bytes were dropped because the ring was full.
+   ****************************************************************************/
+  bool write(const char *data, size_t n);
+
+  /**
+   * @brief Gets the number of bytes thrown away under the drop policy.
+   * @return The byte count.
+   ****************************************************************************/
+  uint64_t get_dropped() const { return dropped; }
+
+private:
+  void run();
+
+  std::streambuf *sink;
+  policy pol;
+  std::vector<char> ring;
+  size_t mask;
+  uint64_t dropped = 0;
+
+  // head and tail are written by different threads, keep them on
+  // separate cache lines
+  std::atomic<size_t> head = {0};          // next byte the producer fills
+  char pad0[64];
+  std::atomic<size_t> tail = {0};          // next byte the writer drains
+  char pad1[64];
+  std::atomic<bool> stopping = {false};
+  std::thread worker;
+};
+
+/**
+ * @class async_streambuf
+ * @brief A stream buffer that sends its output through an async_writer.
+ *
+ * Installing one in std::cout makes every insertion and std::endl a
+ * memory copy into the ring instead of a write to the terminal or disk.
+ ********************************************************************************/
+class async_streambuf : public std::streambuf {
+public:
+  /**
+   * @brief Constructs a buffer that feeds w.
+   * @param w The writer to send output to.
+   ****************************************************************************/
+  async_streambuf(async_writer &w) : out(w) { setp(buf, buf + sizeof(buf)); }
+
+  /**
+   * @brief Sends anything still buffered to the writer.
+   ****************************************************************************/
+  ~async_streambuf() { sync(); }
+
+protected:
+  int_type overflow(int_type c) override;
+  int sync() override;
+
+private:
+  async_writer &out;
+  char buf[8192];
+};
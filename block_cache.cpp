@@ -0,0 +1,72 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file block_cache.cpp
+ * @brief Implementation of the basic block cache.
+ ********************************************************************************/
+#include "block_cache.h"
+
+/**
+ * @brief Constructs an empty cache watching the given memory.
+ * @param m The memory the cached blocks are fetched from.
+ ********************************************************************************/
+block_cache::block_cache(memory &m) : mem(m) { mem.add_watcher(this); }
+
+/**
+ * @brief Unregisters the cache from its memory.
+ ********************************************************************************/
+block_cache::~block_cache() { mem.remove_watcher(this); }
+
+/**
+ * @brief Takes ownership of a newly built block.
+ * @param b The block to add.
+ * @return A pointer to the stored block.
+ ********************************************************************************/
+basic_block *block_cache::insert(std::unique_ptr<basic_block> b) {
+  basic_block *p = b.get();
+  blocks[p->start] = std::move(b);
+  return p;
+}
+
+/**
+ * @brief Links from to its successor to.
+ * @param from The block that just finished.
+ * @param to The block that runs next.
+ ********************************************************************************/
+void block_cache::chain(basic_block *from, basic_block *to) {
+  if (from->succ[0] == nullptr)
+    from->succ[0] = to;
+  else
+    from->succ[1] = to;
+}
+
+/**
+ * @brief Marks the cache stale after a write to watched code.
+ *
+ * Blocks are linked to each other by pointer, so there is no cheap way to
+ * drop just the ones holding addr. Stores into code are rare enough that
+ * rebuilding everything is fine.
+ *
+ * A write from another thread is only recorded here and applied by sync().
+ *
+ * @param addr The word-aligned address that was modified.
+ ********************************************************************************/
+void block_cache::invalidate(uint32_t) {
+  if (on_owner())
+    stale = true;
+  else
+    remote.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Drops every cached block and clears the stale flag.
+ ********************************************************************************/
+void block_cache::flush() {
+  blocks.clear();
+  stale = false;
+}
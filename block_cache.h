@@ -0,0 +1,164 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "memory.h"
+#include "predecode_cache.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct jit_context;
+struct block_profile;
+
+/**
+ * @struct basic_block
+ * @brief A straight-line run of predecoded instructions.
+ *
+ * A block starts at a branch target and ends at the first instruction that
+ * can change the flow of control (a branch, jal, jalr or system
+ * instruction), or when it reaches max_block_insns. The records are laid
+ * out back to back so each threaded handler can jump to the next one. The
+ * two most recently seen successors are linked directly so execution can
+ * chain from one block to the next without a lookup.
+ *
+ * When the JIT is enabled, hits counts how often the block ran and native
+ * points at its translation once it is hot.
+ ********************************************************************************/
+struct basic_block {
+  uint32_t start = 0;
+  std::vector<decoded_insn> insns;    // ends with an op_block_end sentinel
+  uint32_t last = 0;                  // address of the last instruction
+  basic_block *succ[2] = {nullptr, nullptr};
+
+  /**
+   * @brief Gets the number of guest instructions in the block.
+   * @return The instruction count, not counting the sentinel.
+   ****************************************************************************/
+  size_t length() const { return insns.size() - 1; }
+
+  /**
+   * @brief Counts the instructions that come before addr in the block.
+   * @param addr The address of an instruction in the block, or of the one
+   * just past its end.
+   * @return The number of instructions from start up to addr.
+   ****************************************************************************/
+  size_t count_to(uint32_t addr) const {
+    size_t n = 0;
+    for (uint32_t a = start; a != addr && n < length(); a += insns[n].len)
+      ++n;
+    return n;
+  }
+
+  uint32_t hits = 0;
+  uint64_t (*native)(jit_context *) = nullptr;
+  bool no_native = {false};     // the JIT could not translate anything
+  block_profile *profile = nullptr;   // set by a profiler on its first run
+};
+
+/**
+ * @class block_cache
+ * @brief A cache of basic blocks indexed by their starting address.
+ *
+ * Any write to watched code marks the whole cache stale rather than
+ * dropping blocks straight away, since the block holding the store may
+ * still be running. The owner flushes it once it is back in its dispatcher.
+ *
+ * Writes from other threads only set a flag, which sync() turns into a
+ * stale cache at the next block boundary. That way is_stale() still means
+ * that the running block's own store hit code.
+ ********************************************************************************/
+class block_cache : public memory_watcher {
+public:
+  static constexpr size_t max_block_insns = 64;
+
+  /**
+   * @brief Constructs an empty cache watching the given memory.
+   * @param m The memory the cached blocks are fetched from.
+   ****************************************************************************/
+  block_cache(memory &m);
+
+  /**
+   * @brief Unregisters the cache from its memory.
+   ****************************************************************************/
+  ~block_cache();
+
+  block_cache(const block_cache &) = delete;
+  block_cache &operator=(const block_cache &) = delete;
+
+  /**
+   * @brief Looks up the block starting at pc.
+   * @param pc The address of the first instruction in the block.
+   * @return The block, or nullptr on a miss.
+   ****************************************************************************/
+  basic_block *lookup(uint32_t pc) const {
+    auto it = blocks.find(pc);
+    return it == blocks.end() ? nullptr : it->second.get();
+  }
+
+  /**
+   * @brief Takes ownership of a newly built block.
+   * @param b The block to add.
+   * @return A pointer to the stored block.
+   ****************************************************************************/
+  basic_block *insert(std::unique_ptr<basic_block> b);
+
+  /**
+   * @brief Links from to its successor to.
+   *
+   * Fills the first empty successor slot, or replaces the second one if
+   * both are taken.
+   *
+   * @param from The block that just finished.
+   * @param to The block that runs next.
+   ****************************************************************************/
+  static void chain(basic_block *from, basic_block *to);
+
+  /**
+   * @brief Checks if code has been overwritten since the last flush.
+   * @return true if the cached blocks can no longer be trusted.
+   ****************************************************************************/
+  bool is_stale() const { return stale; }
+
+  /**
+   * @brief Marks the cache stale, as FENCE.I does.
+   *
+   * The running block is left alone; the owner flushes the cache once it
+   * is back in its dispatcher.
+   ****************************************************************************/
+  void mark_stale() { stale = true; }
+
+  /**
+   * @brief Picks up writes to cached code made by other threads.
+   *
+   * Call this between blocks; it marks the cache stale if any came in.
+   ****************************************************************************/
+  void sync() {
+    if (remote.load(std::memory_order_relaxed) &&
+        remote.exchange(false, std::memory_order_acquire))
+      stale = true;
+  }
+
+  /**
+   * @brief Marks the cache stale after a write to watched code.
+   * @param addr The word-aligned address that was modified.
+   ****************************************************************************/
+  void invalidate(uint32_t addr) override;
+
+  /**
+   * @brief Drops every cached block and clears the stale flag.
+   ****************************************************************************/
+  void flush();
+
+private:
+  memory &mem;
+  std::unordered_map<uint32_t, std::unique_ptr<basic_block>> blocks;
+  bool stale = {false};
+  std::atomic<bool> remote = {false};   // set by writes from other threads
+};
@@ -0,0 +1,458 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#include "branch_model.h"
+#include "cache_model.h"
+#include "hex.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+/**
+ * @brief Moves a 2-bit saturating counter towards the outcome.
+ * @param c The counter, 0 to 3; 2 and 3 predict taken.
+ * @param taken The outcome.
+ ********************************************************************************/
+static void train(uint8_t &c, bool taken) {
+  if (taken && c < 3)
+    ++c;
+  else if (!taken && c > 0)
+    --c;
+}
+
+/**
+ * @class static_predictor
+ * @brief Backward taken, forward not taken.
+ ********************************************************************************/
+class static_predictor : public direction_predictor {
+public:
+  bool predict(uint32_t pc, uint32_t target) override { return target <= pc; }
+  void update(uint32_t, bool) override {}
+  std::string describe() const override {
+    return "static (backward taken, forward not taken)";
+  }
+};
+
+/**
+ * @class bimodal_predictor
+ * @brief A table of 2-bit counters indexed by the branch address.
+ ********************************************************************************/
+class bimodal_predictor : public direction_predictor {
+public:
+  explicit bimodal_predictor(uint32_t bits)
+      : counters(size_t(1) << bits, 1), mask((1u << bits) - 1) {}
+
+  bool predict(uint32_t pc, uint32_t) override {
+    return counters[(pc >> 1) & mask] >= 2;
+  }
+  void update(uint32_t pc, bool taken) override {
+    train(counters[(pc >> 1) & mask], taken);
+  }
+  std::string describe() const override {
+    return "bimodal, " + std::to_string(counters.size()) + " counters";
+  }
+
+private:
+  std::vector<uint8_t> counters;
+  uint32_t mask;
+};
+
+/**
+ * @class gshare_predictor
+ * @brief 2-bit counters indexed by the branch address xor global history.
+ ********************************************************************************/
+class gshare_predictor : public direction_predictor {
+public:
+  gshare_predictor(uint32_t bits, uint32_t hist)
+      : counters(size_t(1) << bits, 1), mask((1u << bits) - 1),
+        hist_bits(hist) {}
+
+  bool predict(uint32_t pc, uint32_t) override {
+    return counters[index(pc)] >= 2;
+  }
+  void update(uint32_t pc, bool taken) override {
+    train(counters[index(pc)], taken);
+    history = ((history << 1) | taken) & ((1u << hist_bits) - 1);
+  }
+  std::string describe() const override {
+    return "gshare, " + std::to_string(counters.size()) + " counters, " +
+           std::to_string(hist_bits) + " history bits";
+  }
+
+private:
+  uint32_t index(uint32_t pc) const { return ((pc >> 1) ^ history) & mask; }
+
+  std::vector<uint8_t> counters;
+  uint32_t mask;
+  uint32_t hist_bits;
+  uint32_t history = 0;
+};
+
+/**
+ * @class tage_predictor
+ * @brief A small TAGE: a bimodal base and four tagged tables.
+ *
+ * The tagged tables are indexed and tagged by hashes of the branch address
+ * and geometrically longer slices of the global history, a quarter, an
+ * eighth... of the longest. The longest table with a matching tag
+ * provides the prediction, falling back to the base. A misprediction
+ * allocates an entry in a longer table whose useful counter is zero, and
+ * useful counters track whether the provider beat the alternative
+ * prediction; they are halved every 256K branches so stale entries can be
+ * replaced. There is no use-alt-on-newly-allocated logic.
+ ********************************************************************************/
+class tage_predictor : public direction_predictor {
+public:
+  tage_predictor(uint32_t bits, uint32_t hist)
+      : base(bits), table_bits(std::max(bits, 6u) - 2) {
+    for (uint32_t t = 0; t < tables; ++t) {
+      entries[t].resize(size_t(1) << table_bits);
+      lengths[t] = std::max(hist >> (tables - 1 - t), 2u);
+    }
+  }
+
+  bool predict(uint32_t pc, uint32_t target) override {
+    lookup(pc);
+    if (provider < 0)
+      return base.predict(pc, target);
+    return entries[provider][index[provider]].ctr >= 0;
+  }
+
+  // uses the tables found by predict(), which the history has not moved
+  // on from yet
+  void update(uint32_t pc, bool taken) override {
+    bool alt_pred = alt < 0 ? base.predict(pc, 0)
+                            : entries[alt][index[alt]].ctr >= 0;
+    bool pred = alt_pred;
+    if (provider >= 0) {
+      entry &e = entries[provider][index[provider]];
+      pred = e.ctr >= 0;
+      if (pred != alt_pred)
+        e.u = pred == taken ? std::min(e.u + 1, 3) : std::max(e.u - 1, 0);
+      if (taken && e.ctr < 3)
+        ++e.ctr;
+      else if (!taken && e.ctr > -4)
+        --e.ctr;
+    } else
+      base.update(pc, taken);
+
+    if (pred != taken)
+      allocate(taken);
+
+    if (++branches % (256 * 1024) == 0)
+      for (std::vector<entry> &v : entries)
+        for (entry &e : v)
+          e.u >>= 1;
+
+    history = history << 1 | taken;
+  }
+
+  std::string describe() const override {
+    std::ostringstream os;
+    os << "tage, base " << base.describe() << ", " << tables << " x "
+       << (1u << table_bits) << " tagged entries, histories";
+    for (uint32_t t = 0; t < tables; ++t)
+      os << (t ? "/" : " ") << lengths[t];
+    return os.str();
+  }
+
+private:
+  static constexpr uint32_t tables = 4;
+  static constexpr uint32_t tag_bits = 9;
+
+  /**
+   * @brief One tagged entry.
+   ****************************************************************************/
+  struct entry {
+    uint16_t tag = 0;
+    int8_t ctr = 0;             // -4 to 3, taken if >= 0
+    int8_t u = 0;               // usefulness, 0 to 3
+  };
+
+  /**
+   * @brief Folds the newest len bits of the history into bits bits.
+   ****************************************************************************/
+  uint32_t fold(uint32_t len, uint32_t bits) const {
+    uint64_t h = len >= 64 ? history : history & ((uint64_t(1) << len) - 1);
+    uint32_t r = 0;
+    for (; h != 0; h >>= bits)
+      r ^= uint32_t(h) & ((1u << bits) - 1);
+    return r;
+  }
+
+  /**
+   * @brief Finds the provider and alternate tables for pc.
+   ****************************************************************************/
+  void lookup(uint32_t pc) {
+    uint32_t a = pc >> 1;
+    provider = alt = -1;
+    for (int t = tables - 1; t >= 0; --t) {
+      index[t] = (a ^ (a >> table_bits) ^ fold(lengths[t], table_bits)) &
+                 ((1u << table_bits) - 1);
+      tag[t] = (a ^ fold(lengths[t], tag_bits) ^
+                (fold(lengths[t], tag_bits - 1) << 1)) &
+               ((1u << tag_bits) - 1);
+      if (entries[t][index[t]].tag == tag[t]) {
+        if (provider < 0)
+          provider = t;
+        else if (alt < 0)
+          alt = t;
+      }
+    }
+  }
+
+  /**
+   * @brief Claims an entry in a table longer than the provider's.
+   ****************************************************************************/
+  void allocate(bool taken) {
+    for (int t = provider + 1; t < int(tables); ++t) {
+      entry &e = entries[t][index[t]];
+      if (e.u == 0) {
+        e.tag = tag[t];
+        e.ctr = taken ? 0 : -1;
+        return;
+      }
+    }
+    for (int t = provider + 1; t < int(tables); ++t)
+      --entries[t][index[t]].u;
+  }
+
+  bimodal_predictor base;
+  uint32_t table_bits;
+  uint32_t lengths[tables];
+  std::vector<entry> entries[tables];
+  uint64_t history = 0;
+  uint64_t branches = 0;
+
+  // the last lookup()
+  uint32_t index[tables];
+  uint32_t tag[tables];
+  int provider = -1;
+  int alt = -1;
+};
+
+/**
+ * @brief Sets up the predictors from a description.
+ * @param spec The predictor, then any :key=value settings.
+ * @return false, after saying why on stderr, if spec is not valid.
+ ********************************************************************************/
+bool branch_model::configure(const std::string &spec) {
+  std::istringstream parts(spec);
+  std::string name, item;
+  std::getline(parts, name, ':');
+
+  bool is_tage = name == "tage";
+  uint32_t bits = 12, hist = is_tage ? 32 : 0, btb_size = 512, ras_size = 16;
+  while (std::getline(parts, item, ':')) {
+    size_t eq = item.find('=');
+    std::string key = item.substr(0, eq);
+    uint32_t *v = key == "bits" ? &bits
+                  : key == "hist" ? &hist
+                  : key == "btb" ? &btb_size
+                  : key == "ras" ? &ras_size : nullptr;
+    std::istringstream iss(eq == std::string::npos ? "" : item.substr(eq + 1));
+    char extra;
+    if (v == nullptr || !(iss >> *v) || iss >> extra) {
+      std::cerr << "Bad branch predictor setting '" << item << "'\n";
+      return false;
+    }
+  }
+  if (name == "gshare" && hist == 0)
+    hist = bits;
+
+  bool ok = bits >= 1 && bits <= 24 && is_pow2(btb_size) && ras_size >= 1;
+  if (name == "gshare")
+    ok = ok && hist >= 1 && hist <= bits;
+  else if (is_tage)
+    ok = ok && hist >= 8 && hist <= 64;
+  else
+    ok = ok && hist == 0;
+  if (!ok) {
+    std::cerr << "Bad branch predictor geometry in '" << spec << "'\n";
+    return false;
+  }
+
+  if (name == "static")
+    dir.reset(new static_predictor);
+  else if (name == "bimodal")
+    dir.reset(new bimodal_predictor(bits));
+  else if (name == "gshare")
+    dir.reset(new gshare_predictor(bits, hist));
+  else if (is_tage)
+    dir.reset(new tage_predictor(bits, hist));
+  else {
+    std::cerr << "Unknown branch predictor '" << name << "'\n";
+    return false;
+  }
+  btb.assign(btb_size, btb_entry());
+  ras.assign(ras_size, 0);
+  return true;
+}
+
+/**
+ * @brief Looks a taken control transfer up in the BTB and trains it.
+ * @param pc The address of the branch or jump.
+ * @param target Where it went.
+ * @return true if the BTB had the right target.
+ ********************************************************************************/
+bool branch_model::btb_predicts(uint32_t pc, uint32_t target) {
+  btb_entry &e = btb[(pc >> 1) & (btb.size() - 1)];
+  bool hit = e.valid && e.pc == pc && e.target == target;
+  e.valid = true;
+  e.pc = pc;
+  e.target = target;
+  return hit;
+}
+
+/**
+ * @brief Pushes a return address, overwriting the oldest when full.
+ * @param addr The return address.
+ ********************************************************************************/
+void branch_model::push_return(uint32_t addr) {
+  ras[ras_top] = addr;
+  ras_top = (ras_top + 1) % ras.size();
+  ras_count = std::min(ras_count + 1, ras.size());
+}
+
+/**
+ * @brief Pops the predicted return address.
+ * @param addr Set to the address, if there is one.
+ * @return false if the stack is empty.
+ ********************************************************************************/
+bool branch_model::pop_return(uint32_t &addr) {
+  if (ras_count == 0)
+    return false;
+  ras_top = (ras_top + ras.size() - 1) % ras.size();
+  --ras_count;
+  addr = ras[ras_top];
+  return true;
+}
+
+/**
+ * @brief Predicts a branch or jump and checks the prediction.
+ *
+ * jalr follows the return-address hints of the RISC-V spec: a jalr that
+ * links and reads the other link register pops and then pushes, as a
+ * coroutine swap does.
+ *
+ * @param pc The address of the instruction.
+ * @param d The instruction.
+ * @param next_pc The pc after it ran.
+ ********************************************************************************/
+void branch_model::predict(uint32_t pc, const decoded_insn &d,
+                           uint32_t next_pc) {
+  bool taken = next_pc != pc + d.len;
+  bool rd_link = d.rd == 1 || d.rd == 5;
+  bool rs1_link = d.rs1 == 1 || d.rs1 == 5;
+  kind k;
+  bool miss = false;
+
+  if (d.op == op_jal) {
+    k = jump;
+    btb_misses[k] += !btb_predicts(pc, next_pc);
+    if (rd_link)
+      push_return(pc + d.len);
+  } else if (d.op == op_jalr) {
+    if (rs1_link && (!rd_link || d.rd != d.rs1)) {
+      k = ret;
+      uint32_t addr;
+      miss = !pop_return(addr) || addr != next_pc;
+    } else {
+      k = indirect;
+      miss = !btb_predicts(pc, next_pc);
+      btb_misses[k] += miss;
+    }
+    if (rd_link)
+      push_return(pc + d.len);
+  } else {
+    k = conditional;
+    bool guess = dir->predict(pc, pc + d.imm);
+    dir->update(pc, taken);
+    miss = guess != taken;
+    if (taken)
+      btb_misses[k] += !btb_predicts(pc, next_pc);
+  }
+
+  ++executed[k];
+  mispredicted[k] += miss;
+  branch_stats &s = branches[pc];
+  s.k = k;
+  ++s.executed;
+  s.taken += taken;
+  s.mispredicted += miss;
+}
+
+/**
+ * @brief Formats a count and its share of a total.
+ * @param n The count.
+ * @param total The total.
+ * @return e.g. "12 (3.45%)".
+ ********************************************************************************/
+static std::string rate(uint64_t n, uint64_t total) {
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(2)
+     << (total ? 100.0 * n / total : 0.0) << "%";
+  return os.str();
+}
+
+/**
+ * @brief Prints the totals and the misprediction rate of every branch.
+ * @param os The stream to print to.
+ * @param syms The program's symbols, or nullptr.
+ ********************************************************************************/
+void branch_model::report(std::ostream &os, const symbol_table *syms) const {
+  static const char *const kind_names[kind_count] = {"branch", "jal",
+                                                      "return", "indirect"};
+  std::ios_base::fmtflags flags = os.flags();
+
+  os << "Branch prediction: " << dir->describe() << "; BTB " << btb.size()
+     << " entries; RAS " << ras.size() << " entries\n";
+  os << std::left << std::setw(10) << "kind" << std::right << std::setw(14)
+     << "executed" << std::setw(14) << "mispredicted" << std::setw(10)
+     << "rate" << std::setw(12) << "BTB misses" << '\n';
+  uint64_t all = 0, all_missed = 0;
+  for (int k = 0; k < kind_count; ++k) {
+    os << std::left << std::setw(10) << kind_names[k] << std::right
+       << std::setw(14) << executed[k] << std::setw(14) << mispredicted[k]
+       << std::setw(10) << rate(mispredicted[k], executed[k])
+       << std::setw(12) << btb_misses[k] << '\n';
+    all += executed[k];
+    all_missed += mispredicted[k];
+  }
+  os << std::left << std::setw(10) << "total" << std::right << std::setw(14)
+     << all << std::setw(14) << all_missed << std::setw(10)
+     << rate(all_missed, all) << '\n';
+
+  std::vector<std::pair<uint32_t, const branch_stats *>> sorted;
+  for (const auto &b : branches)
+    sorted.emplace_back(b.first, &b.second);
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<uint32_t, const branch_stats *> &a,
+               const std::pair<uint32_t, const branch_stats *> &b) {
+              if (a.second->mispredicted != b.second->mispredicted)
+                return a.second->mispredicted > b.second->mispredicted;
+              return a.first < b.first;
+            });
+
+  os << "\nPer branch:\n"
+     << std::setw(10) << "pc" << "  " << std::left << std::setw(10) << "kind"
+     << std::right << std::setw(14) << "executed" << std::setw(10) << "taken"
+     << std::setw(14) << "mispredicted" << std::setw(10) << "rate" << '\n';
+  for (const auto &b : sorted) {
+    const branch_stats &s = *b.second;
+    os << std::setw(10) << hex::to_hex0x32(b.first) << "  " << std::left
+       << std::setw(10) << kind_names[s.k] << std::right << std::setw(14)
+       << s.executed << std::setw(10) << rate(s.taken, s.executed)
+       << std::setw(14) << s.mispredicted << std::setw(10)
+       << rate(s.mispredicted, s.executed);
+    if (syms != nullptr && syms->containing(b.first) != nullptr)
+      os << "  <" << syms->name_of(b.first) << ">";
+    os << '\n';
+  }
+  os.flags(flags);
+}
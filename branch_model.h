@@ -0,0 +1,151 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "predecode_cache.h"
+#include "symbol_table.h"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class direction_predictor
+ * @brief Guesses whether a conditional branch is taken.
+ *
+ * The branch model asks for a prediction and then reports the outcome,
+ * once for every conditional branch in the order they run. Predictors
+ * that use global history update it in update().
+ ********************************************************************************/
+class direction_predictor {
+public:
+  virtual ~direction_predictor() {}
+
+  /**
+   * @brief Predicts a branch.
+   * @param pc The address of the branch.
+   * @param target Where it goes if taken.
+   * @return true if it is predicted taken.
+   ****************************************************************************/
+  virtual bool predict(uint32_t pc, uint32_t target) = 0;
+
+  /**
+   * @brief Trains the predictor with the branch predict() was asked about.
+   * @param pc The address of the branch.
+   * @param taken true if it was taken.
+   ****************************************************************************/
+  virtual void update(uint32_t pc, bool taken) = 0;
+
+  /**
+   * @brief Describes the predictor for the report.
+   * @return e.g. "gshare, 4096 counters, 12 history bits".
+   ****************************************************************************/
+  virtual std::string describe() const = 0;
+};
+
+/**
+ * @class branch_model
+ * @brief Front-end branch prediction for an in-order core.
+ *
+ * Every conditional branch, jal and jalr the hart runs is predicted and
+ * then checked against what it did:
+ * - A conditional branch is mispredicted when its direction predictor
+ *   guessed wrong.
+ * - A return, a jalr through ra or t0 that doesn't link, is predicted by
+ *   the return-address stack; calls, a jal or jalr linking into ra or t0,
+ *   push onto it.
+ * - Any other jalr is predicted by the branch target buffer.
+ * - Taken branches and jals need the BTB to redirect fetch; a BTB miss
+ *   there is counted, but is not a misprediction, since decode finds the
+ *   target.
+ *
+ * The model only keeps statistics and never changes what runs.
+ ********************************************************************************/
+class branch_model {
+public:
+  /**
+   * @brief Sets up the predictors from a description.
+   *
+   * The description is the direction predictor, static, bimodal, gshare
+   * or tage, optionally followed by :key=value settings:
+   * - bits: log2 of the number of counters (default 12; for tage, of the
+   *   base predictor, with four tagged tables a quarter of that size)
+   * - hist: global history bits (gshare: default bits, up to bits;
+   *   tage: the longest history, default 32, 8 to 64)
+   * - btb: BTB entries, a power of two (default 512)
+   * - ras: return-address stack entries (default 16)
+   *
+   * For example "gshare:bits=14" or "tage:hist=64:btb=1024".
+   *
+   * @param spec The description.
+   * @return false, after saying why on stderr, if spec is not valid.
+   ****************************************************************************/
+  bool configure(const std::string &spec);
+
+  /**
+   * @brief Predicts and checks an instruction that ran, if it is a branch
+   * or a jump.
+   * @param pc The address of the instruction.
+   * @param d The instruction.
+   * @param next_pc The pc after it ran.
+   ****************************************************************************/
+  void note(uint32_t pc, const decoded_insn &d, uint32_t next_pc) {
+    if ((d.op >= op_beq && d.op <= op_bgeu) || d.op == op_jal ||
+        d.op == op_jalr)
+      predict(pc, d, next_pc);
+  }
+
+  /**
+   * @brief Prints the totals and the misprediction rate of every branch.
+   *
+   * Branches are listed worst first, by the number of mispredictions.
+   *
+   * @param os The stream to print to.
+   * @param syms The program's symbols, or nullptr.
+   ****************************************************************************/
+  void report(std::ostream &os, const symbol_table *syms) const;
+
+private:
+  enum kind { conditional, jump, ret, indirect, kind_count };
+
+  /**
+   * @brief What happened at one branch pc.
+   ****************************************************************************/
+  struct branch_stats {
+    kind k = conditional;
+    uint64_t executed = 0;
+    uint64_t taken = 0;
+    uint64_t mispredicted = 0;
+  };
+
+  /**
+   * @brief One BTB entry.
+   ****************************************************************************/
+  struct btb_entry {
+    bool valid = false;
+    uint32_t pc = 0;
+    uint32_t target = 0;
+  };
+
+  void predict(uint32_t pc, const decoded_insn &d, uint32_t next_pc);
+  bool btb_predicts(uint32_t pc, uint32_t target);
+  void push_return(uint32_t addr);
+  bool pop_return(uint32_t &addr);
+
+  std::unique_ptr<direction_predictor> dir;
+  std::vector<btb_entry> btb;
+  std::vector<uint32_t> ras;
+  size_t ras_top = 0;           // where the next push goes
+  size_t ras_count = 0;         // valid entries, up to ras.size()
+
+  std::unordered_map<uint32_t, branch_stats> branches;
+  uint64_t executed[kind_count] = {};
+  uint64_t mispredicted[kind_count] = {};
+  uint64_t btb_misses[kind_count] = {};
+};
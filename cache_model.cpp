@@ -0,0 +1,265 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#include "cache_model.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+/**
+ * @brief Constructs an empty cache.
+ * @param name The name used in the report.
+ * @param size The capacity in bytes.
+ * @param ways The associativity.
+ * @param line_size The line size in bytes, a power of two.
+ * @param p How the line to evict is picked.
+ * @param next The level misses go to, or nullptr for memory.
+ ********************************************************************************/
+cache_level::cache_level(const std::string &name, uint32_t size,
+                         uint32_t ways, uint32_t line_size, policy p,
+                         cache_level *next)
+    : name(name), size(size), ways(ways), line_bits(0), pol(p), next(next) {
+  while ((1u << line_bits) < line_size)
+    ++line_bits;
+  uint32_t sets = size / line_size / ways;
+  set_mask = sets - 1;
+  lines.resize(size_t(sets) * ways);
+}
+
+/**
+ * @brief Picks the way of a full set to replace.
+ *
+ * An empty way is always taken first.
+ *
+ * @param set The first way of the set.
+ * @return The index of the way within the set.
+ ********************************************************************************/
+uint32_t cache_level::victim(way *set) {
+  for (uint32_t i = 0; i < ways; ++i)
+    if (!set[i].valid)
+      return i;
+
+  if (pol == random) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % ways;
+  }
+
+  // LRU and FIFO both evict the oldest stamp; they differ in when it is set
+  uint32_t oldest = 0;
+  for (uint32_t i = 1; i < ways; ++i)
+    if (set[i].stamp < set[oldest].stamp)
+      oldest = i;
+  return oldest;
+}
+
+/**
+ * @brief Accesses the line holding addr.
+ *
+ * A miss writes the victim back to the next level if it is dirty, then
+ * reads the new line from the next level.
+ *
+ * @param addr The address.
+ * @param write true for a store, which leaves the line dirty.
+ ********************************************************************************/
+void cache_level::access(uint32_t addr, bool write) {
+  ++accesses;
+  ++clock;
+  uint32_t line = addr >> line_bits;
+  way *set = &lines[size_t(line & set_mask) * ways];
+  for (uint32_t i = 0; i < ways; ++i) {
+    way &w = set[i];
+    if (w.valid && w.line == line) {
+      ++hits;
+      if (pol == lru)
+        w.stamp = clock;
+      w.dirty |= write;
+      return;
+    }
+  }
+
+  ++misses;
+  way &w = set[victim(set)];
+  if (w.valid) {
+    ++evictions;
+    if (w.dirty) {
+      ++writebacks;
+      if (next)
+        next->access(w.line << line_bits, true);
+    }
+  }
+  if (next)
+    next->access(addr, false);
+  w.line = line;
+  w.valid = true;
+  w.dirty = write;
+  w.stamp = clock;
+}
+
+/**
+ * @brief Prints a row of statistics for the report.
+ * @param os The stream to print to.
+ ********************************************************************************/
+void cache_level::report(std::ostream &os) const {
+  static const char *const policy_names[] = {"lru", "fifo", "random"};
+
+  std::ostringstream shape;
+  if (size % 1024 == 0)
+    shape << size / 1024 << "K";
+  else
+    shape << size;
+  shape << "/" << ways << "/" << (1u << line_bits) << "/"
+        << policy_names[pol];
+
+  std::ostringstream rate;
+  rate << std::fixed << std::setprecision(2)
+       << (accesses ? 100.0 * misses / accesses : 0.0) << "%";
+
+  os << std::left << std::setw(6) << name << std::setw(18) << shape.str()
+     << std::right << std::setw(12) << accesses << std::setw(12) << hits
+     << std::setw(12) << misses << std::setw(10) << rate.str()
+     << std::setw(12) << evictions << std::setw(12) << writebacks << '\n';
+}
+
+/**
+ * @brief Reads a cache size, which may end in k or m.
+ * @param s The text.
+ * @param v Set to the size in bytes.
+ * @return false if s is not a size that fits in 32 bits.
+ ********************************************************************************/
+static bool parse_size(const std::string &s, uint32_t &v) {
+  std::istringstream iss(s);
+  uint64_t n;
+  if (!(iss >> n))
+    return false;
+  char suffix;
+  if (iss >> suffix) {
+    if (suffix == 'k' || suffix == 'K')
+      n <<= 10;
+    else if (suffix == 'm' || suffix == 'M')
+      n <<= 20;
+    else
+      return false;
+    if (iss >> suffix)
+      return false;
+  }
+  if (n == 0 || n > 0xffffffff)
+    return false;
+  v = n;
+  return true;
+}
+
+/**
+ * @brief Sets up the levels from a description.
+ * @param spec A comma-separated list of level=size:ways:line[:policy].
+ * @return false, after saying why on stderr, if spec is not valid.
+ ********************************************************************************/
+bool cache_hierarchy::configure(const std::string &spec) {
+  struct level {
+    bool present = false;
+    uint32_t size = 0, ways = 0, line = 0;
+    cache_level::policy pol = cache_level::lru;
+  } l1i_spec, l1d_spec, l2_spec;
+
+  std::istringstream items(spec);
+  std::string item;
+  while (std::getline(items, item, ',')) {
+    size_t eq = item.find('=');
+    std::string name = item.substr(0, eq);
+    level *l = name == "l1i" ? &l1i_spec
+               : name == "l1d" ? &l1d_spec
+               : name == "l2" ? &l2_spec : nullptr;
+    if (l == nullptr || eq == std::string::npos) {
+      std::cerr << "Unknown cache level in '" << item << "'\n";
+      return false;
+    }
+
+    std::vector<std::string> fields;
+    std::istringstream parts(item.substr(eq + 1));
+    std::string field;
+    while (std::getline(parts, field, ':'))
+      fields.push_back(field);
+
+    bool ok = (fields.size() == 3 || fields.size() == 4) &&
+              parse_size(fields[0], l->size) &&
+              parse_size(fields[1], l->ways) &&
+              parse_size(fields[2], l->line) && is_pow2(l->line);
+    if (ok && fields.size() == 4) {
+      if (fields[3] == "lru")
+        l->pol = cache_level::lru;
+      else if (fields[3] == "fifo")
+        l->pol = cache_level::fifo;
+      else if (fields[3] == "random")
+        l->pol = cache_level::random;
+      else
+        ok = false;
+    }
+    if (ok) {
+      uint64_t set_bytes = uint64_t(l->ways) * l->line;
+      ok = l->size % set_bytes == 0 && is_pow2(l->size / set_bytes);
+    }
+    if (!ok) {
+      std::cerr << "Bad cache geometry in '" << item << "'\n";
+      return false;
+    }
+    l->present = true;
+  }
+
+  if (!l1i_spec.present && !l1d_spec.present && !l2_spec.present) {
+    std::cerr << "No cache levels in '" << spec << "'\n";
+    return false;
+  }
+
+  auto build = [](const char *name, const level &l, cache_level *next) {
+    return std::unique_ptr<cache_level>(
+        l.present ? new cache_level(name, l.size, l.ways, l.line, l.pol, next)
+                  : nullptr);
+  };
+  l2_cache = build("L2", l2_spec, nullptr);
+  l1i_cache = build("L1I", l1i_spec, l2_cache.get());
+  l1d_cache = build("L1D", l1d_spec, l2_cache.get());
+  l1i = l1i_cache ? l1i_cache.get() : l2_cache.get();
+  l1d = l1d_cache ? l1d_cache.get() : l2_cache.get();
+  return true;
+}
+
+/**
+ * @brief Sends an access to the first level it reaches.
+ * @param c The level, or nullptr if there is none.
+ * @param addr The address.
+ * @param len The access size in bytes.
+ * @param write true for a store.
+ ********************************************************************************/
+void cache_hierarchy::access(cache_level *c, uint32_t addr, uint32_t len,
+                             bool write) {
+  if (c == nullptr)
+    return;
+  uint32_t mask = ~(c->get_line_size() - 1);
+  uint32_t last = addr + len - 1;
+  c->access(addr, write);
+  if ((last & mask) != (addr & mask))
+    c->access(last, write);
+}
+
+/**
+ * @brief Prints the statistics of every level.
+ * @param os The stream to print to.
+ ********************************************************************************/
+void cache_hierarchy::report(std::ostream &os) const {
+  std::ios_base::fmtflags flags = os.flags();
+  os << std::left << std::setw(6) << "Cache" << std::setw(18)
+     << "size/ways/line" << std::right << std::setw(12) << "accesses"
+     << std::setw(12) << "hits" << std::setw(12) << "misses"
+     << std::setw(10) << "miss rate" << std::setw(12) << "evictions"
+     << std::setw(12) << "writebacks" << '\n';
+  for (const cache_level *c :
+       {l1i_cache.get(), l1d_cache.get(), l2_cache.get()})
+    if (c != nullptr)
+      c->report(os);
+  os.flags(flags);
+}
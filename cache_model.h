@@ -0,0 +1,154 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Checks for a power of two, as cache and table sizes must be.
+ * @param v The value.
+ * @return true if v is a power of two.
+ ********************************************************************************/
+inline bool is_pow2(uint32_t v) { return v != 0 && (v & (v - 1)) == 0; }
+
+/**
+ * @class cache_level
+ * @brief One set-associative, write-back, write-allocate cache.
+ *
+ * Only tags are kept; the data always comes from memory, so the model
+ * changes no results, only the statistics. A miss fetches the line from
+ * the next level and an evicted dirty line is written back to it. Levels
+ * are not inclusive: evicting a line here leaves the copies in the other
+ * levels alone.
+ ********************************************************************************/
+class cache_level {
+public:
+  enum policy { lru, fifo, random };
+
+  /**
+   * @brief Constructs an empty cache.
+   * @param name The name used in the report, e.g. "L1D".
+   * @param size The capacity in bytes.
+   * @param ways The associativity.
+   * @param line_size The line size in bytes, a power of two.
+   * @param p How the line to evict is picked.
+   * @param next The level misses go to, or nullptr for memory.
+   ****************************************************************************/
+  cache_level(const std::string &name, uint32_t size, uint32_t ways,
+              uint32_t line_size, policy p, cache_level *next);
+
+  /**
+   * @brief Accesses the line holding addr.
+   * @param addr The address.
+   * @param write true for a store, which leaves the line dirty.
+   ****************************************************************************/
+  void access(uint32_t addr, bool write);
+
+  /**
+   * @brief Gets the line size.
+   * @return The line size in bytes.
+   ****************************************************************************/
+  uint32_t get_line_size() const { return 1u << line_bits; }
+
+  /**
+   * @brief Prints a row of statistics for the report.
+   * @param os The stream to print to.
+   ****************************************************************************/
+  void report(std::ostream &os) const;
+
+private:
+  /**
+   * @brief The tag and state of one line.
+   ****************************************************************************/
+  struct way {
+    uint32_t line = 0;          // address >> line_bits
+    bool valid = false;
+    bool dirty = false;
+    uint64_t stamp = 0;         // last use for LRU, fill time for FIFO
+  };
+
+  uint32_t victim(way *set);
+
+  std::string name;
+  uint32_t size;
+  uint32_t ways;
+  uint32_t line_bits;
+  uint32_t set_mask;
+  policy pol;
+  cache_level *next;
+  std::vector<way> lines;       // set s is lines[s * ways] onwards
+  uint64_t clock = 0;
+  uint32_t seed = 0x2545f491;   // xorshift state for random
+
+  uint64_t accesses = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  uint64_t writebacks = 0;
+};
+
+/**
+ * @class cache_hierarchy
+ * @brief Split L1 instruction and data caches in front of a unified L2.
+ *
+ * Any level may be left out, in which case its accesses go to the level
+ * behind it, or to memory. The hart feeds it every instruction fetch and
+ * every load and store; an access that straddles a line touches both
+ * lines.
+ ********************************************************************************/
+class cache_hierarchy {
+public:
+  /**
+   * @brief Sets up the levels from a description.
+   *
+   * The description is a comma-separated list of level=size:ways:line
+   * with an optional :lru, :fifo or :random at the end (lru if left out),
+   * where level is l1i, l1d or l2. The size may end in k or m, and the
+   * line size and the number of sets must be powers of two. For example
+   * "l1i=32k:4:64,l1d=32k:8:64,l2=256k:8:64:random".
+   *
+   * @param spec The description.
+   * @return false, after saying why on stderr, if spec is not valid.
+   ****************************************************************************/
+  bool configure(const std::string &spec);
+
+  /**
+   * @brief Records an instruction fetch.
+   * @param addr The address of the instruction.
+   * @param len Its length in bytes.
+   ****************************************************************************/
+  void fetch(uint32_t addr, uint32_t len) { access(l1i, addr, len, false); }
+
+  /**
+   * @brief Records a data access.
+   * @param addr The address.
+   * @param len The access size in bytes.
+   * @param write true for a store or an AMO.
+   ****************************************************************************/
+  void data(uint32_t addr, uint32_t len, bool write) {
+    access(l1d, addr, len, write);
+  }
+
+  /**
+   * @brief Prints the statistics of every level.
+   * @param os The stream to print to.
+   ****************************************************************************/
+  void report(std::ostream &os) const;
+
+private:
+  void access(cache_level *c, uint32_t addr, uint32_t len, bool write);
+
+  std::unique_ptr<cache_level> l2_cache;
+  std::unique_ptr<cache_level> l1i_cache;
+  std::unique_ptr<cache_level> l1d_cache;
+  cache_level *l1i = nullptr;   // where fetches go first
+  cache_level *l1d = nullptr;   // where loads and stores go first
+};
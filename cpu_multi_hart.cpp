@@ -0,0 +1,129 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file cpu_multi_hart.cpp
+ * @brief Implementation of the multi-hart driver.
+ ********************************************************************************/
+#include "cpu_multi_hart.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+/**
+ * @brief Constructs the harts and gives each one a stack.
+ * @param mem The memory every hart runs in.
+ * @param n The number of harts.
+ * @param stack_size The number of bytes of stack each hart gets.
+ ********************************************************************************/
+cpu_multi_hart::cpu_multi_hart(memory &mem, unsigned n, uint32_t stack_size)
+    : mem(mem) {
+  n = std::max(n, 1u);
+  this->stack_size =
+      uint32_t(std::min<uint64_t>(stack_size, mem.get_size() / n) & ~15u);
+
+  for (unsigned i = 0; i < n; ++i) {
+    harts.emplace_back(new hart(mem));
+    harts[i]->set_mhartid(i);
+    harts[i]->set_sp(uint32_t(mem.get_size() - uint64_t(i) * this->stack_size));
+  }
+}
+
+/**
+ * @brief Builds the prefix for a hart's output lines.
+ * @param i The hart's mhartid.
+ * @return "[i] ".
+ ********************************************************************************/
+std::string cpu_multi_hart::prefix(unsigned i) {
+  return "[" + std::to_string(i) + "] ";
+}
+
+/**
+ * @brief Runs every hart until it halts or reaches the execution limit.
+ *
+ * Only untraced runs with more than one hart use threads, and those
+ * share the memory between them, so it is switched into its thread-safe
+ * mode first.
+ *
+ * @param exec_limit The maximum number of instructions per hart, or 0
+ * for no limit.
+ ********************************************************************************/
+void cpu_multi_hart::run(uint64_t exec_limit) {
+  bool traced = std::any_of(harts.begin(), harts.end(),
+                            [](const std::unique_ptr<hart> &h) {
+                              return h->is_traced();
+                            });
+  if (traced) {
+    run_lockstep(exec_limit);
+  } else if (harts.size() == 1) {
+    harts[0]->run_blocks(exec_limit);
+  } else {
+    mem.share();
+    run_threads(exec_limit);
+  }
+
+  for (unsigned i = 0; i < harts.size(); ++i) {
+    std::string hdr = prefix(i);
+    std::cout << hdr << "Execution terminated. Reason: "
+              << harts[i]->get_halt_reason() << '\n'
+              << hdr << harts[i]->get_insn_counter()
+              << " instructions executed" << '\n';
+  }
+}
+
+/**
+ * @brief Runs each hart to completion on a host thread of its own.
+ * @param exec_limit The maximum number of instructions per hart.
+ ********************************************************************************/
+void cpu_multi_hart::run_threads(uint64_t exec_limit) {
+  std::vector<std::thread> threads;
+  for (std::unique_ptr<hart> &h : harts) {
+    hart *p = h.get();
+    threads.emplace_back([p, exec_limit]() {
+      p->claim_thread();
+      p->run_blocks(exec_limit);
+    });
+  }
+  for (std::thread &t : threads)
+    t.join();
+
+  // the main thread runs the harts from here on, e.g. for a later dump
+  for (std::unique_ptr<hart> &h : harts)
+    h->claim_thread();
+}
+
+/**
+ * @brief Runs the harts one instruction each in turn on this thread.
+ * @param exec_limit The maximum number of instructions per hart.
+ ********************************************************************************/
+void cpu_multi_hart::run_lockstep(uint64_t exec_limit) {
+  std::vector<std::string> hdrs;
+  for (unsigned i = 0; i < harts.size(); ++i)
+    hdrs.push_back(prefix(i));
+
+  bool running = true;
+  while (running) {
+    running = false;
+    for (unsigned i = 0; i < harts.size(); ++i) {
+      hart &h = *harts[i];
+      if (h.is_halted() ||
+          (exec_limit != 0 && h.get_insn_counter() == exec_limit))
+        continue;
+      h.tick(hdrs[i].c_str());
+      running = true;
+    }
+  }
+}
+
+/**
+ * @brief Dumps every hart's registers, then the memory once.
+ ********************************************************************************/
+void cpu_multi_hart::dump() const {
+  for (unsigned i = 0; i < harts.size(); ++i)
+    harts[i]->dump_regs(prefix(i));
+  mem.dump();
+}
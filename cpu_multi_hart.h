@@ -0,0 +1,100 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "rv32i_hart.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class cpu_multi_hart
+ * @brief Runs several harts against one shared memory.
+ *
+ * Hart i gets mhartid i and a stack of its own: hart 0's stack starts at
+ * the top of memory like cpu_single_hart's, and every other hart's starts
+ * stack_size bytes below the one before it. All harts start at the same
+ * pc, so guest code tells them apart by reading mhartid.
+ *
+ * Untraced runs put every hart on its own host thread. When any hart
+ * prints or records its instructions, the harts instead take turns a
+ * single instruction at a time on the calling thread, so the trace is
+ * readable and repeatable; each line is prefixed with "[i] ".
+ ********************************************************************************/
+class cpu_multi_hart {
+public:
+  static constexpr uint32_t default_stack_size = 0x10000;
+
+  /**
+   * @brief Constructs the harts.
+   *
+   * If memory is too small to give every hart stack_size bytes, the
+   * stacks shrink to an equal share of it.
+   *
+   * @param mem The memory every hart runs in.
+   * @param n The number of harts.
+   * @param stack_size The number of bytes of stack each hart gets.
+   ****************************************************************************/
+  cpu_multi_hart(memory &mem, unsigned n,
+                 uint32_t stack_size = default_stack_size);
+
+  /**
+   * @brief Gets the number of harts.
+   * @return The hart count.
+   ****************************************************************************/
+  unsigned get_hart_count() const { return unsigned(harts.size()); }
+
+  /**
+   * @brief Gets a hart, to set it up before run().
+   * @param i The hart's mhartid.
+   * @return The hart.
+   ****************************************************************************/
+  rv32i_hart &get_hart(unsigned i) { return *harts[i]; }
+
+  /**
+   * @brief Runs every hart until it halts or reaches the execution limit.
+   *
+   * Prints the halt reason and instruction count of each hart once they
+   * have all stopped.
+   *
+   * @param exec_limit The maximum number of instructions per hart, or 0
+   * for no limit.
+   ****************************************************************************/
+  void run(uint64_t exec_limit);
+
+  /**
+   * @brief Dumps every hart's registers, then the memory once.
+   ****************************************************************************/
+  void dump() const;
+
+private:
+  /**
+   * @class hart
+   * @brief An rv32i_hart that the driver can start with its own stack.
+   **************************************************************************/
+  class hart : public rv32i_hart {
+  public:
+    hart(memory &mem) : rv32i_hart(mem) {}
+
+    /**
+     * @brief Sets the stack pointer.
+     * @param sp The top of the hart's stack.
+     ************************************************************************/
+    void set_sp(uint32_t sp) { regs.set(2, sp); }
+
+    using rv32i_hart::run_blocks;
+  };
+
+  static std::string prefix(unsigned i);
+
+  void run_threads(uint64_t exec_limit);
+  void run_lockstep(uint64_t exec_limit);
+
+  memory &mem;
+  uint32_t stack_size;
+  std::vector<std::unique_ptr<hart>> harts;
+};
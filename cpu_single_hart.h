@@ -7,6 +7,7 @@
 */
 #pragma once
 #include "rv32i_hart.h"
+#include <functional>
 
 /**
  * @class cpu_single_hart
@@ -19,18 +20,26 @@ class cpu_single_hart : public rv32i_hart{
 public:
   /**
    * @brief Constructs a new cpu_single_hart object.
+   *
+   * Initializes the stack pointer (x2) to the top of memory.
+   *
    * @param mem Reference to the memory object to be used by the CPU.
    ****************************************************************************/
-  cpu_single_hart(memory &mem) : rv32i_hart(mem){}
+  cpu_single_hart(memory &mem) : rv32i_hart(mem) {
+    regs.set(2, mem.get_size());
+  }
 
   /**
    * @brief Runs the CPU simulation.
    *
-   * Initializes the stack pointer (x2) and executes instructions until
-   * the processor halts or the execution limit is reached.
+   * Executes instructions until the processor halts or the execution
+   * limit is reached.
    *
    * @param exec_limit The maximum number of instructions to execute.
    * If 0, the simulation runs until a halt condition occurs.
+   * @param on_stop Called each time request_stop() interrupts the run,
+   * which then carries on; may be empty.
    ****************************************************************************/
-  void run(uint64_t exec_limit);
+  void run(uint64_t exec_limit,
+           const std::function<void()> &on_stop = nullptr);
 };
@@ -0,0 +1,258 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#include "csr_file.h"
+#include <chrono>
+
+/**
+ * @brief Host time at startup, which the time CSR counts from.
+ *
+ * It is shared so that every hart reads the same time.
+ ********************************************************************************/
+static const std::chrono::steady_clock::time_point host_epoch =
+    std::chrono::steady_clock::now();
+
+/**
+ * @brief The bits of each value CSR that writes can change.
+ *
+ * mstatus keeps MIE and MPIE; MPP stays machine mode, the only mode there
+ * is. mie keeps the three machine interrupt enables. mtvec may be direct
+ * or vectored but not one of the reserved modes, and mepc is always at
+ * least 2-byte aligned.
+ ********************************************************************************/
+const uint32_t csr_file::value_masks[value_count] = {
+    0x00000088,         // mstatus
+    0x00000888,         // mie
+    0xfffffffd,         // mtvec
+    0xffffffff,         // mscratch
+    0xfffffffe,         // mepc
+    0xffffffff,         // mcause
+    0xffffffff,         // mtval
+};
+
+const std::vector<csr_file::slot> csr_file::table = csr_file::build_table();
+
+/**
+ * @brief Builds the CSR number lookup table.
+ * @return One slot for each CSR number, missing unless listed here.
+ ********************************************************************************/
+std::vector<csr_file::slot> csr_file::build_table() {
+  std::vector<slot> t(csr_count);
+  auto set = [&t](uint32_t csr, slot::kind_t kind, uint8_t arg) {
+    t[csr].kind = kind;
+    t[csr].arg = arg;
+  };
+
+  set(csr_mstatus, slot::value, v_mstatus);
+  set(csr_misa, slot::misa, 0);
+  set(csr_mie, slot::value, v_mie);
+  set(csr_mtvec, slot::value, v_mtvec);
+  set(csr_mstatush, slot::zero, 0);
+  set(csr_mscratch, slot::value, v_mscratch);
+  set(csr_mepc, slot::mepc, v_mepc);
+  set(csr_mcause, slot::value, v_mcause);
+  set(csr_mtval, slot::value, v_mtval);
+  set(csr_mip, slot::zero, 0);
+
+  set(csr_mvendorid, slot::zero, 0);
+  set(csr_marchid, slot::zero, 0);
+  set(csr_mimpid, slot::zero, 0);
+  set(csr_mhartid, slot::mhartid, 0);
+  set(csr_mconfigptr, slot::zero, 0);
+
+  const uint32_t high = csr_counter_high;
+  for (uint8_t n = 0; n < 32; ++n) {
+    set(csr_cycle + n, slot::counter, n);
+    set(csr_cycle + high + n, slot::counter_high, n);
+    if (n == csr_time - csr_cycle)
+      continue;                 // time has no machine-mode counterpart
+    set(csr_mcycle + n, slot::counter, n);
+    set(csr_mcycle + high + n, slot::counter_high, n);
+  }
+  return t;
+}
+
+/**
+ * @brief Constructs a CSR file in its reset state.
+ * @param insn_counter The hart's instruction count.
+ * @param mhartid The hart's ID.
+ ********************************************************************************/
+csr_file::csr_file(const uint64_t &insn_counter, const uint32_t &mhartid)
+    : insn_counter(insn_counter), mhartid(mhartid) {
+  set_compressed(false);
+  reset();
+}
+
+/**
+ * @brief Puts every CSR back into its reset state.
+ *
+ * mstatus.MPP reads as machine mode, and everything else starts at zero.
+ ********************************************************************************/
+void csr_file::reset() {
+  for (uint32_t &v : values)
+    v = 0;
+  values[v_mstatus] = 0x1800;
+  cycle_offset = 0;
+  instret_offset = 0;
+}
+
+/**
+ * @brief Sets whether RV32C is on.
+ *
+ * Without RV32C, bit 1 of mepc is kept but reads as zero, as the spec
+ * has it for IALIGN=32.
+ *
+ * @param on true if 16-bit instructions are allowed.
+ ********************************************************************************/
+void csr_file::set_compressed(bool on) {
+  // MXL=1 (32-bit) and the A, I and M extensions, plus C if it is on
+  misa = 1u << 30 | 1u << ('A' - 'A') | 1u << ('I' - 'A') | 1u << ('M' - 'A');
+  if (on)
+    misa |= 1u << ('C' - 'A');
+  epc_mask = on ? ~uint32_t(1) : ~uint32_t(3);
+}
+
+/**
+ * @brief Reads a 64-bit counter, or zero for counters that are not there.
+ *
+ * cycle and instret both count instructions; cycle has no pipeline to
+ * model. time is the host's monotonic clock in nanoseconds, i.e. a 1 GHz
+ * timebase.
+ *
+ * @param n The counter's index, 0 through 31, as in cycle + n.
+ * @return The counter's value.
+ ********************************************************************************/
+uint64_t csr_file::read_counter(uint32_t n) const {
+  switch (n) {
+  case csr_cycle - csr_cycle:
+    return insn_counter - 1 + cycle_offset;
+  case csr_time - csr_cycle:
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - host_epoch)
+        .count();
+  case csr_instret - csr_cycle:
+    return insn_counter - 1 + instret_offset;
+  default:
+    return 0;                   // hpmcounter3-31 count no events
+  }
+}
+
+/**
+ * @brief Reads a CSR.
+ * @param csr The CSR number.
+ * @param val Set to the CSR's value.
+ * @return false if there is no such CSR.
+ ********************************************************************************/
+bool csr_file::read(uint32_t csr, uint32_t &val) const {
+  const slot &s = table[csr & (csr_count - 1)];
+  switch (s.kind) {
+  case slot::missing:
+    return false;
+  case slot::value:
+    val = values[s.arg];
+    return true;
+  case slot::mepc:
+    val = values[s.arg] & epc_mask;
+    return true;
+  case slot::zero:
+    val = 0;
+    return true;
+  case slot::misa:
+    val = misa;
+    return true;
+  case slot::mhartid:
+    val = mhartid;
+    return true;
+  case slot::counter:
+    val = read_counter(s.arg);
+    return true;
+  case slot::counter_high:
+    val = read_counter(s.arg) >> 32;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Writes a CSR.
+ *
+ * CSR numbers with both top bits set are read-only. misa and the other
+ * zero CSRs ignore writes, as do the mhpmcounters, which are hardwired to
+ * zero.
+ *
+ * @param csr The CSR number.
+ * @param val The value to write.
+ * @return false if there is no such CSR or it is read-only.
+ ********************************************************************************/
+bool csr_file::write(uint32_t csr, uint32_t val) {
+  csr &= csr_count - 1;
+  if ((csr >> 10) == 3)
+    return false;
+
+  const slot &s = table[csr];
+  switch (s.kind) {
+  case slot::missing:
+    return false;
+  case slot::value:
+  case slot::mepc:
+    values[s.arg] = (values[s.arg] & ~value_masks[s.arg]) |
+                    (val & value_masks[s.arg]);
+    return true;
+  case slot::counter:
+  case slot::counter_high: {
+    // only mcycle and minstret count; the mhpmcounters stay zero
+    uint64_t *offset = s.arg == 0 ? &cycle_offset
+                       : s.arg == 2 ? &instret_offset : nullptr;
+    if (offset == nullptr)
+      return true;
+    uint64_t v = read_counter(s.arg);
+    if (s.kind == slot::counter_high)
+      v = (v & 0xffffffff) | uint64_t(val) << 32;
+    else
+      v = (v & ~uint64_t(0xffffffff)) | val;
+    // the next instruction reads insn_counter + offset
+    *offset = v - insn_counter;
+    return true;
+  }
+  default:
+    return true;
+  }
+}
+
+/**
+ * @brief Copies the CSRs out for a snapshot.
+ * @param s The hart state to fill in.
+ ********************************************************************************/
+void csr_file::save(snapshot_hart &s) const {
+  s.cycle_offset = cycle_offset;
+  s.instret_offset = instret_offset;
+  s.mstatus = values[v_mstatus];
+  s.mie = values[v_mie];
+  s.mtvec = values[v_mtvec];
+  s.mscratch = values[v_mscratch];
+  s.mepc = values[v_mepc];
+  s.mcause = values[v_mcause];
+  s.mtval = values[v_mtval];
+}
+
+/**
+ * @brief Puts the CSRs back from a snapshot.
+ *
+ * The values go through the write masks, so a damaged snapshot cannot
+ * set bits that are not implemented.
+ *
+ * @param s The saved hart state.
+ ********************************************************************************/
+void csr_file::restore(const snapshot_hart &s) {
+  reset();
+  cycle_offset = s.cycle_offset;
+  instret_offset = s.instret_offset;
+  const uint32_t saved[value_count] = {s.mstatus, s.mie,  s.mtvec, s.mscratch,
+                                       s.mepc,    s.mcause, s.mtval};
+  for (uint32_t i = 0; i < value_count; ++i)
+    values[i] = (values[i] & ~value_masks[i]) | (saved[i] & value_masks[i]);
+}
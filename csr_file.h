@@ -0,0 +1,154 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "snapshot_format.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class csr_file
+ * @brief The control and status registers of one machine-mode-only hart.
+ *
+ * Covers the machine trap setup and handling CSRs (mstatus, misa, mie,
+ * mtvec, mscratch, mepc, mcause, mtval, mip), the machine information
+ * CSRs and the counters. A CSR number is looked up in a table shared by
+ * every hart that has a slot for each of the 4096 numbers, so an access
+ * costs one load and a switch no matter which CSR it is.
+ *
+ * Writes follow the WARL rules of the privileged spec: bits that are not
+ * implemented keep their value. The hart has no traps, so mstatus.MIE and
+ * mie can be set but no interrupt is ever taken, and mip reads as zero.
+ ********************************************************************************/
+class csr_file {
+public:
+  // CSR numbers; each of the 64-bit counters has its high half at +0x80
+  static constexpr uint32_t csr_cycle             = 0xc00;
+  static constexpr uint32_t csr_time              = 0xc01;
+  static constexpr uint32_t csr_instret           = 0xc02;
+  static constexpr uint32_t csr_hpmcounter3       = 0xc03;
+  static constexpr uint32_t csr_hpmcounter31      = 0xc1f;
+  static constexpr uint32_t csr_mcycle            = 0xb00;
+  static constexpr uint32_t csr_minstret          = 0xb02;
+  static constexpr uint32_t csr_mhpmcounter3      = 0xb03;
+  static constexpr uint32_t csr_mhpmcounter31     = 0xb1f;
+  static constexpr uint32_t csr_counter_high      = 0x080;
+  static constexpr uint32_t csr_mstatus           = 0x300;
+  static constexpr uint32_t csr_misa              = 0x301;
+  static constexpr uint32_t csr_mie               = 0x304;
+  static constexpr uint32_t csr_mtvec             = 0x305;
+  static constexpr uint32_t csr_mstatush          = 0x310;
+  static constexpr uint32_t csr_mscratch          = 0x340;
+  static constexpr uint32_t csr_mepc              = 0x341;
+  static constexpr uint32_t csr_mcause            = 0x342;
+  static constexpr uint32_t csr_mtval             = 0x343;
+  static constexpr uint32_t csr_mip               = 0x344;
+  static constexpr uint32_t csr_mvendorid         = 0xf11;
+  static constexpr uint32_t csr_marchid           = 0xf12;
+  static constexpr uint32_t csr_mimpid            = 0xf13;
+  static constexpr uint32_t csr_mhartid           = 0xf14;
+  static constexpr uint32_t csr_mconfigptr        = 0xf15;
+
+  /**
+   * @brief Constructs a CSR file in its reset state.
+   * @param insn_counter The hart's instruction count, which cycle and
+   * instret are read from. It must outlive the CSR file.
+   * @param mhartid The hart's ID, which mhartid reads. It must outlive
+   * the CSR file.
+   ****************************************************************************/
+  csr_file(const uint64_t &insn_counter, const uint32_t &mhartid);
+
+  /**
+   * @brief Puts every CSR back into its reset state.
+   *
+   * misa keeps its C bit, which follows set_compressed().
+   ****************************************************************************/
+  void reset();
+
+  /**
+   * @brief Reads a CSR.
+   *
+   * A counter read does not include the instruction doing the reading,
+   * which must already have been counted.
+   *
+   * @param csr The CSR number.
+   * @param val Set to the CSR's value.
+   * @return false if there is no such CSR.
+   ****************************************************************************/
+  bool read(uint32_t csr, uint32_t &val) const;
+
+  /**
+   * @brief Writes a CSR.
+   *
+   * Writing mcycle or minstret, or a high half, sets the value the next
+   * instruction reads.
+   *
+   * @param csr The CSR number.
+   * @param val The value to write.
+   * @return false if there is no such CSR or it is read-only.
+   ****************************************************************************/
+  bool write(uint32_t csr, uint32_t val);
+
+  /**
+   * @brief Sets whether RV32C is on, which shows in misa and mepc.
+   * @param on true if 16-bit instructions are allowed.
+   ****************************************************************************/
+  void set_compressed(bool on);
+
+  /**
+   * @brief Copies the CSRs out for a snapshot.
+   * @param s The hart state to fill in.
+   ****************************************************************************/
+  void save(snapshot_hart &s) const;
+
+  /**
+   * @brief Puts the CSRs back from a snapshot.
+   * @param s The saved hart state.
+   ****************************************************************************/
+  void restore(const snapshot_hart &s);
+
+private:
+  // the CSRs that hold a value; see value_masks
+  enum value_index {
+    v_mstatus, v_mie, v_mtvec, v_mscratch, v_mepc, v_mcause, v_mtval,
+    value_count
+  };
+
+  /**
+   * @brief What a CSR number refers to, as kept in the lookup table.
+   ****************************************************************************/
+  struct slot {
+    enum kind_t : uint8_t {
+      missing,          // no such CSR
+      value,            // values[arg]
+      mepc,             // values[v_mepc], read through epc_mask
+      zero,             // reads as zero and ignores writes
+      misa,             // the ISA, with C from set_compressed()
+      mhartid,          // the hart's ID
+      counter,          // low half of counter arg
+      counter_high      // high half of counter arg
+    };
+    kind_t kind = missing;
+    uint8_t arg = 0;
+  };
+
+  static constexpr uint32_t csr_count = 4096;
+  static std::vector<slot> build_table();
+  static const std::vector<slot> table;         // indexed by CSR number
+  static const uint32_t value_masks[value_count];
+
+  uint64_t read_counter(uint32_t n) const;
+
+  const uint64_t &insn_counter;
+  const uint32_t &mhartid;
+
+  uint32_t values[value_count];
+  uint32_t misa = {0};
+  uint32_t epc_mask = {~uint32_t(3)};   // mepc bits that can read as 1
+  uint64_t cycle_offset = {0};          // mcycle - instructions run
+  uint64_t instret_offset = {0};        // minstret - instructions run
+};
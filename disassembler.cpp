@@ -0,0 +1,170 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file disassembler.cpp
+ * @brief Implementation of the chunked, multi-threaded disassembler.
+ ********************************************************************************/
+#include "disassembler.h"
+#include "hex.h"
+#include "rv32i_decode.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Sets up a disassembler for a memory image.
+ * @param m The memory to disassemble.
+ * @param s The program's symbols.
+ * @param threads The number of worker threads, 0 to use one per core.
+ ********************************************************************************/
+disassembler::disassembler(const memory &m, const symbol_table &s,
+                           unsigned threads)
+    : mem(m), syms(s), threads(threads) {
+  if (this->threads == 0)
+    this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * @brief Decodes part of the image into a text buffer.
+ *
+ * Each instruction becomes one line: its address, the raw word and the
+ * decoded instruction. A 16-bit instruction shows 4 digits padded to the
+ * width of 8. Addresses that start a known symbol are preceded by a label
+ * line.
+ *
+ * @param first The address of the first instruction.
+ * @param end Decoding stops at the first instruction at or past this.
+ * @param out Where to put the text; any old contents are replaced.
+ * @return The address after the last instruction decoded.
+ ********************************************************************************/
+uint64_t disassembler::decode_chunk(uint64_t first, uint64_t end,
+                                    std::string &out) const {
+  out.clear();
+  out.reserve(end > first ? (end - first) / 4 * 48 : 0);
+
+  char line[9 + 1 + 8 + 2];
+  uint64_t addr = first;
+  while (addr < end) {
+    const symbol *sym = syms.at(addr);
+    if (sym != nullptr) {
+      out += '<';
+      out += sym->name;
+      out += ">:\n";
+    }
+
+    char *p = hex::fmt_hex32(line, addr);
+    *p++ = ':';
+    *p++ = ' ';
+    uint16_t low = compressed ? mem.get16(addr) : 0;
+    if (compressed && rv32i_decode::is_compressed(low)) {
+      p = hex::fmt_hex16(p, low);
+      p = std::fill_n(p, 6, ' ');
+      out.append(line, p - line);
+      out += rv32i_decode::decode_compressed(addr, low);
+      addr += 2;
+    } else {
+      uint32_t inst = mem.get32(addr);
+      p = hex::fmt_hex32(p, inst);
+      *p++ = ' ';
+      *p++ = ' ';
+      out.append(line, p - line);
+      out += rv32i_decode::decode(addr, inst);
+      addr += 4;
+    }
+    out += '\n';
+  }
+  return addr;
+}
+
+/**
+ * @brief Disassembles the whole image.
+ *
+ * Workers claim chunks in address order while the calling thread writes
+ * the finished ones. At most two chunks per worker are held at a time,
+ * so a slow output stream holds back the workers rather than letting the
+ * whole disassembly pile up in memory.
+ *
+ * @param os Where to write the disassembly.
+ ********************************************************************************/
+void disassembler::write(std::ostream &os) const {
+  uint64_t chunk_bytes = uint64_t(chunk_words) * 4;
+  uint64_t chunks = (mem.get_size() + chunk_bytes - 1) / chunk_bytes;
+  auto chunk_end = [&](uint64_t i) {
+    return std::min((i + 1) * chunk_bytes, mem.get_size());
+  };
+
+  if (threads <= 1 || chunks <= 1) {
+    std::string text;
+    uint64_t at = 0;
+    for (uint64_t i = 0; i < chunks; ++i) {
+      at = decode_chunk(at, chunk_end(i), text);
+      os.write(text.data(), text.size());
+    }
+    os.flush();
+    return;
+  }
+
+  unsigned workers = unsigned(std::min<uint64_t>(threads, chunks));
+  size_t window = 2 * workers;
+  std::vector<std::string> slots(window);
+  std::vector<uint64_t> ends(window);   // where each slot's text stopped
+  std::vector<bool> ready(window, false);
+  uint64_t next = 0;            // next chunk to hand to a worker
+  uint64_t written = 0;         // chunks already written to os
+  std::mutex m;
+  std::condition_variable cv;
+
+  auto work = [&]() {
+    for (;;) {
+      uint64_t i;
+      {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&] { return next == chunks || next < written + window; });
+        if (next == chunks)
+          return;
+        i = next++;
+      }
+      ends[i % window] =
+          decode_chunk(i * chunk_bytes, chunk_end(i), slots[i % window]);
+      {
+        std::lock_guard<std::mutex> lock(m);
+        ready[i % window] = true;
+      }
+      cv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < workers; ++t)
+    pool.emplace_back(work);
+
+  uint64_t at = 0;               // where the next chunk has to start
+  for (uint64_t i = 0; i < chunks; ++i) {
+    size_t s = i % window;
+    {
+      std::unique_lock<std::mutex> lock(m);
+      cv.wait(lock, [&] { return bool(ready[s]); });
+    }
+    if (at != i * chunk_bytes)
+      ends[s] = decode_chunk(at, chunk_end(i), slots[s]);
+    at = ends[s];
+    os.write(slots[s].data(), slots[s].size());
+    {
+      std::lock_guard<std::mutex> lock(m);
+      ready[s] = false;
+      ++written;
+    }
+    cv.notify_all();
+  }
+
+  for (auto &t : pool)
+    t.join();
+  os.flush();
+}
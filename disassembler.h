@@ -0,0 +1,61 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "memory.h"
+#include "symbol_table.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * @class disassembler
+ * @brief Writes the disassembly of a memory image.
+ *
+ * The image is split into fixed-size chunks that worker threads decode
+ * into their own text buffers. The buffers are written to the output in
+ * address order with one write each, so the result is the same as a
+ * serial walk over the image. Images no larger than a chunk, or runs with
+ * a single thread, are decoded on the calling thread.
+ *
+ * With RV32C, a 32-bit instruction can straddle two chunks. The next chunk
+ * was decoded from its first halfword, so the writer decodes it again from
+ * where the straddling instruction ended.
+ ********************************************************************************/
+class disassembler {
+public:
+  static constexpr uint32_t chunk_words = 64 * 1024;
+
+  /**
+   * @brief Sets up a disassembler for a memory image.
+   * @param m The memory to disassemble.
+   * @param s The program's symbols, empty for a flat binary.
+   * @param threads The number of worker threads, 0 to use one per core.
+   ****************************************************************************/
+  disassembler(const memory &m, const symbol_table &s, unsigned threads = 0);
+
+  /**
+   * @brief Disassembles the whole image.
+   * @param os Where to write the disassembly.
+   ****************************************************************************/
+  void write(std::ostream &os) const;
+
+  /**
+   * @brief Sets whether to decode RV32C compressed instructions.
+   * @param on true to walk the image an instruction at a time, 2 or 4
+   * bytes each, instead of a word at a time.
+   ****************************************************************************/
+  void set_compressed(bool on) { compressed = on; }
+
+private:
+  uint64_t decode_chunk(uint64_t first, uint64_t end, std::string &out) const;
+
+  const memory &mem;
+  const symbol_table &syms;
+  unsigned threads;
+  bool compressed = {false};
+};
@@ -0,0 +1,144 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file elf_loader.cpp
+ * @brief Implementation of the ELF32 executable loader.
+ ********************************************************************************/
+#include "elf_loader.h"
+#include <cstring>
+#include <elf.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+/**
+ * @brief Checks if a file starts with the ELF magic number.
+ * @param fname The path to the file.
+ * @return true if the file looks like an ELF file.
+ ********************************************************************************/
+bool elf_loader::is_elf(const std::string &fname) {
+  std::ifstream infile(fname, std::ios::in | std::ios::binary);
+  char magic[SELFMAG];
+  return infile.read(magic, SELFMAG) &&
+         std::memcmp(magic, ELFMAG, SELFMAG) == 0;
+}
+
+/**
+ * @brief Loads an ELF executable into memory.
+ *
+ * The file is read in one go and the headers are checked against its
+ * length before anything is copied out of it.
+ *
+ * @param fname The path to the file.
+ * @param mem The memory to load the segments into.
+ * @return true if the file was loaded.
+ ********************************************************************************/
+bool elf_loader::load(const std::string &fname, memory &mem) {
+  std::ifstream infile(fname, std::ios::in | std::ios::binary);
+  if (!infile) {
+    std::cerr << "Can't open file '" << fname << "' for reading.";
+    return false;
+  }
+  std::string image((std::istreambuf_iterator<char>(infile)),
+                    std::istreambuf_iterator<char>());
+
+  Elf32_Ehdr eh;
+  if (image.size() < sizeof(eh)) {
+    std::cerr << "'" << fname << "' is not a valid ELF file.";
+    return false;
+  }
+  std::memcpy(&eh, image.data(), sizeof(eh));
+  if (eh.e_ident[EI_CLASS] != ELFCLASS32 ||
+      eh.e_ident[EI_DATA] != ELFDATA2LSB || eh.e_machine != EM_RISCV ||
+      eh.e_type != ET_EXEC) {
+    std::cerr << "'" << fname << "' is not an ELF32 RISC-V executable.";
+    return false;
+  }
+  if (eh.e_phentsize != sizeof(Elf32_Phdr) ||
+      eh.e_phoff + uint64_t(eh.e_phnum) * sizeof(Elf32_Phdr) > image.size()) {
+    std::cerr << "'" << fname << "' has a bad program header table.";
+    return false;
+  }
+
+  for (uint32_t i = 0; i < eh.e_phnum; ++i) {
+    Elf32_Phdr ph;
+    std::memcpy(&ph, image.data() + eh.e_phoff + i * sizeof(ph), sizeof(ph));
+    if (ph.p_type != PT_LOAD || ph.p_memsz == 0)
+      continue;
+
+    if (ph.p_filesz > ph.p_memsz ||
+        uint64_t(ph.p_offset) + ph.p_filesz > image.size() ||
+        uint64_t(ph.p_vaddr) + ph.p_memsz > mem.get_size()) {
+      std::cerr << "Segment " << i << " of '" << fname
+                << "' does not fit in memory.";
+      return false;
+    }
+
+    mem.set_bytes(ph.p_vaddr,
+                  reinterpret_cast<const uint8_t *>(image.data()) +
+                      ph.p_offset,
+                  ph.p_filesz);
+    mem.zero_bytes(ph.p_vaddr + ph.p_filesz, ph.p_memsz - ph.p_filesz);
+  }
+
+  entry = eh.e_entry;
+  load_symbols(image);
+  return true;
+}
+
+/**
+ * @brief Reads the function and object symbols out of the file.
+ *
+ * Section, file and local assembler labels (.L*) are skipped since they
+ * do not name anything useful. A file without a symbol table or with a
+ * malformed one just ends up with an empty table.
+ *
+ * @param image The whole ELF file.
+ ********************************************************************************/
+void elf_loader::load_symbols(const std::string &image) {
+  Elf32_Ehdr eh;
+  std::memcpy(&eh, image.data(), sizeof(eh));
+  if (eh.e_shentsize != sizeof(Elf32_Shdr) ||
+      eh.e_shoff + uint64_t(eh.e_shnum) * sizeof(Elf32_Shdr) > image.size())
+    return;
+
+  auto section = [&](uint32_t i) {
+    Elf32_Shdr sh;
+    std::memcpy(&sh, image.data() + eh.e_shoff + i * sizeof(sh), sizeof(sh));
+    return sh;
+  };
+
+  for (uint32_t i = 0; i < eh.e_shnum; ++i) {
+    Elf32_Shdr sh = section(i);
+    if (sh.sh_type != SHT_SYMTAB || sh.sh_link >= eh.e_shnum ||
+        sh.sh_entsize != sizeof(Elf32_Sym) ||
+        uint64_t(sh.sh_offset) + sh.sh_size > image.size())
+      continue;
+
+    Elf32_Shdr str = section(sh.sh_link);
+    if (uint64_t(str.sh_offset) + str.sh_size > image.size())
+      continue;
+
+    for (uint32_t off = 0; off + sizeof(Elf32_Sym) <= sh.sh_size;
+         off += sizeof(Elf32_Sym)) {
+      Elf32_Sym sym;
+      std::memcpy(&sym, image.data() + sh.sh_offset + off, sizeof(sym));
+      int type = ELF32_ST_TYPE(sym.st_info);
+      if ((type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE) ||
+          sym.st_shndx == SHN_UNDEF || sym.st_shndx == SHN_ABS ||
+          sym.st_name == 0 || sym.st_name >= str.sh_size)
+        continue;
+
+      const char *name = image.data() + str.sh_offset + sym.st_name;
+      size_t len = strnlen(name, str.sh_size - sym.st_name);
+      if (len == 0 || std::strncmp(name, ".L", 2) == 0)
+        continue;
+      symbols.add(sym.st_value, sym.st_size, std::string(name, len));
+    }
+  }
+}
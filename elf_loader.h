@@ -0,0 +1,61 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "memory.h"
+#include "symbol_table.h"
+#include <cstdint>
+#include <string>
+
+/**
+ * @class elf_loader
+ * @brief Loads statically linked ELF32 RISC-V executables into memory.
+ *
+ * Each PT_LOAD segment is copied to its virtual address and the part of
+ * it past the end of the file data (the BSS) is zeroed. Nothing outside
+ * the segments is touched, so the rest of memory keeps its fill pattern.
+ * The entry point and the symbol table are kept for the caller.
+ ********************************************************************************/
+class elf_loader {
+public:
+  /**
+   * @brief Checks if a file starts with the ELF magic number.
+   * @param fname The path to the file.
+   * @return true if the file looks like an ELF file.
+   ****************************************************************************/
+  static bool is_elf(const std::string &fname);
+
+  /**
+   * @brief Loads an ELF executable into memory.
+   *
+   * Prints a message to std::cerr and returns false if the file is not a
+   * 32-bit little-endian RISC-V executable or a segment does not fit.
+   *
+   * @param fname The path to the file.
+   * @param mem The memory to load the segments into.
+   * @return true if the file was loaded.
+   ****************************************************************************/
+  bool load(const std::string &fname, memory &mem);
+
+  /**
+   * @brief Gets the address execution should start at.
+   * @return The e_entry field of the loaded file.
+   ****************************************************************************/
+  uint32_t get_entry() const { return entry; }
+
+  /**
+   * @brief Gets the function and object symbols of the loaded file.
+   * @return The symbol table, which is empty if the file was stripped.
+   ****************************************************************************/
+  const symbol_table &get_symbols() const { return symbols; }
+
+private:
+  void load_symbols(const std::string &image);
+
+  uint32_t entry = 0;
+  symbol_table symbols;
+};
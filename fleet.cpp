@@ -0,0 +1,301 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file fleet.cpp
+ * @brief Implementation of the batch runner.
+ ********************************************************************************/
+#include "fleet.h"
+#include "elf_loader.h"
+#include "fork_point.h"
+#include "hex.h"
+#include "memory.h"
+#include "rv32i_hart.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+/**
+ * @class fleet::hart
+ * @brief An rv32i_hart that runs quietly and reports its final state.
+ ********************************************************************************/
+class fleet::hart : public rv32i_hart {
+public:
+  hart(memory &mem) : rv32i_hart(mem) {}
+
+  /**
+   * @brief Sets the stack pointer.
+   * @param sp The top of the stack.
+   ****************************************************************************/
+  void set_sp(uint32_t sp) { regs.set(2, sp); }
+
+  /**
+   * @brief Reads a register.
+   * @param r The register number.
+   * @return The register's value.
+   ****************************************************************************/
+  uint32_t get_reg(uint32_t r) const { return regs.get(r); }
+
+  using rv32i_hart::run_blocks;
+};
+
+/**
+ * @struct fleet::image
+ * @brief A loaded program that the jobs running it fork from.
+ ********************************************************************************/
+struct fleet::image {
+  std::once_flag loaded;
+  std::unique_ptr<fork_point> start;   // null if the program didn't load
+  const char *error = nullptr;
+};
+
+/**
+ * @brief Quotes a string for a JSON result line.
+ * @param s The string.
+ * @return s in double quotes, with quotes, backslashes and control
+ * characters escaped.
+ ********************************************************************************/
+static std::string json_string(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (uint8_t(c) < 0x20) {
+      out += "\\u00";
+      out += hex::to_hex8(uint8_t(c));
+    } else {
+      out += c;
+    }
+  }
+  return out + '"';
+}
+
+/**
+ * @brief Sets up an empty fleet.
+ * @param threads The number of worker threads, 0 to use one per core.
+ ********************************************************************************/
+fleet::fleet(unsigned threads) : threads(threads) {
+  if (this->threads == 0)
+    this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * @brief Reads jobs from a manifest file.
+ *
+ * Reports the first bad line on stderr.
+ *
+ * @param fname The path to the manifest.
+ * @param memory_limit The memory size of jobs that do not give one.
+ * @param exec_limit The execution limit of jobs that do not give one.
+ * @return true if the whole manifest was read.
+ ********************************************************************************/
+bool fleet::load_manifest(const std::string &fname, uint64_t memory_limit,
+                          uint64_t exec_limit) {
+  std::ifstream infile(fname);
+  if (!infile) {
+    std::cerr << "Can't open file '" << fname << "' for reading.\n";
+    return false;
+  }
+
+  size_t slash = fname.rfind('/');
+  std::string dir =
+      slash == std::string::npos ? "" : fname.substr(0, slash + 1);
+
+  std::string line;
+  for (unsigned n = 1; std::getline(infile, line); ++n) {
+    std::istringstream iss(line);
+    job j = {"", memory_limit, exec_limit};
+    if (!(iss >> j.file) || j.file[0] == '#')
+      continue;
+    if (j.file[0] != '/')
+      j.file = dir + j.file;
+
+    std::string field;
+    uint64_t *limits[] = {&j.memory_limit, &j.exec_limit};
+    for (uint64_t *limit : limits) {
+      if (!(iss >> field))
+        break;
+      std::istringstream num(field);
+      if (!(num >> std::hex >> *limit) || !num.eof()) {
+        std::cerr << fname << ":" << n << ": bad hex number '" << field
+                  << "'\n";
+        return false;
+      }
+    }
+    if (iss >> field) {
+      std::cerr << fname << ":" << n << ": unexpected '" << field << "'\n";
+      return false;
+    }
+    add(j);
+  }
+  return true;
+}
+
+/**
+ * @brief Claims the next job for a worker.
+ *
+ * Takes the first job of the worker's own queue, or failing that the last
+ * job of the first other queue that has one.
+ *
+ * @param w The worker's number.
+ * @param i Set to the index of the job claimed.
+ * @return false once every queue is empty.
+ ********************************************************************************/
+bool fleet::next_job(unsigned w, size_t &i) {
+  {
+    work_queue &q = *queues[w];
+    std::lock_guard<std::mutex> lock(q.m);
+    if (!q.jobs.empty()) {
+      i = q.jobs.front();
+      q.jobs.pop_front();
+      return true;
+    }
+  }
+  for (size_t k = 1; k < queues.size(); ++k) {
+    work_queue &q = *queues[(w + k) % queues.size()];
+    std::lock_guard<std::mutex> lock(q.m);
+    if (!q.jobs.empty()) {
+      i = q.jobs.back();
+      q.jobs.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Loads a job's program and takes a fork point of it.
+ *
+ * The hart starts at the program's entry point with the stack at the top
+ * of memory, like cpu_single_hart.
+ *
+ * @param j The first job to run the program.
+ * @param img Where to put the fork point, or the reason there is none.
+ ********************************************************************************/
+void fleet::load_image(const job &j, image &img) const {
+  // the loaders complain on stderr, so catch the common case first
+  if (!std::ifstream(j.file)) {
+    img.error = "can't open file";
+    return;
+  }
+
+  memory mem(j.memory_limit);
+  elf_loader elf;
+  bool is_elf = elf_loader::is_elf(j.file);
+  if (is_elf ? !elf.load(j.file, mem) : !mem.load_file(j.file)) {
+    img.error = "can't load file";
+    return;
+  }
+
+  hart h(mem);
+  h.set_pc(elf.get_entry());
+  h.set_sp(uint32_t(mem.get_size()));
+  h.set_compressed(compressed);
+  img.start.reset(new fork_point(h, mem));
+}
+
+/**
+ * @brief Runs one job to completion on the calling thread.
+ *
+ * Forks the job's image, loading it first if no other job has, and runs
+ * a hart in the fork until it halts or reaches the job's execution limit.
+ *
+ * @param i The index of the job.
+ * @param img The job's image. Dropped once forked, so the image goes away
+ * as soon as the last job that runs it has started.
+ * @return The job's result line, without the newline.
+ ********************************************************************************/
+std::string fleet::run_job(size_t i, std::shared_ptr<image> img) const {
+  const job &j = jobs[i];
+  std::ostringstream os;
+  os << "{\"job\":" << i << ",\"file\":" << json_string(j.file);
+
+  std::call_once(img->loaded, [&]() { load_image(j, *img); });
+  if (!img->start) {
+    os << ",\"error\":" << json_string(img->error) << '}';
+    return os.str();
+  }
+
+  std::unique_ptr<memory> mem = img->start->fork_memory();
+  hart h(*mem);
+  img->start->restore(h);
+  img.reset();
+  if (use_jit)
+    h.enable_jit();
+  h.run_blocks(j.exec_limit);
+
+  os << ",\"halted\":" << (h.is_halted() ? "true" : "false")
+     << ",\"reason\":"
+     << json_string(h.is_halted() ? h.get_halt_reason() : "Execution limit")
+     << ",\"insns\":" << h.get_insn_counter();
+  if (dump_regs) {
+    os << ",\"pc\":\"" << hex::to_hex32(h.get_pc()) << "\",\"regs\":[";
+    for (uint32_t r = 0; r < 32; ++r)
+      os << (r ? ",\"" : "\"") << hex::to_hex32(h.get_reg(r)) << '"';
+    os << ']';
+  }
+  os << '}';
+  return os.str();
+}
+
+/**
+ * @brief Runs every job and writes the results.
+ *
+ * Job k of n starts out in the queue of worker k * workers / n, so each
+ * worker owns a contiguous run of the manifest and thieves take from the
+ * far end of it. Results are kept until every worker is done, then
+ * written in manifest order.
+ *
+ * Each job's image is looked up here, by file and memory size, so the
+ * workers only ever touch their own job's entry.
+ *
+ * @param os Where to write one line per job.
+ ********************************************************************************/
+void fleet::run(std::ostream &os) {
+  unsigned workers = unsigned(std::min<size_t>(threads, jobs.size()));
+  std::vector<std::string> results(jobs.size());
+
+  std::vector<std::shared_ptr<image>> images(jobs.size());
+  {
+    std::map<std::pair<std::string, uint64_t>, std::shared_ptr<image>> seen;
+    for (size_t k = 0; k < jobs.size(); ++k) {
+      std::shared_ptr<image> &img = seen[{jobs[k].file, jobs[k].memory_limit}];
+      if (!img)
+        img = std::make_shared<image>();
+      images[k] = img;
+    }
+  }
+
+  queues.clear();
+  for (unsigned w = 0; w < workers; ++w)
+    queues.emplace_back(new work_queue);
+  for (size_t k = 0; k < jobs.size(); ++k)
+    queues[k * workers / jobs.size()]->jobs.push_back(k);
+
+  auto work = [&](unsigned w) {
+    size_t i;
+    while (next_job(w, i))
+      results[i] = run_job(i, std::move(images[i]));
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned w = 1; w < workers; ++w)
+    pool.emplace_back(work, w);
+  if (workers != 0)
+    work(0);
+  for (std::thread &t : pool)
+    t.join();
+
+  for (const std::string &r : results)
+    os << r << '\n';
+  os.flush();
+}
@@ -0,0 +1,127 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @class fleet
+ * @brief Runs a batch of guest programs, each in a simulator of its own.
+ *
+ * Every job gets its own memory and hart, so jobs share nothing and run
+ * on a pool of worker threads. The jobs are dealt out to the workers in
+ * contiguous runs; a worker takes jobs from the front of its own queue
+ * and, once that is empty, steals from the back of the others', so a few
+ * long jobs do not leave the other cores idle.
+ *
+ * Jobs that run the same file with the same memory size share one load
+ * of it: the first of them to start loads the image and takes a
+ * fork_point of it, and every one of them runs in a copy-on-write fork.
+ *
+ * Each job produces one JSON object on a line of its own. The lines are
+ * written in manifest order whatever order the jobs finished in.
+ ********************************************************************************/
+class fleet {
+public:
+  /**
+   * @struct job
+   * @brief One program to run and the limits to run it with.
+   **************************************************************************/
+  struct job {
+    std::string file;            // flat binary or ELF executable
+    uint64_t memory_limit;       // memory size in bytes
+    uint64_t exec_limit;         // max instructions, 0 for no limit
+  };
+
+  /**
+   * @brief Sets up an empty fleet.
+   * @param threads The number of worker threads, 0 to use one per core.
+   ****************************************************************************/
+  fleet(unsigned threads = 0);
+
+  /**
+   * @brief Reads jobs from a manifest file.
+   *
+   * Each line names a program, optionally followed by a hex memory size
+   * and a hex execution limit that override the defaults. Blank lines and
+   * lines starting with '#' are skipped. Relative paths are taken relative
+   * to the directory the manifest is in.
+   *
+   * @param fname The path to the manifest.
+   * @param memory_limit The memory size of jobs that do not give one.
+   * @param exec_limit The execution limit of jobs that do not give one.
+   * @return true if the whole manifest was read.
+   ****************************************************************************/
+  bool load_manifest(const std::string &fname, uint64_t memory_limit,
+                     uint64_t exec_limit);
+
+  /**
+   * @brief Adds a job to the end of the batch.
+   * @param j The job.
+   ****************************************************************************/
+  void add(const job &j) { jobs.push_back(j); }
+
+  /**
+   * @brief Gets the number of jobs.
+   * @return The job count.
+   ****************************************************************************/
+  size_t size() const { return jobs.size(); }
+
+  /**
+   * @brief Sets whether the jobs run RV32C compressed instructions.
+   * @param on true to enable RV32C.
+   ****************************************************************************/
+  void set_compressed(bool on) { compressed = on; }
+
+  /**
+   * @brief Sets whether the jobs translate hot blocks into native code.
+   * @param on true to enable the JIT.
+   ****************************************************************************/
+  void set_jit(bool on) { use_jit = on; }
+
+  /**
+   * @brief Sets whether each result includes the final registers and pc.
+   * @param on true to dump the registers.
+   ****************************************************************************/
+  void set_dump_regs(bool on) { dump_regs = on; }
+
+  /**
+   * @brief Runs every job and writes the results.
+   * @param os Where to write one line per job, in manifest order.
+   ****************************************************************************/
+  void run(std::ostream &os);
+
+private:
+  class hart;
+  struct image;
+
+  /**
+   * @struct work_queue
+   * @brief The jobs dealt to one worker, by index into jobs.
+   **************************************************************************/
+  struct work_queue {
+    std::mutex m;
+    std::deque<size_t> jobs;
+  };
+
+  bool next_job(unsigned w, size_t &i);
+  std::string run_job(size_t i, std::shared_ptr<image> img) const;
+  void load_image(const job &j, image &img) const;
+
+  std::vector<job> jobs;
+  unsigned threads;
+  bool compressed = {false};
+  bool use_jit = {false};
+  bool dump_regs = {false};
+  std::vector<std::unique_ptr<work_queue>> queues;
+};
@@ -0,0 +1,21 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file fork_point.cpp
+ * @brief Implementation of copy-on-write fork points.
+ ********************************************************************************/
+#include "fork_point.h"
+
+/**
+ * @brief Captures a hart and its memory.
+ * @param h The hart.
+ * @param mem The memory the hart runs in.
+ ********************************************************************************/
+fork_point::fork_point(const rv32i_hart &h, memory &mem) : base(mem.fork()) {
+  h.save(state);
+}
@@ -0,0 +1,63 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "memory.h"
+#include "rv32i_hart.h"
+#include "snapshot_format.h"
+#include <memory>
+
+/**
+ * @class fork_point
+ * @brief A warmed-up simulator state that clones can be started from.
+ *
+ * Taking a fork point forks the hart's memory once into a base memory
+ * that nothing ever writes, and copies the hart's registers, pc and
+ * counters by value. Every clone forks the base again, so clones share
+ * the image's pages until they write them, and start their hart from the
+ * copied state. A clone costs a page table copy and an empty set of
+ * caches, however big the image is, and never changes the fork point, so
+ * any number of clones can be started, on any number of threads.
+ *
+ * The hart the fork point was taken from may keep running afterwards.
+ ********************************************************************************/
+class fork_point {
+public:
+  /**
+   * @brief Captures a hart and its memory.
+   * @param h The hart.
+   * @param mem The memory the hart runs in. Its written pages become
+   * copy-on-write.
+   ****************************************************************************/
+  fork_point(const rv32i_hart &h, memory &mem);
+
+  /**
+   * @brief Makes a memory for a new clone.
+   * @return A copy-on-write clone of the captured memory.
+   ****************************************************************************/
+  std::unique_ptr<memory> fork_memory() const { return base->fork(); }
+
+  /**
+   * @brief Puts a clone's hart into the captured state.
+   *
+   * The hart should run in a memory from fork_memory(). Settings that are
+   * not part of the state, such as tracing and the JIT, are left alone.
+   *
+   * @param h The clone's hart.
+   ****************************************************************************/
+  void restore(rv32i_hart &h) const { h.restore(state); }
+
+  /**
+   * @brief Gets the captured hart state.
+   * @return The state.
+   ****************************************************************************/
+  const snapshot_hart &get_state() const { return state; }
+
+private:
+  std::unique_ptr<memory> base;
+  snapshot_hart state;
+};
@@ -14,7 +14,144 @@
  ********************************************************************************/
 
 #include "hex.h"
-#include <iomanip>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/**
+ * @brief The two hex digits of every byte value, built at compile time.
+ ********************************************************************************/
+struct hex_pairs {
+  char pairs[512];
+
+  constexpr hex_pairs() : pairs() {
+    const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 256; ++i) {
+      pairs[2 * i] = digits[i >> 4];
+      pairs[2 * i + 1] = digits[i & 15];
+    }
+  }
+};
+
+constexpr hex_pairs table;
+
+} // namespace
+
+/**
+ * @brief Writes an 8-bit value as 2 hex digits.
+ * @param buf Where to write.
+ * @param i The value.
+ * @return buf + 2.
+ ********************************************************************************/
+char *hex::fmt_hex8(char *buf, uint8_t i) {
+  std::memcpy(buf, &table.pairs[2 * i], 2);
+  return buf + 2;
+}
+
+/**
+ * @brief Writes a 16-bit value as 4 hex digits.
+ * @param buf Where to write.
+ * @param i The value.
+ * @return buf + 4.
+ ********************************************************************************/
+char *hex::fmt_hex16(char *buf, uint16_t i) {
+  std::memcpy(buf, &table.pairs[2 * (i >> 8)], 2);
+  std::memcpy(buf + 2, &table.pairs[2 * (i & 0xff)], 2);
+  return buf + 4;
+}
+
+/**
+ * @brief Writes a 32-bit value as 8 hex digits.
+ *
+ * Converts a byte at a time through the pair table, most significant
+ * byte first.
+ *
+ * @param buf Where to write.
+ * @param i The value.
+ * @return buf + 8.
+ ********************************************************************************/
+char *hex::fmt_hex32(char *buf, uint32_t i) {
+  std::memcpy(buf, &table.pairs[2 * (i >> 24)], 2);
+  std::memcpy(buf + 2, &table.pairs[2 * ((i >> 16) & 0xff)], 2);
+  std::memcpy(buf + 4, &table.pairs[2 * ((i >> 8) & 0xff)], 2);
+  std::memcpy(buf + 6, &table.pairs[2 * (i & 0xff)], 2);
+  return buf + 8;
+}
+
+/**
+ * @brief Writes a 32-bit value as "0x" and 8 hex digits.
+ * @param buf Where to write.
+ * @param i The value.
+ * @return buf + 10.
+ ********************************************************************************/
+char *hex::fmt_hex0x32(char *buf, uint32_t i) {
+  buf[0] = '0';
+  buf[1] = 'x';
+  return fmt_hex32(buf + 2, i);
+}
+
+/**
+ * @brief Writes "0x" and at least min_digits hex digits, zero-padded.
+ * @param buf Where to write.
+ * @param i The value.
+ * @param min_digits The minimum number of digits.
+ * @return A pointer just past the last digit.
+ ********************************************************************************/
+char *hex::fmt_hex0x(char *buf, uint32_t i, int min_digits) {
+  int digits = 1;
+  while (digits < 8 && (i >> (4 * digits)) != 0)
+    ++digits;
+  if (digits < min_digits)
+    digits = min_digits;
+
+  char full[8];
+  fmt_hex32(full, i);
+  buf[0] = '0';
+  buf[1] = 'x';
+  std::memcpy(buf + 2, full + 8 - digits, digits);
+  return buf + 2 + digits;
+}
+
+/**
+ * @brief Writes each of n bytes as 2 hex digits, with no separators.
+ *
+ * The SSE2 path splits 16 bytes into their high and low nibbles,
+ * interleaves them into digit order and turns each nibble into ASCII by
+ * adding '0', plus 'a' - '0' - 10 for nibbles above 9. Any remainder is
+ * done through the pair table.
+ *
+ * @param buf Where to write.
+ * @param src The bytes to convert.
+ * @param n The number of bytes.
+ * @return buf + 2 * n.
+ ********************************************************************************/
+char *hex::fmt_hex_bytes(char *buf, const uint8_t *src, size_t n) {
+#if defined(__SSE2__)
+  const __m128i low4 = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i gap = _mm_set1_epi8('a' - '0' - 10);
+  for (; n >= 16; n -= 16, src += 16, buf += 32) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low4);
+    __m128i lo = _mm_and_si128(v, low4);
+    __m128i a = _mm_unpacklo_epi8(hi, lo);
+    __m128i b = _mm_unpackhi_epi8(hi, lo);
+    a = _mm_add_epi8(_mm_add_epi8(a, zero),
+                     _mm_and_si128(_mm_cmpgt_epi8(a, nine), gap));
+    b = _mm_add_epi8(_mm_add_epi8(b, zero),
+                     _mm_and_si128(_mm_cmpgt_epi8(b, nine), gap));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(buf), a);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(buf + 16), b);
+  }
+#endif
+  for (; n != 0; --n)
+    buf = fmt_hex8(buf, *src++);
+  return buf;
+}
 
 /**
  * @brief Converts an 8-bit unsigned integer to a 2-character hex string.
@@ -22,10 +159,18 @@
  * @return A 2-character std::string, zero-padded.
  ********************************************************************************/
 std::string hex::to_hex8(uint8_t i) {
-  std::ostringstream os;
-  os << std::hex << std::setfill('0') << std::setw(2)
-     << static_cast<uint16_t>(i);
-  return os.str();
+  char buf[2];
+  return std::string(buf, fmt_hex8(buf, i));
+}
+
+/**
+ * @brief Converts a 16-bit unsigned integer to a 4-character hex string.
+ * @param i The uint16_t value to convert.
+ * @return A 4-character std::string, zero-padded.
+ ********************************************************************************/
+std::string hex::to_hex16(uint16_t i) {
+  char buf[4];
+  return std::string(buf, fmt_hex16(buf, i));
 }
 
 /**
@@ -34,10 +179,8 @@ std::string hex::to_hex8(uint8_t i) {
  * @return An 8-character std::string, zero-padded
  *********************************************************************************/
 std::string hex::to_hex32(uint32_t i) {
-  std::ostringstream os;
-  os << std::hex << std::setfill('0') << std::setw(8)
-     << static_cast<uint32_t>(i);
-  return os.str();
+  char buf[8];
+  return std::string(buf, fmt_hex32(buf, i));
 }
 
 /**
@@ -47,7 +190,8 @@ std::string hex::to_hex32(uint32_t i) {
  * @return A 10-character std::string.
  ********************************************************************************/
 std::string hex::to_hex0x32(uint32_t i) {
-  return std::string("0x") + hex::to_hex32(i);
+  char buf[10];
+  return std::string(buf, fmt_hex0x32(buf, i));
 }
 
 /**
@@ -57,9 +201,8 @@ std::string hex::to_hex0x32(uint32_t i) {
  * @return A 7-character std::string.
  ********************************************************************************/
 std::string hex::to_hex0x20(uint32_t i) {
-  std::ostringstream os;
-  os << "0x"<< std::hex << std::setfill('0') << std::setw(5) << i;
-  return os.str();
+  char buf[10];
+  return std::string(buf, fmt_hex0x(buf, i, 5));
 }
 
 /**
@@ -69,7 +212,6 @@ std::string hex::to_hex0x20(uint32_t i) {
  * @return A 5-character std::string.
  ********************************************************************************/
 std::string hex::to_hex0x12(uint32_t i) {
-  std::ostringstream os;
-  os << "0x" << std::hex << std::setfill('0') << std::setw(3) << i;
-  return os.str();
+  char buf[10];
+  return std::string(buf, fmt_hex0x(buf, i, 3));
 }
@@ -17,9 +17,69 @@
  *
  * This class provides methods to convert 8-bit and 32-bit unsigned
  * integers into various hexadecimal string representations.
+ *
+ * The fmt_* methods write straight into a caller's buffer without
+ * allocating and return a pointer just past what they wrote. The to_*
+ * methods are thin wrappers around them that return a std::string.
  ********************************************************************************/
 class hex {
 public:
+  /**
+   * @brief Writes an 8-bit value as 2 hex digits.
+   * @param buf Where to write; needs room for 2 characters.
+   * @param i The value.
+   * @return buf + 2.
+   ****************************************************************************/
+  static char *fmt_hex8(char *buf, uint8_t i);
+
+  /**
+   * @brief Writes a 16-bit value as 4 hex digits.
+   * @param buf Where to write; needs room for 4 characters.
+   * @param i The value.
+   * @return buf + 4.
+   ****************************************************************************/
+  static char *fmt_hex16(char *buf, uint16_t i);
+
+  /**
+   * @brief Writes a 32-bit value as 8 hex digits.
+   * @param buf Where to write; needs room for 8 characters.
+   * @param i The value.
+   * @return buf + 8.
+   ****************************************************************************/
+  static char *fmt_hex32(char *buf, uint32_t i);
+
+  /**
+   * @brief Writes a 32-bit value as "0x" and 8 hex digits.
+   * @param buf Where to write; needs room for 10 characters.
+   * @param i The value.
+   * @return buf + 10.
+   ****************************************************************************/
+  static char *fmt_hex0x32(char *buf, uint32_t i);
+
+  /**
+   * @brief Writes "0x" and at least min_digits hex digits, zero-padded.
+   *
+   * Like setw, min_digits is a minimum; larger values get more digits.
+   *
+   * @param buf Where to write; needs room for 10 characters.
+   * @param i The value.
+   * @param min_digits The minimum number of digits.
+   * @return A pointer just past the last digit.
+   ****************************************************************************/
+  static char *fmt_hex0x(char *buf, uint32_t i, int min_digits);
+
+  /**
+   * @brief Writes each of n bytes as 2 hex digits, with no separators.
+   *
+   * Uses SSE2 to convert 16 bytes at a time where available.
+   *
+   * @param buf Where to write; needs room for 2 * n characters.
+   * @param src The bytes to convert.
+   * @param n The number of bytes.
+   * @return buf + 2 * n.
+   ****************************************************************************/
+  static char *fmt_hex_bytes(char *buf, const uint8_t *src, size_t n);
+
   /**
    * @brief Converts an 8-bit unsigned integer to a 2-character hex string.
    * @param i The uint8_t value to convert.
@@ -27,6 +87,13 @@ public:
    ****************************************************************************/
   static std::string to_hex8(uint8_t i);
 
+  /**
+   * @brief Converts a 16-bit unsigned integer to a 4-character hex string.
+   * @param i The uint16_t value to convert.
+   * @return A 4-character std::string.
+   ****************************************************************************/
+  static std::string to_hex16(uint16_t i);
+
   /**
    * @brief Converts a 32-bit unsigned integer to an 8-character hex string.
    * @param i The uint32_t value to convert.
@@ -17,9 +17,18 @@
 #include "memory.h"
 #include "rv32i_decode.h"
 #include "cpu_single_hart.h"
+#include "cpu_multi_hart.h"
+#include "elf_loader.h"
+#include "async_writer.h"
+#include "disassembler.h"
+#include "fleet.h"
+#include "snapshot.h"
+#include <csignal>
 #include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <unistd.h>
 
 /**
@@ -33,9 +42,22 @@ struct opts_list {
   bool dump_dsasmbl = false;      //dump memory before execution
   bool show_insn = false;         //show instructions during execution
   uint64_t exec_limit = 0x0;      //max number of instructions to execute
-  uint32_t memory_limit = 0x100;  //size of memory
+  uint64_t memory_limit = 0x100;  //size of memory, up to 0x100000000
   bool dump_on_exec = false;       //show regs and pc before each execution
   bool dump_hart_post = false;     //show regs, pc, and memory after halt
+  bool use_jit = false;            //translate hot blocks to native code
+  std::string trace_file;          //write a binary trace here if set
+  bool async_output = false;       //write output from a separate thread
+  async_writer::policy backpressure = async_writer::block;
+  unsigned harts = 1;              //number of harts sharing memory
+  bool compressed = false;         //run RV32C compressed instructions
+  std::string fleet_file;          //run infile as a manifest, results here
+  std::string save_file;           //write a snapshot here when stopped
+  std::string restore_file;        //resume from this snapshot
+  std::string flat_profile;        //write a flat profile here
+  std::string callgrind_profile;   //write a callgrind profile here
+  std::string cache_config;        //model the caches described here
+  std::string branch_config;       //model the branch predictor described
 };
 
 /**
@@ -45,13 +67,30 @@ struct opts_list {
  * then terminates the program with exit code 1.
  ********************************************************************************/
 static void usage() {
-  std::cerr << "Usage : rv32i [ - d ] [ - i ] [ - r ] [ - z ] [ - l exec - "
-               "limit ] [ - m hex - mem - size ] infile\n"
+  std::cerr << "Usage : rv32i [ - B predictor ] [ - b result - file ] [ - C cache - config ] [ - c ] [ - d ] [ - i ] [ - j ] [ - r ] [ - z ] [ - l exec - "
+               "limit ] [ - m hex - mem - size ] [ - p harts ] [ - t trace - file ] [ - a block | drop ] [ - s snapshot - file ] [ - R snapshot - file ] [ - P profile - file ] [ - G callgrind - file ] infile\n"
+            << "\t-a write output from a writer thread that blocks or drops\n"
+            << "\t   output when it falls behind\n"
+            << "\t-B model branch prediction, e.g. gshare:bits=14 or\n"
+            << "\t   tage:btb=1024:ras=16, and report mispredictions\n"
+            << "\t-b run each program listed in infile on a thread pool and\n"
+            << "\t   write one result line per program to result-file\n"
+            << "\t-C model the caches described, e.g.\n"
+            << "\t   l1i=32k:4:64,l1d=32k:8:64,l2=256k:8:64:lru\n"
+            << "\t-c run and disassemble RV32C compressed instructions\n"
             << "\t-d show disassembly before program execution \n"
+            << "\t-G write a callgrind call graph of the run to a file\n"
             << "\t-i show instruction printing during execution\n"
+            << "\t-j translate hot code to native code (x86-64 only)\n"
             << "\t-l maximum number of instructions to exec\n"
             << "\t-m specify memory size(default = 0 x100)\n"
+            << "\t-P write a flat profile of the run to a file\n"
+            << "\t-p run this many harts, each on its own thread\n"
             << "\t-r show register printing during execution\n"
+            << "\t-s write a snapshot to a file when execution stops, or\n"
+            << "\t   on SIGUSR1 and carry on\n"
+            << "\t-R resume from a snapshot file; infile may be left out\n"
+            << "\t-t write a binary trace of every instruction to a file\n"
             << "\t-z show a dump of the regs & memory after simulation\n";
   exit(1);
 }
@@ -59,22 +98,77 @@ static void usage() {
 /**
  * @brief Disassembles the instructions in memory.
  *
- * Iterates through the memory range and decodes the 32-bit words into
- * readable RISC-V assembly instructions, printing them to stdout.
+ * Decodes the 32-bit words, or with RV32C the 16- and 32-bit
+ * instructions, into readable RISC-V assembly, printing them to stdout.
+ * Addresses that start a known symbol are preceded by a label line. Large
+ * images are decoded in chunks on one thread per core.
  *
  * @param mem Reference to the memory object containing the binary code.
+ * @param syms The program's symbols, empty for a flat binary.
+ * @param compressed true to decode RV32C instructions.
  ********************************************************************************/
-static void disassemble(const memory &mem) {
-  // should end up looking like the dump loop, works on 32 bit words
+static void disassemble(const memory &mem, const symbol_table &syms,
+                        bool compressed) {
+  disassembler d(mem, syms);
+  d.set_compressed(compressed);
+  d.write(std::cout);
+}
+
+/**
+ * @brief Opens a profile output file, if one was asked for.
+ * @param out The stream to open.
+ * @param fname The path from the command line, or empty for none.
+ * @return false if fname was given and can't be written.
+ ********************************************************************************/
+static bool open_profile(std::ofstream &out, const std::string &fname) {
+  if (fname.empty())
+    return true;
+  out.open(fname);
+  if (!out)
+    std::cerr << "Can't open file '" << fname << "' for writing.\n";
+  return bool(out);
+}
 
-  for (uint32_t addr = 0; addr < mem.get_size(); addr += 4) {
-    std::cout << hex::to_hex32(addr) + ":";
-    uint32_t inst = mem.get32(addr);
+/**
+ * @brief The hart a SIGUSR1 asks to stop for a snapshot, if any.
+ ********************************************************************************/
+static rv32i_hart *volatile stop_target = nullptr;
 
-    std::cout << std::right << std::setw(11) << (hex::to_hex32(inst) + "  ");
-    std::cout << rv32i_decode::decode(addr, inst) << std::endl;
+/**
+ * @brief Handles SIGUSR1 by asking the running hart to stop.
+ * @param sig The signal number.
+ ********************************************************************************/
+static void request_stop(int sig) {
+  (void)sig;
+  rv32i_hart *h = stop_target;
+  if (h != nullptr)
+    h->request_stop();
+}
+
+/**
+ * @brief Runs every program listed in a manifest, as with -b.
+ *
+ * The -m and -l values are the defaults for manifest lines that leave
+ * them out; -c, -j and -z apply to every job. Tracing options are ignored.
+ *
+ * @param opts The command-line options.
+ * @param manifest The path to the manifest.
+ * @return 0 once the results are written.
+ ********************************************************************************/
+static int run_fleet(const opts_list &opts, const char *manifest) {
+  fleet f;
+  if (!f.load_manifest(manifest, opts.memory_limit, opts.exec_limit))
+    usage();
+  std::ofstream out(opts.fleet_file);
+  if (!out) {
+    std::cerr << "Can't open file '" << opts.fleet_file << "' for writing.\n";
+    usage();
   }
-  return;
+  f.set_compressed(opts.compressed);
+  f.set_jit(opts.use_jit);
+  f.set_dump_regs(opts.dump_hart_post);
+  f.run(out);
+  return 0;
 }
 
 /**
@@ -91,7 +185,7 @@ static void disassemble(const memory &mem) {
 int main(int argc, char **argv) {
   int opt;
   opts_list opts;
-  while ((opt = getopt(argc, argv, "m:l:dirz")) != -1) {
+  while ((opt = getopt(argc, argv, "m:l:p:t:a:b:s:R:P:G:C:B:cdijrz")) != -1) {
     switch (opt) {
     case 'm': {
       std::istringstream iss(optarg);
@@ -103,6 +197,57 @@ int main(int argc, char **argv) {
       iss >> std::hex >> opts.exec_limit;
       break;
     }
+    case 'p': {
+      std::istringstream iss(optarg);
+      if (!(iss >> opts.harts) || opts.harts == 0 || opts.harts > 256)
+        usage();
+      break;
+    }
+    case 't': {
+      opts.trace_file = optarg;
+      break;
+    }
+    case 'a': {
+      std::string p = optarg;
+      if (p != "block" && p != "drop")
+        usage();
+      opts.async_output = true;
+      opts.backpressure =
+          p == "block" ? async_writer::block : async_writer::drop;
+      break;
+    }
+    case 'b': {
+      opts.fleet_file = optarg;
+      break;
+    }
+    case 's': {
+      opts.save_file = optarg;
+      break;
+    }
+    case 'R': {
+      opts.restore_file = optarg;
+      break;
+    }
+    case 'P': {
+      opts.flat_profile = optarg;
+      break;
+    }
+    case 'G': {
+      opts.callgrind_profile = optarg;
+      break;
+    }
+    case 'C': {
+      opts.cache_config = optarg;
+      break;
+    }
+    case 'B': {
+      opts.branch_config = optarg;
+      break;
+    }
+    case 'c': {
+      opts.compressed = true;
+      break;
+    }
     case 'd': {
       opts.dump_dsasmbl = true;
       break;
@@ -111,6 +256,10 @@ int main(int argc, char **argv) {
       opts.show_insn = true;
       break;
     }
+    case 'j': {
+      opts.use_jit = true;
+      break;
+    }
     case 'r': {
       opts.dump_on_exec = true;
       break;
@@ -123,25 +272,166 @@ int main(int argc, char **argv) {
       usage();
     }
   }
-  if (optind >= argc)
+  bool restoring = !opts.restore_file.empty();
+  bool batch = !opts.fleet_file.empty();
+  if (batch && restoring)
+    usage(); // a manifest lists programs, not snapshots
+  if (optind >= argc && !restoring)
     usage(); // missing filename
+  if (batch)
+    return run_fleet(opts, argv[optind]);
+  bool profiling =
+      !opts.flat_profile.empty() || !opts.callgrind_profile.empty();
+  bool modelling = !opts.cache_config.empty();
+  bool predicting = !opts.branch_config.empty();
+  if (opts.harts > 1 && (restoring || !opts.save_file.empty() || profiling ||
+                         modelling || predicting))
+    usage(); // snapshots, profiles and models cover a single hart
+  cache_hierarchy caches;
+  if (modelling && !caches.configure(opts.cache_config))
+    usage();
+  branch_model branches;
+  if (predicting && !branches.configure(opts.branch_config))
+    usage();
+  if (restoring &&
+      !snapshot::read_memory_size(opts.restore_file, opts.memory_limit))
+    usage();
   memory mem(opts.memory_limit);
 
-  if (!mem.load_file(argv[optind]))
-    usage();
+  // a restored run takes its memory from the snapshot instead of infile
+  elf_loader elf;
+  if (!restoring) {
+    bool is_elf = elf_loader::is_elf(argv[optind]);
+    if (is_elf ? !elf.load(argv[optind], mem) : !mem.load_file(argv[optind]))
+      usage();
+  }
 
-  if (opts.dump_dsasmbl) {
-    disassemble(mem);
+  std::unique_ptr<trace_writer> trace;
+  if (!opts.trace_file.empty()) {
+    trace.reset(new trace_writer(opts.trace_file, opts.async_output,
+                                 opts.backpressure));
+    if (!trace->good()) {
+      std::cerr << "Can't open file '" << opts.trace_file
+                << "' for writing.\n";
+      usage();
+    }
+  }
+
+  // from here on std::cout goes through the writer thread, unless harts
+  // will be running on several threads: the streambuf only takes one writer
+  bool traced = opts.show_insn || opts.dump_on_exec || trace;
+  bool async_cout = opts.async_output && (opts.harts == 1 || traced);
+  std::streambuf *cout_buf = std::cout.rdbuf();
+  std::unique_ptr<async_writer> cout_writer;
+  std::unique_ptr<async_streambuf> cout_async;
+  if (async_cout) {
+    cout_writer.reset(new async_writer(cout_buf, opts.backpressure));
+    cout_async.reset(new async_streambuf(*cout_writer));
+    std::cout.rdbuf(cout_async.get());
+  }
+
+  if (opts.dump_dsasmbl && !restoring) {
+    disassemble(mem, elf.get_symbols(), opts.compressed);
   }
  
-  cpu_single_hart cpu(mem);
-  cpu.set_show_instructions(opts.show_insn);
-  cpu.set_show_registers(opts.dump_on_exec);
-  
-  cpu.run(opts.exec_limit);
-
-  if (opts.dump_hart_post) {
-    cpu.dump();  
+  auto setup = [&](rv32i_hart &h) {
+    h.set_show_instructions(opts.show_insn);
+    h.set_show_registers(opts.dump_on_exec);
+    h.set_symbols(&elf.get_symbols());
+    h.set_pc(elf.get_entry());
+    h.set_trace(trace.get());
+    h.set_compressed(opts.compressed);
+    if (opts.use_jit)
+      h.enable_jit();
+  };
+
+  if (opts.harts > 1) {
+    cpu_multi_hart cpu(mem, opts.harts);
+    for (unsigned i = 0; i < cpu.get_hart_count(); ++i)
+      setup(cpu.get_hart(i));
+
+    cpu.run(opts.exec_limit);
+
+    if (opts.dump_hart_post)
+      cpu.dump();
+  } else {
+    cpu_single_hart cpu(mem);
+    setup(cpu);
+    if (restoring) {
+      if (!snapshot::restore(opts.restore_file, cpu, mem))
+        usage();
+      if (opts.dump_dsasmbl)
+        disassemble(mem, elf.get_symbols(), cpu.get_compressed());
+      // -l counts the instructions run after the snapshot
+      if (opts.exec_limit != 0)
+        opts.exec_limit += cpu.get_insn_counter();
+    }
+
+    std::unique_ptr<profiler> prof;
+    std::ofstream flat_out, callgrind_out;
+    if (profiling) {
+      if (!open_profile(flat_out, opts.flat_profile) ||
+          !open_profile(callgrind_out, opts.callgrind_profile))
+        usage();
+      prof.reset(new profiler(&elf.get_symbols(), cpu.get_pc()));
+      cpu.set_profiler(prof.get());
+    }
+    if (modelling)
+      cpu.set_caches(&caches);
+    if (predicting)
+      cpu.set_branch_model(&branches);
+
+    std::function<void()> on_stop;
+    if (!opts.save_file.empty()) {
+      stop_target = &cpu;
+      std::signal(SIGUSR1, request_stop);
+      on_stop = [&]() {
+        if (snapshot::save(opts.save_file, cpu, mem))
+          std::cerr << "Snapshot written to '" << opts.save_file << "' after "
+                    << cpu.get_insn_counter() << " instructions\n";
+      };
+    }
+
+    cpu.run(opts.exec_limit, on_stop);
+
+    if (!opts.save_file.empty()) {
+      std::signal(SIGUSR1, SIG_DFL);
+      stop_target = nullptr;
+      on_stop();
+    }
+
+    if (modelling)
+      caches.report(std::cout);
+    if (predicting)
+      branches.report(std::cout, &elf.get_symbols());
+
+    if (prof) {
+      prof->finish();
+      if (flat_out.is_open())
+        prof->write_flat(flat_out);
+      if (callgrind_out.is_open())
+        prof->write_callgrind(callgrind_out, restoring ? opts.restore_file
+                                                       : argv[optind]);
+    }
+
+    if (opts.dump_hart_post) {
+      cpu.dump();
+    }
+  }
+
+  if (async_cout) {
+    std::cout.flush();
+    std::cout.rdbuf(cout_buf);
+    cout_async.reset();
+    if (cout_writer->get_dropped() != 0)
+      std::cerr << cout_writer->get_dropped()
+                << " bytes of output dropped\n";
+    cout_writer.reset();
+  }
+  if (trace) {
+    trace->flush();
+    if (trace->get_dropped() != 0)
+      std::cerr << trace->get_dropped() << " trace records dropped\n";
   }
   return 0;
 }
@@ -17,34 +17,146 @@
 #include <fstream>
 #include <iomanip>
 #include <ios>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 
+namespace {
+
 /**
- * @brief Constructs a new memory object.
- *
- * Initializes a vector of a given size, rounding the size up to the
- * nearest multiple of 16. All memory is initialized to 0xa5.
- *
- * @param size The desired size of the memory.
- ********************************************************************************/
-memory::memory(uint32_t size) {
-  size = (size + 15) & 0xfffffff0;
-  mem.resize(size, 0xa5);
+ * @brief Reads a little-endian value of type T from a host buffer.
+ *
+ * memcpy lets the compiler emit a single native-width load regardless of
+ * alignment. Big-endian hosts assemble the value a byte at a time.
+ *
+ * @param p The first byte of the value.
+ * @return The value.
+ ********************************************************************************/
+template <typename T> T load_le(const uint8_t *p) {
+  T v;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  std::memcpy(&v, p, sizeof(T));
+#else
+  v = 0;
+  for (size_t i = 0; i < sizeof(T); ++i)
+    v |= T(p[i]) << (8 * i);
+#endif
+  return v;
 }
 
 /**
- * @brief Destroys the memory object.
- *
- * Clears the internal memory vector to free resources.
- ********************************************************************************/
-memory::~memory() { std::vector<uint8_t>().swap(mem); }
+ * @brief Writes a value of type T to a host buffer in little-endian order.
+ * @param p The first byte to write.
+ * @param v The value.
+ ********************************************************************************/
+template <typename T> void store_le(uint8_t *p, T v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  std::memcpy(p, &v, sizeof(T));
+#else
+  for (size_t i = 0; i < sizeof(T); ++i)
+    p[i] = uint8_t(v >> (8 * i));
+#endif
+}
+
+} // namespace
 
 /**
- * @brief Gets the total allocated size of the memory.
- * @return The size of the memory in bytes, rounded.
- ********************************************************************************/
-uint32_t memory::get_size() const { return (mem.size() + 15) & 0xfffffff0; }
+ * @brief Gets the page every untouched page reads from.
+ * @return A page_size block of 0xa5 bytes.
+ ********************************************************************************/
+static const uint8_t *fill_page() {
+  static const std::vector<uint8_t> page(memory::page_size, 0xa5);
+  return page.data();
+}
+
+/**
+ * @brief Gets the page fully zeroed pages read from.
+ * @return A page_size block of zero bytes.
+ ********************************************************************************/
+static const uint8_t *zero_page() {
+  static const std::vector<uint8_t> page(memory::page_size, 0);
+  return page.data();
+}
+
+/**
+ * @brief Constructs a new memory object.
+ *
+ * Rounds the size up to the nearest multiple of 16 and caps it at 4 GiB.
+ * Nothing is allocated up front besides the top level of the page table;
+ * all memory reads as 0xa5 until it is written.
+ *
+ * @param s The desired size of the memory.
+ ********************************************************************************/
+memory::memory(uint64_t s) : fill(fill_page()) {
+  size = std::min((s + 15) & ~uint64_t(15), max_size);
+  dir.resize((size + (uint64_t(page_size) << table_bits) - 1) >>
+             (page_bits + table_bits));
+}
+
+/**
+ * @brief Destroys the memory object.
+ *
+ * Frees every page table and page frame. Mapped images and frozen frames
+ * are released once no other memory reads from them.
+ ********************************************************************************/
+memory::~memory() {
+  dir.clear();
+}
+
+/**
+ * @brief Gets the total allocated size of the memory.
+ * @return The size of the memory in bytes, rounded.
+ ********************************************************************************/
+uint64_t memory::get_size() const { return size; }
+
+/**
+ * @brief Gets the page table entry for an address, creating its table.
+ *
+ * A new table starts with every page reading from the fill page.
+ *
+ * @param addr An in-range address.
+ * @return The entry.
+ ********************************************************************************/
+memory::page &memory::get_page(uint32_t addr) {
+  std::unique_ptr<page[]> &t = dir[addr >> (page_bits + table_bits)];
+  if (!t) {
+    t.reset(new page[1u << table_bits]);
+    for (uint32_t i = 0; i < (1u << table_bits); ++i)
+      t[i].rd.store(fill, std::memory_order_relaxed);
+  }
+  return *find_page(addr);
+}
+
+/**
+ * @brief Gives the page holding addr a frame of its own.
+ *
+ * The frame starts as a copy of whatever the page read from before. In a
+ * shared memory two threads can race to write the same new page, so the
+ * check is repeated under the lock and the loser uses the winner's frame.
+ *
+ * @param addr An in-range address.
+ * @return The entry, now writable.
+ ********************************************************************************/
+memory::page &memory::make_private(uint32_t addr) {
+  std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+  if (shared)
+    guard.lock();
+
+  page &p = get_page(addr);
+  if (p.wr.load(std::memory_order_relaxed) == nullptr) {
+    p.frame.reset(new uint8_t[page_size]);
+    std::memcpy(p.frame.get(), p.rd.load(std::memory_order_relaxed),
+                page_size);
+    p.rd.store(p.frame.get(), std::memory_order_release);
+    p.wr.store(p.frame.get(), std::memory_order_release);
+  }
+  return p;
+}
 
 /**
  * @brief Checks if a given address is outside the allocated memory size.
@@ -56,7 +168,7 @@ uint32_t memory::get_size() const { return (mem.size() + 15) & 0xfffffff0; }
  ********************************************************************************/
 bool memory::check_illegal(uint32_t i) const {
 
-  if (i > mem.size()) {
+  if (i >= size) {
     std::cout << "WARNING: Address out of range: " << to_hex0x32(i)
               << std::endl;
     return true;
@@ -74,20 +186,25 @@ uint8_t memory::get8(uint32_t addr) const {
   if (check_illegal(addr) == true)
     return 0x00;
 
-  return mem[addr];
+  return *read_ptr(addr);
 }
 
 /**
  * @brief Reads a 16-bit unsigned value from memory (little-endian).
  *
- * Reads from the lowest address first to ensure warnings are printed
- * in ascending order.
+ * When the whole value is in range and in one page it is read with one
+ * native load.
+ * Otherwise it falls back to reading from the lowest address first so
+ * warnings are printed in ascending order.
  *
  * @param addr The starting address to read from.
  * @return The uint16_t value, or 0 if any part of the address
  * is illegal.
  ********************************************************************************/
 uint16_t memory::get16(uint32_t addr) const {
+  if (is_fast(addr, 2))
+    return load_le<uint16_t>(read_ptr(addr));
+
   uint16_t low, high;
   low = get8(addr);
   high = get8(addr + 1);
@@ -98,14 +215,19 @@ uint16_t memory::get16(uint32_t addr) const {
 /**
  * @brief Reads a 32-bit unsigned value from memory (little-endian).
  *
- * Reads from the lowest address first to ensure warnings are printed
- * in ascending order.
+ * When the whole value is in range and in one page it is read with one
+ * native load.
+ * Otherwise it falls back to reading from the lowest address first so
+ * warnings are printed in ascending order.
  *
  * @param addr The starting address to read from.
  * @return The uint32_t value, or 0 if any part of the address
  * is illegal.
  ********************************************************************************/
 uint32_t memory::get32(uint32_t addr) const {
+  if (is_fast(addr, 4))
+    return load_le<uint32_t>(read_ptr(addr));
+
   uint32_t low, high;
   low = get16(addr);
   high = get16(addr + 2);
@@ -175,19 +297,28 @@ void memory::set8(uint32_t addr, uint8_t val) {
   if (check_illegal(addr) == true)
     return;
 
-  mem[addr] = val;
+  *write_ptr(addr) = val;
+  check_watch(addr, 1);
 }
 
 /**
  * @brief Writes a 16-bit value to memory (little-endian).
  *
- * The 16-bit value is split into two 8-bit bytes. The low byte
+ * When the whole value is in range and in one page it is written with one
+ * native store.
+ * Otherwise the 16-bit value is split into two 8-bit bytes. The low byte
  * is written to 'addr' and the high byte is written to 'addr + 1'.
  *
  * @param addr The starting address to write to.
  * @param val The uint16_t value to write.
  ********************************************************************************/
 void memory::set16(uint32_t addr, uint16_t val) {
+  if (is_fast(addr, 2)) {
+    store_le<uint16_t>(write_ptr(addr), val);
+    check_watch(addr, 2);
+    return;
+  }
+
   uint8_t start8, end8;
 
   start8 = uint8_t(val >> 8);
@@ -200,7 +331,9 @@ void memory::set16(uint32_t addr, uint16_t val) {
 /**
  * @brief Writes a 32-bit value to memory (little-endian).
  *
- * The 32-bit value is split into two 16-bit words. The low word
+ * When the whole value is in range and in one page it is written with one
+ * native store.
+ * Otherwise the 32-bit value is split into two 16-bit words. The low word
  * is written to 'addr' and the high word is written to 'addr + 2',
  * handled by set16().
  *
@@ -208,6 +341,12 @@ void memory::set16(uint32_t addr, uint16_t val) {
  * @param val The uint32_t value to write.
  ********************************************************************************/
 void memory::set32(uint32_t addr, uint32_t val) {
+  if (is_fast(addr, 4)) {
+    store_le<uint32_t>(write_ptr(addr), val);
+    check_watch(addr, 4);
+    return;
+  }
+
   uint16_t start16, end16;
 
   start16 = uint16_t(val >> 16);
@@ -218,44 +357,384 @@ void memory::set32(uint32_t addr, uint32_t val) {
 }
 
 /**
- * @brief Dumps the contents of memory to stdout.
+ * @brief Copies a block of bytes into memory.
+ *
+ * Works a page at a time, so only the pages the block covers are given
+ * frames of their own.
+ *
+ * @param addr The first address to write.
+ * @param src The bytes to copy.
+ * @param len The number of bytes, which must all be in range.
+ ********************************************************************************/
+void memory::set_bytes(uint32_t addr, const uint8_t *src, uint64_t len) {
+  while (len != 0) {
+    uint32_t n = std::min<uint64_t>(len, page_size - (addr & page_mask));
+    std::memcpy(write_ptr(addr), src, n);
+    addr += n;
+    src += n;
+    len -= n;
+  }
+}
+
+/**
+ * @brief Sets a block of memory to zero.
+ *
+ * Whole pages are pointed at the shared zero page instead of being
+ * allocated. Only the partial pages at either end get frames.
+ *
+ * @param addr The first address to clear.
+ * @param len The number of bytes, which must all be in range.
+ ********************************************************************************/
+void memory::zero_bytes(uint32_t addr, uint64_t len) {
+  while (len != 0) {
+    uint32_t n = std::min<uint64_t>(len, page_size - (addr & page_mask));
+    if (n == page_size) {
+      page &p = get_page(addr);
+      p.frame.reset();
+      p.wr.store(nullptr, std::memory_order_relaxed);
+      p.rd.store(zero_page(), std::memory_order_relaxed);
+    } else {
+      std::memset(write_ptr(addr), 0, n);
+    }
+    addr += n;
+    len -= n;
+  }
+}
+
+/**
+ * @brief Converts between guest (little-endian) and host byte order.
+ * @param v A 32-bit word in one order.
+ * @return The same word in the other.
+ ********************************************************************************/
+static uint32_t le32(uint32_t v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return v;
+#else
+  return __builtin_bswap32(v);
+#endif
+}
+
+/**
+ * @brief Atomically applies op to a 32-bit word and returns its old value.
+ *
+ * swap, add, and, or and xor map straight onto host atomic instructions on
+ * little-endian hosts. min and max, and everything on big-endian hosts,
+ * loop on a compare-and-swap. The store is reported to watchers like any
+ * other, after it lands. Since size is a multiple of 16, an aligned word
+ * is either wholly in range or starts out of range.
+ *
+ * @param addr A 4-byte aligned address.
+ * @param op The operation.
+ * @param val The operand.
+ * @return The value the word held before.
+ ********************************************************************************/
+uint32_t memory::amo32(uint32_t addr, amo_op op, uint32_t val) {
+  if (check_illegal(addr))
+    return 0;
+
+  uint32_t *p = reinterpret_cast<uint32_t *>(write_ptr(addr));
+  uint32_t old;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  switch (op) {
+  case amo_swap:
+    old = __atomic_exchange_n(p, val, __ATOMIC_SEQ_CST);
+    check_watch(addr, 4);
+    return old;
+  case amo_add:
+    old = __atomic_fetch_add(p, val, __ATOMIC_SEQ_CST);
+    check_watch(addr, 4);
+    return old;
+  case amo_xor:
+    old = __atomic_fetch_xor(p, val, __ATOMIC_SEQ_CST);
+    check_watch(addr, 4);
+    return old;
+  case amo_and:
+    old = __atomic_fetch_and(p, val, __ATOMIC_SEQ_CST);
+    check_watch(addr, 4);
+    return old;
+  case amo_or:
+    old = __atomic_fetch_or(p, val, __ATOMIC_SEQ_CST);
+    check_watch(addr, 4);
+    return old;
+  default:
+    break;
+  }
+#endif
+
+  uint32_t raw = __atomic_load_n(p, __ATOMIC_RELAXED);
+  uint32_t next;
+  do {
+    old = le32(raw);
+    switch (op) {
+    case amo_swap: next = val; break;
+    case amo_add: next = old + val; break;
+    case amo_xor: next = old ^ val; break;
+    case amo_and: next = old & val; break;
+    case amo_or: next = old | val; break;
+    case amo_min: next = int32_t(old) < int32_t(val) ? old : val; break;
+    case amo_max: next = int32_t(old) > int32_t(val) ? old : val; break;
+    case amo_minu: next = old < val ? old : val; break;
+    case amo_maxu: next = old > val ? old : val; break;
+    default: next = old; break;
+    }
+  } while (!__atomic_compare_exchange_n(p, &raw, le32(next), false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+  check_watch(addr, 4);
+  return old;
+}
+
+/**
+ * @brief Reads a 32-bit word with sequentially consistent ordering.
+ * @param addr A 4-byte aligned address.
+ * @return The value, or 0 with a warning if addr is out of range.
+ ********************************************************************************/
+uint32_t memory::load32_seq(uint32_t addr) const {
+  if (check_illegal(addr))
+    return 0;
+  const uint32_t *p = reinterpret_cast<const uint32_t *>(read_ptr(addr));
+  return le32(__atomic_load_n(p, __ATOMIC_SEQ_CST));
+}
+
+/**
+ * @brief Atomically replaces a 32-bit word if it holds an expected value.
+ *
+ * Only a successful swap is reported to watchers.
+ *
+ * @param addr A 4-byte aligned address.
+ * @param expected The value the word must hold.
+ * @param desired The value to store.
+ * @return true if the word held expected and now holds desired.
+ ********************************************************************************/
+bool memory::cas32(uint32_t addr, uint32_t expected, uint32_t desired) {
+  if (check_illegal(addr))
+    return false;
+
+  uint32_t *p = reinterpret_cast<uint32_t *>(write_ptr(addr));
+  uint32_t raw = le32(expected);
+  if (!__atomic_compare_exchange_n(p, &raw, le32(desired), false,
+                                   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+    return false;
+  check_watch(addr, 4);
+  return true;
+}
+
+/**
+ * @brief Dumps the contents of memory to stdout.
  *
  * Prints the memory contents in a hex dump format. Each line displays
  * the 32-bit starting address, followed by 16 bytes in hexadecimal,
  * followed by the ASCII representation of those 16 bytes.
- * Non-printable ASCII characters are replaced with a '.'.
- ********************************************************************************/
+ * Non-printable ASCII characters are replaced with a '.'.
+ * Each line is formatted into a local buffer and written in one call.
+ ********************************************************************************/
 void memory::dump() const {
-  for (uint32_t addr = 0; addr < mem.size(); addr += 16) {
-    std::string ascii = "";
-    std::cout << to_hex32(addr) + ":";
+  // "aaaaaaaa:" + 16 * " xx" + " " + " *" + 16 ascii + "*\n"
+  char line[9 + 48 + 1 + 2 + 16 + 2];
 
-    for (uint32_t i = 0; i < 16 && (addr + i) < mem.size(); i++) {
+  for (uint64_t addr = 0; addr < size; addr += 16) {
+    uint32_t n = std::min<uint64_t>(16, size - addr);
+    const uint8_t *bytes = read_ptr(addr);
+    char *p = fmt_hex32(line, addr);
+    *p++ = ':';
+
+    for (uint32_t i = 0; i < n; i++) {
       if (i == 8)
-        std::cout << " ";
+        *p++ = ' ';
+      *p++ = ' ';
+      p = fmt_hex8(p, bytes[i]);
+    }
 
-      std::cout << std::right << std::setw(3) << to_hex8(mem[i + addr]);
+    *p++ = ' ';
+    *p++ = '*';
+    for (uint32_t i = 0; i < n; i++)
+      *p++ = isprint(bytes[i]) ? bytes[i] : '.';
+    *p++ = '*';
+    *p++ = '\n';
+    std::cout.write(line, p - line);
+  }
+  std::cout.flush();
+}
 
-      uint8_t ch = get8(i + addr);
-      ch = isprint(ch) ? ch : '.';
-      ascii.append(1, ch);
+/**
+ * @brief Loads a binary file into memory.
+ *
+ * Loads the contents of a binary file sequentially into the memory,
+ * starting from address 0. Regular files are mapped with map_file();
+ * anything that cannot be mapped is read through load_stream().
+ *
+ * @param fname The path to the file to load.
+ * @return true if the file was successfully loaded, false if the file
+ *        could not be opened or if the file contents exceed
+ *        the memory size.
+ ********************************************************************************/
+bool memory::load_file(const std::string &fname) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Can't open file '" << fname << "' for reading.";
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return load_stream(fname);
+  }
+
+  uint64_t len = st.st_size;
+  if (len > size) {
+    close(fd);
+    check_illegal(size);
+    std::cerr << "Can't open file '" << fname << "' for reading.";
+    return false;
+  }
+
+  bool ok = map_file(fd, len);
+  close(fd);
+  return ok ? true : load_stream(fname);
+}
+
+/**
+ * @brief Keeps a file mapping alive while any memory reads from it.
+ * @param m The start of the mapping.
+ * @param len Its length in bytes.
+ ********************************************************************************/
+void memory::hold_mapping(void *m, size_t len) {
+  holds.emplace_back(m, [len](void *p) { munmap(p, len); });
+}
+
+/**
+ * @brief Maps an open file into memory starting at address 0.
+ *
+ * The whole pages of the file are mapped privately, so the kernel copies
+ * a page only when the guest first writes to it. The partial page at the
+ * end is copied into a frame of its own so the bytes past the end of the
+ * file keep their previous contents instead of reading as zero.
+ *
+ * @param fd The open file.
+ * @param len The length of the file, which must fit in memory.
+ * @return true on success, false if the file could not be mapped.
+ ********************************************************************************/
+bool memory::map_file(int fd, uint64_t len) {
+  size_t whole = len & ~uint64_t(page_mask);
+  if (whole != 0) {
+    void *m = mmap(nullptr, whole, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED)
+      return false;
+    hold_mapping(m, whole);
+
+    uint8_t *base = static_cast<uint8_t *>(m);
+    for (size_t off = 0; off < whole; off += page_size) {
+      page &p = get_page(off);
+      p.frame.reset();
+      p.rd.store(base + off, std::memory_order_relaxed);
+      p.wr.store(base + off, std::memory_order_relaxed);
     }
-    std::cout << " " << "*" << ascii << "*" << std::endl;
   }
+
+  size_t tail = len - whole;
+  if (tail != 0 && pread(fd, write_ptr(whole), tail, whole) !=
+                       static_cast<ssize_t>(tail))
+    return false;
+  return true;
 }
 
 /**
- * @brief Loads a binary file into memory.
- *
- * Reads the contents of a binary file byte by byte and loads them
- * sequentially into the memory, starting from address 0.
- *
- * @param fname The path to the file to load.
- * @return true if the file was successfully loaded, false if the file
-*        could not be opened or if the file contents exceed
-*        the memory size.
- ********************************************************************************/
-bool memory::load_file(const std::string &fname) {
+ * @brief Lists the pages that no longer read as fill bytes.
+ *
+ * Pages whose tables were never created, and pages in created tables that
+ * were never written, still read from the fill page and are left out.
+ *
+ * @return One entry per page, in address order.
+ ********************************************************************************/
+std::vector<snapshot_page> memory::get_pages() const {
+  std::vector<snapshot_page> pages;
+  uint32_t count = uint32_t((size + page_mask) >> page_bits);
+  for (uint32_t n = 0; n < count; ++n) {
+    const page *p = find_page(n << page_bits);
+    const uint8_t *rd =
+        p == nullptr ? fill : p->rd.load(std::memory_order_acquire);
+    if (rd == fill)
+      continue;
+    snapshot_page e;
+    e.page = n;
+    e.kind = rd == zero_page() ? snapshot_page::zero : snapshot_page::data;
+    pages.push_back(e);
+  }
+  return pages;
+}
+
+/**
+ * @brief Restores the pages saved in a snapshot file.
+ *
+ * The data pages are one contiguous run in the file and are mapped in a
+ * single call. If the file can't be mapped, they are read into frames of
+ * their own instead.
+ *
+ * @param fd The open snapshot file.
+ * @param data_offset Where the first data page starts in the file.
+ * @param pages The snapshot's page index.
+ * @return true on success.
+ ********************************************************************************/
+bool memory::load_pages(int fd, uint64_t data_offset,
+                        const std::vector<snapshot_page> &pages) {
+  size_t data_pages = 0;
+  for (const snapshot_page &e : pages) {
+    if ((uint64_t(e.page) << page_bits) >= size)
+      return false;
+    if (e.kind == snapshot_page::data)
+      ++data_pages;
+  }
+
+  // a mapping past the end of the file would only fault once touched
+  size_t len = data_pages * page_size;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || uint64_t(st.st_size) < data_offset + len)
+    return false;
+
+  uint8_t *base = nullptr;
+  if (len != 0) {
+    void *m = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                   off_t(data_offset));
+    if (m != MAP_FAILED) {
+      hold_mapping(m, len);
+      base = static_cast<uint8_t *>(m);
+    }
+  }
+
+  uint64_t off = 0;
+  for (const snapshot_page &e : pages) {
+    uint32_t addr = e.page << page_bits;
+    page &p = get_page(addr);
+    if (e.kind == snapshot_page::zero) {
+      p.frame.reset();
+      p.wr.store(nullptr, std::memory_order_relaxed);
+      p.rd.store(zero_page(), std::memory_order_relaxed);
+      continue;
+    }
+    if (base != nullptr) {
+      p.frame.reset();
+      p.rd.store(base + off, std::memory_order_relaxed);
+      p.wr.store(base + off, std::memory_order_relaxed);
+    } else if (pread(fd, write_ptr(addr), page_size,
+                     off_t(data_offset + off)) != ssize_t(page_size)) {
+      return false;
+    }
+    off += page_size;
+  }
+  return true;
+}
+
+/**
+ * @brief Loads a file into memory one byte at a time.
+ *
+ * Used for files that cannot be mapped, such as pipes.
+ *
+ * @param fname The path to the file to load.
+ * @return true if the file was successfully loaded, false if the file
+ *        could not be opened or if the file contents exceed
+ *        the memory size.
+ ********************************************************************************/
+bool memory::load_stream(const std::string &fname) {
   std::ifstream infile(fname, std::ios::in | std::ios::binary);
   if (!infile) {
     std::cerr << "Can't open file '" << fname << "' for reading.";
@@ -269,7 +748,162 @@ bool memory::load_file(const std::string &fname) {
       std::cerr << "Can't open file '" << fname << "' for reading.";
       return false;
     }
-    mem[addr] = i;
+    *write_ptr(addr) = i;
   }
   return true;
 }
+
+/**
+ * @brief Registers a watcher to be notified of writes to watched words.
+ * @param w The watcher to add.
+ ********************************************************************************/
+void memory::add_watcher(memory_watcher *w) { watchers.push_back(w); }
+
+/**
+ * @brief Unregisters a previously added watcher.
+ * @param w The watcher to remove.
+ ********************************************************************************/
+void memory::remove_watcher(memory_watcher *w) {
+  watchers.erase(std::remove(watchers.begin(), watchers.end(), w),
+                 watchers.end());
+}
+
+/**
+ * @brief Marks the word containing addr as cached code.
+ *
+ * Addresses outside of memory are ignored since nothing can be fetched
+ * from them without a warning anyway. The mark is set with a seq_cst
+ * read-modify-write, so a caller that watches a word before reading it
+ * can't miss a store from another thread; see check_watch_word().
+ *
+ * @param addr An address within the word to watch.
+ ********************************************************************************/
+void memory::watch(uint32_t addr) {
+  if (!in_range(addr, 1))
+    return;
+
+  std::atomic<uint32_t> *bits;
+  {
+    std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+    if (shared)
+      guard.lock();
+
+    page &p = get_page(addr);
+    bits = p.watched.load(std::memory_order_relaxed);
+    if (bits == nullptr) {
+      bits = new std::atomic<uint32_t>[page_size / 4 / 32];
+      for (uint32_t i = 0; i < page_size / 4 / 32; ++i)
+        bits[i].store(0, std::memory_order_relaxed);
+      p.watched.store(bits, std::memory_order_release);
+    }
+  }
+  uint32_t word = (addr & page_mask) / 4;
+  bits[word / 32].fetch_or(1u << (word % 32), std::memory_order_seq_cst);
+}
+
+/**
+ * @brief Prepares the memory to be used by several threads at once.
+ *
+ * Every page table is created here, so find_page() never sees the
+ * directory change while harts are running.
+ ********************************************************************************/
+void memory::share() {
+  uint64_t table_span = uint64_t(page_size) << table_bits;
+  for (uint64_t addr = 0; addr < size; addr += table_span)
+    get_page(addr);
+  shared = true;
+}
+
+/**
+ * @brief Makes a copy-on-write clone of the memory.
+ *
+ * A written page is frozen by moving its frame, if it has one, into a
+ * block that both memories hold and clearing its write pointer; the read
+ * pointer still points at the same bytes. Pages of a mapped file are
+ * frozen the same way, minus the move. make_private() then copies the
+ * page on its next write, exactly as for a page that was never written.
+ *
+ * @return The clone.
+ ********************************************************************************/
+std::unique_ptr<memory> memory::fork() {
+  typedef std::vector<std::unique_ptr<uint8_t[]>> frame_list;
+  std::shared_ptr<frame_list> frozen;
+  for (std::unique_ptr<page[]> &t : dir) {
+    if (!t)
+      continue;
+    for (uint32_t i = 0; i < (1u << table_bits); ++i) {
+      page &p = t[i];
+      if (p.wr.load(std::memory_order_relaxed) == nullptr)
+        continue;
+      if (p.frame) {
+        if (!frozen)
+          frozen = std::make_shared<frame_list>();
+        frozen->push_back(std::move(p.frame));
+      }
+      p.wr.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+  if (frozen)
+    holds.push_back(frozen);
+
+  std::unique_ptr<memory> m(new memory(size));
+  m->holds = holds;
+  for (size_t d = 0; d < dir.size(); ++d) {
+    if (!dir[d])
+      continue;
+    m->dir[d].reset(new page[1u << table_bits]);
+    for (uint32_t i = 0; i < (1u << table_bits); ++i)
+      m->dir[d][i].rd.store(dir[d][i].rd.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+  }
+  return m;
+}
+
+/**
+ * @brief Notifies watchers of any watched words in a write.
+ *
+ * A write of up to four bytes touches at most two words, and only spans
+ * two when it is misaligned.
+ *
+ * @param addr The first address being written.
+ * @param len The number of bytes being written.
+ ********************************************************************************/
+void memory::check_watch(uint32_t addr, uint32_t len) {
+  check_watch_word(addr);
+  if ((addr ^ (addr + len - 1)) & 0xfffffffc)
+    check_watch_word(addr + len - 1);
+}
+
+/**
+ * @brief Notifies watchers if the word containing addr is being watched.
+ *
+ * The mark is cleared before notifying, so a word is only reported once
+ * until someone watches it again. Stores call this after writing, so a
+ * watcher on another thread that refetches the word sees the new value.
+ *
+ * In a shared memory a full fence keeps the store from passing the check.
+ * Together with the seq_cst mark in watch(), a hart that watches a word
+ * and then reads it either reads this store or is notified of it.
+ *
+ * @param addr The address being written.
+ ********************************************************************************/
+void memory::check_watch_word(uint32_t addr) {
+  if (shared)
+    fence();
+  page *p = find_page(addr);
+  std::atomic<uint32_t> *bits =
+      p == nullptr ? nullptr : p->watched.load(std::memory_order_acquire);
+  if (bits == nullptr)
+    return;
+
+  uint32_t word = (addr & page_mask) / 4;
+  uint32_t bit = 1u << (word % 32);
+  if ((bits[word / 32].load(std::memory_order_relaxed) & bit) == 0)
+    return;
+  // when several threads store to the word only one of them reports it
+  if ((bits[word / 32].fetch_and(~bit, std::memory_order_acq_rel) & bit) == 0)
+    return;
+
+  for (memory_watcher *w : watchers)
+    w->invalidate(addr & 0xfffffffc);
+}
@@ -8,33 +8,97 @@
 #pragma once
 
 #include "hex.h"
+#include "snapshot_format.h"
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+/**
+ * @class memory_watcher
+ * @brief Interface for objects that cache decoded copies of guest memory.
+ *
+ * A watcher is told when a word it asked memory to watch is overwritten so
+ * it can drop whatever it derived from the old contents.
+ *
+ * In a shared memory the write may come from a hart on another thread.
+ * Each watcher belongs to one thread, the one that constructed it unless
+ * set_owner() says otherwise, and can use on_owner() to tell the two cases
+ * apart.
+ ********************************************************************************/
+class memory_watcher {
+public:
+  virtual ~memory_watcher() {}
+
+  /**
+   * @brief Called when a watched word is written.
+   * @param addr The word-aligned address that was modified.
+   ****************************************************************************/
+  virtual void invalidate(uint32_t addr) = 0;
+
+  /**
+   * @brief Makes the calling thread the owner of the watcher.
+   ****************************************************************************/
+  void set_owner() {
+    owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+  }
+
+protected:
+  /**
+   * @brief Checks if the calling thread owns the watcher.
+   * @return true if it is safe to touch the watcher's state directly.
+   ****************************************************************************/
+  bool on_owner() const {
+    return std::this_thread::get_id() == owner.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<std::thread::id> owner = {std::this_thread::get_id()};
+};
+
 /**
  * @class memory
  * @brief Simulates a chunk of computer memory.
  *
- * Manages a vector of bytes, providing methods to read and write 8, 16,
+ * Manages up to 4 GiB of bytes, providing methods to read and write 8, 16,
  * and 32-bit values in a little-endian format. It also handles memory
  * bounds-checking and can load a file into its simulated memory.
  * It inherits from 'hex' to get access to the formatting utilities.
+ *
+ * Memory is kept in 4 KiB pages behind a two-level page table. A page
+ * only gets its own storage the first time it is written; until then it
+ * reads from a shared page of 0xa5 fill bytes.
+ *
+ * After share() has been called, several harts may run against the memory
+ * from different threads at once.
+ *
+ * fork() makes a clone that shares every page with the original until
+ * one of the two writes it. Storage that pages read from without owning
+ * it, such as mapped files and frames frozen by a fork, is kept alive by
+ * reference counts until no memory reads from it any more.
  ********************************************************************************/
 class memory : public hex {
 public:
   /**
    * @brief Constructs a new memory object.
    * @param s The desired size of the memory. Will be rounded up to the
-   * nearest multiple of 16.
+   * nearest multiple of 16 and capped at 4 GiB.
    ****************************************************************************/
-  memory(uint32_t s);
+  memory(uint64_t s);
 
   /**
-   * @brief Destroys the memory object and clears the internal vector.
+   * @brief Destroys the memory object and frees its pages.
    ****************************************************************************/
   ~memory();
 
+  static constexpr uint32_t page_bits = 12;
+  static constexpr uint32_t page_size = 1u << page_bits;
+  static constexpr uint64_t max_size = uint64_t(1) << 32;
+
   /**
    * @brief Checks if a given address is outside the allocated memory size.
    * @param addr The address to check.
@@ -47,7 +111,7 @@ public:
    * @brief Gets the total allocated size of the memory.
    * @return The size of the memory in bytes (always a multiple of 16).
    ****************************************************************************/
-  uint32_t get_size() const;
+  uint64_t get_size() const;
 
   /**
    * @brief Reads an 8-bit unsigned value from memory.
@@ -115,6 +179,69 @@ public:
    ****************************************************************************/
   void set32(uint32_t addr, uint32_t val);
 
+  /**
+   * @brief Copies a block of bytes into memory.
+   * @param addr The first address to write.
+   * @param src The bytes to copy.
+   * @param len The number of bytes, which must all be in range.
+   ****************************************************************************/
+  void set_bytes(uint32_t addr, const uint8_t *src, uint64_t len);
+
+  /**
+   * @brief Sets a block of memory to zero.
+   *
+   * Pages that are zeroed completely read from a shared zero page and only
+   * get storage of their own once they are written.
+   *
+   * @param addr The first address to clear.
+   * @param len The number of bytes, which must all be in range.
+   ****************************************************************************/
+  void zero_bytes(uint32_t addr, uint64_t len);
+
+  /**
+   * @brief The read-modify-write operations amo32() can do.
+   ****************************************************************************/
+  enum amo_op {
+    amo_swap, amo_add, amo_xor, amo_and, amo_or,
+    amo_min, amo_max, amo_minu, amo_maxu
+  };
+
+  /**
+   * @brief Atomically applies op to a 32-bit word and returns its old value.
+   *
+   * Runs as a single host atomic instruction where there is one, and as a
+   * compare-and-swap loop otherwise, with sequentially consistent ordering
+   * either way. An out-of-range address gets the usual warning, is left
+   * alone and reads as 0.
+   *
+   * @param addr A 4-byte aligned address.
+   * @param op The operation.
+   * @param val The operand.
+   * @return The value the word held before.
+   ****************************************************************************/
+  uint32_t amo32(uint32_t addr, amo_op op, uint32_t val);
+
+  /**
+   * @brief Reads a 32-bit word with sequentially consistent ordering.
+   * @param addr A 4-byte aligned address.
+   * @return The value, or 0 with a warning if addr is out of range.
+   ****************************************************************************/
+  uint32_t load32_seq(uint32_t addr) const;
+
+  /**
+   * @brief Atomically replaces a 32-bit word if it holds an expected value.
+   * @param addr A 4-byte aligned address.
+   * @param expected The value the word must hold.
+   * @param desired The value to store.
+   * @return true if the word held expected and now holds desired.
+   ****************************************************************************/
+  bool cas32(uint32_t addr, uint32_t expected, uint32_t desired);
+
+  /**
+   * @brief Orders every earlier access before every later one.
+   ****************************************************************************/
+  static void fence() { std::atomic_thread_fence(std::memory_order_seq_cst); }
+
   /**
    * @brief Dumps the entire contents of memory to std::cout in a hex
    * and ASCII format.
@@ -123,12 +250,206 @@ public:
 
   /**
    * @brief Loads a binary file into the memory.
+   *
+   * Regular files are mapped copy-on-write straight into the page table,
+   * so a page of the image is only copied once the guest writes to it.
+   *
    * @param fname The path to the file to load.
    * @return true if the file was loaded successfully, false otherwise.
    * @note Stops loading if the file is larger than the memory size.
    ****************************************************************************/
   bool load_file(const std::string &fname);
 
+  /**
+   * @brief Lists the pages that no longer read as fill bytes.
+   * @return One entry per page, in address order.
+   ****************************************************************************/
+  std::vector<snapshot_page> get_pages() const;
+
+  /**
+   * @brief Gets the contents of a page.
+   * @param page The page number, address >> page_bits, of an in-range page.
+   * @return page_size bytes, which may be shared with other pages.
+   ****************************************************************************/
+  const uint8_t *get_page_data(uint32_t page) const {
+    return read_ptr(page << page_bits);
+  }
+
+  /**
+   * @brief Restores the pages saved in a snapshot file.
+   *
+   * Like load_file(), the data pages are mapped copy-on-write from the
+   * file, so even a large memory is back straight away and a page is only
+   * copied once the guest writes to it. Only meant for a memory that has
+   * not been written yet.
+   *
+   * @param fd The open snapshot file.
+   * @param data_offset Where the first data page starts in the file.
+   * @param pages The snapshot's page index.
+   * @return true on success, false if a page is out of range or the file
+   * is too short.
+   ****************************************************************************/
+  bool load_pages(int fd, uint64_t data_offset,
+                  const std::vector<snapshot_page> &pages);
+
+  /**
+   * @brief Makes a copy-on-write clone of the memory.
+   *
+   * Every page this memory has written becomes read-only and shared with
+   * the clone, so the next write to it, by either memory, copies just that
+   * page. Only the page tables that exist are copied, so the cost of a
+   * fork depends on how much of the memory was touched, not its size.
+   *
+   * The memory must not be in use by harts on other threads. Forking a
+   * memory that has not been written since its last fork changes nothing
+   * in it, so several threads may fork such a memory at once.
+   *
+   * @return The clone, which has no watchers and is not shared.
+   ****************************************************************************/
+  std::unique_ptr<memory> fork();
+
+  /**
+   * @brief Registers a watcher to be notified of writes to watched words.
+   * @param w The watcher to add.
+   ****************************************************************************/
+  void add_watcher(memory_watcher *w);
+
+  /**
+   * @brief Unregisters a previously added watcher.
+   * @param w The watcher to remove.
+   ****************************************************************************/
+  void remove_watcher(memory_watcher *w);
+
+  /**
+   * @brief Marks the word containing addr as cached code.
+   *
+   * The next write to that word notifies every registered watcher and
+   * clears the mark.
+   *
+   * @param addr An address within the word to watch.
+   ****************************************************************************/
+  void watch(uint32_t addr);
+
+  /**
+   * @brief Prepares the memory to be used by several threads at once.
+   *
+   * Creates every page table up front so the table directory never
+   * changes afterwards, and makes giving a page its own frame and the
+   * watch bookkeeping take a lock. Loads and stores to pages that already
+   * have frames stay lock-free. Loading files is not allowed after this.
+   ****************************************************************************/
+  void share();
+
 private:
-  std::vector<uint8_t> mem;
+  static constexpr uint32_t table_bits = 10;     // pages per page table
+  static constexpr uint32_t page_mask = page_size - 1;
+
+  /**
+   * @struct page
+   * @brief One entry of a page table.
+   *
+   * rd always points at something loads can read: the shared fill page
+   * until the page is written, then the page's own frame. wr stays null
+   * until the page has a frame of its own.
+   *
+   * The pointers are atomic so a shared memory can publish a new frame
+   * while other threads read the page. On x86-64 the acquire loads on the
+   * fast paths are ordinary loads.
+   **************************************************************************/
+  struct page {
+    std::atomic<const uint8_t *> rd = {nullptr};
+    std::atomic<uint8_t *> wr = {nullptr};
+    std::unique_ptr<uint8_t[]> frame;
+    std::atomic<std::atomic<uint32_t> *> watched = {nullptr}; // bit per word
+
+    ~page() { delete[] watched.load(std::memory_order_relaxed); }
+  };
+
+  /**
+   * @brief Checks if an access lies entirely inside memory.
+   * @param addr The first address of the access.
+   * @param len The number of bytes accessed.
+   * @return true if every byte of the access is in range.
+   ****************************************************************************/
+  bool in_range(uint32_t addr, uint32_t len) const {
+    return uint64_t(addr) + len <= size;
+  }
+
+  /**
+   * @brief Checks if an access can take a native-width fast path.
+   *
+   * This is the one check the fast paths take: the access has to be in
+   * range and inside a single page. Anything else goes through the
+   * byte-at-a-time slow path so the out-of-range warnings stay the same.
+   *
+   * @param addr The first address of the access.
+   * @param len The number of bytes accessed.
+   * @return true if the access can be done with one host load or store.
+   ****************************************************************************/
+  bool is_fast(uint32_t addr, uint32_t len) const {
+    return in_range(addr, len) && (addr & page_mask) <= page_size - len;
+  }
+
+  /**
+   * @brief Finds the page table entry for an address.
+   * @param addr An in-range address.
+   * @return The entry, or nullptr if its page table was never created.
+   ****************************************************************************/
+  page *find_page(uint32_t addr) const {
+    page *t = dir[addr >> (page_bits + table_bits)].get();
+    if (t == nullptr)
+      return nullptr;
+    return &t[(addr >> page_bits) & ((1u << table_bits) - 1)];
+  }
+
+  /**
+   * @brief Gets a host pointer for reading an in-range address.
+   * @param addr The address.
+   * @return A pointer to the byte, which may be in the shared fill page.
+   ****************************************************************************/
+  const uint8_t *read_ptr(uint32_t addr) const {
+    const page *p = find_page(addr);
+    return (p == nullptr ? fill : p->rd.load(std::memory_order_acquire)) +
+           (addr & page_mask);
+  }
+
+  /**
+   * @brief Gets a host pointer for writing an in-range address.
+   * @param addr The address.
+   * @return A pointer to the byte in the page's own frame.
+   ****************************************************************************/
+  uint8_t *write_ptr(uint32_t addr) {
+    page *p = find_page(addr);
+    uint8_t *wr = p == nullptr ? nullptr : p->wr.load(std::memory_order_acquire);
+    if (wr == nullptr)
+      wr = make_private(addr).wr.load(std::memory_order_relaxed);
+    return wr + (addr & page_mask);
+  }
+
+  page &get_page(uint32_t addr);
+  page &make_private(uint32_t addr);
+  bool map_file(int fd, uint64_t len);
+  void hold_mapping(void *m, size_t len);
+  bool load_stream(const std::string &fname);
+
+  /**
+   * @brief Notifies watchers of any watched words in a write.
+   * @param addr The first address being written.
+   * @param len The number of bytes being written.
+   ****************************************************************************/
+  void check_watch(uint32_t addr, uint32_t len);
+
+  /**
+   * @brief Notifies watchers if the word containing addr is being watched.
+   * @param addr The address being written.
+   ****************************************************************************/
+  void check_watch_word(uint32_t addr);
+
+  uint64_t size;
+  const uint8_t *fill;                           // shared page of 0xa5
+  std::vector<std::unique_ptr<page[]>> dir;      // lazily created tables
+  std::vector<memory_watcher *> watchers;
+  std::vector<std::shared_ptr<const void>> holds; // storage pages read from
+  bool shared = {false};                         // see share()
+  std::mutex lock;                               // only taken when shared
 };
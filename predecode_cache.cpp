@@ -0,0 +1,99 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file predecode_cache.cpp
+ * @brief Implementation of the predecoded instruction cache.
+ ********************************************************************************/
+#include "predecode_cache.h"
+
+/**
+ * @brief Constructs a cache covering all of the given memory.
+ *
+ * Registers the cache as a watcher so writes into cached code reach it.
+ *
+ * @param m The memory the cached instructions are fetched from.
+ ********************************************************************************/
+predecode_cache::predecode_cache(memory &m) : mem(m) {
+  pages.resize((mem.get_size() + memory::page_size - 1) >> memory::page_bits);
+  mem.add_watcher(this);
+}
+
+/**
+ * @brief Unregisters the cache from its memory.
+ ********************************************************************************/
+predecode_cache::~predecode_cache() { mem.remove_watcher(this); }
+
+/**
+ * @brief Stores a decoded instruction for pc.
+ *
+ * The slots for its page are allocated on the first insert into it.
+ *
+ * @param pc The address of the instruction.
+ * @param d The decoded instruction.
+ * @return A pointer to the stored record.
+ ********************************************************************************/
+const decoded_insn *predecode_cache::insert(uint32_t pc, const decoded_insn &d) {
+  uint32_t i = pc >> memory::page_bits;
+  if (i >= pages.size()) {
+    scratch = d;
+    return &scratch;
+  }
+
+  if (!pages[i])
+    pages[i].reset(new decoded_insn[memory::page_size >> slot_shift]);
+  decoded_insn &slot_d = pages[i][slot(pc)];
+  slot_d = d;
+  return &slot_d;
+}
+
+/**
+ * @brief Drops the entry for a word that was overwritten.
+ *
+ * A write from another thread only sets the flag sync() checks.
+ *
+ * @param addr The word-aligned address that was modified.
+ ********************************************************************************/
+void predecode_cache::invalidate(uint32_t addr) {
+  if (!on_owner()) {
+    remote.store(true, std::memory_order_release);
+    return;
+  }
+
+  drop(addr);
+  if (slot_shift == 1) {
+    drop(addr + 2);
+    drop(addr - 2);
+  }
+}
+
+/**
+ * @brief Sets whether instructions may start on any halfword.
+ * @param on true to allow 2-byte aligned instructions.
+ ********************************************************************************/
+void predecode_cache::set_compressed(bool on) {
+  flush();
+  slot_shift = on ? 1 : 2;
+}
+
+/**
+ * @brief Drops the entry for the instruction at pc, if there is one.
+ * @param pc The address of the instruction.
+ ********************************************************************************/
+void predecode_cache::drop(uint32_t pc) {
+  uint32_t i = pc >> memory::page_bits;
+  if (i < pages.size() && pages[i])
+    pages[i][slot(pc)].handler = nullptr;
+}
+
+/**
+ * @brief Drops every cached entry.
+ ********************************************************************************/
+void predecode_cache::flush() {
+  for (std::unique_ptr<decoded_insn[]> &p : pages)
+    p.reset();
+}
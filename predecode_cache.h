@@ -0,0 +1,181 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "memory.h"
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+class rv32i_hart;
+
+/**
+ * @brief Every operation the hart can execute, in handler table order.
+ *
+ * Each name X has a matching rv32i_hart::exec_X handler. block_end is a
+ * sentinel placed after the last instruction of every basic block.
+ ********************************************************************************/
+#define RV32I_OPS(X)                                                           \
+  X(illegal_insn) X(block_end)                                                 \
+  X(lui) X(auipc) X(jal) X(jalr)                                               \
+  X(add) X(sub) X(and) X(or) X(sll) X(slt) X(sltu) X(sra) X(srl) X(xor)        \
+  X(mul) X(mulh) X(mulhsu) X(mulhu) X(div) X(divu) X(rem) X(remu)              \
+  X(addi) X(andi) X(ori) X(slli) X(slti) X(sltiu) X(srai) X(srli) X(xori)      \
+  X(lb) X(lh) X(lw) X(lbu) X(lhu)                                              \
+  X(beq) X(bne) X(blt) X(bge) X(bltu) X(bgeu)                                  \
+  X(sb) X(sh) X(sw)                                                            \
+  X(ecall) X(ebreak)                                                           \
+  X(csrrw) X(csrrs) X(csrrc) X(csrrwi) X(csrrsi) X(csrrci)                     \
+  X(fence) X(fence_i)                                                          \
+  X(lr_w) X(sc_w) X(amoswap_w) X(amoadd_w) X(amoxor_w) X(amoand_w)             \
+  X(amoor_w) X(amomin_w) X(amomax_w) X(amominu_w) X(amomaxu_w)
+
+#define RV32I_OP_ENUM(NAME) op_##NAME,
+enum insn_op : uint8_t { RV32I_OPS(RV32I_OP_ENUM) op_count };
+#undef RV32I_OP_ENUM
+
+/**
+ * @struct decoded_insn
+ * @brief A predecoded instruction, ready to be executed.
+ *
+ * Holds everything an exec_* handler needs so the fields only have to be
+ * pulled out of the instruction word once. The raw word is kept for
+ * rendering trace output.
+ *
+ * A compressed instruction is stored as the 32-bit instruction it expands
+ * to, so it runs through the same handlers; only len tells them apart.
+ *
+ * Records in the predecode cache hold the single-step version of their
+ * handler. Copies inside a basic block hold the threaded version, which
+ * jumps straight to the handler of the record that follows it.
+ ********************************************************************************/
+struct decoded_insn {
+  void (rv32i_hart::*handler)(const decoded_insn &, std::ostream *) = nullptr;
+  insn_op op = op_illegal_insn;
+  uint32_t insn = 0;
+  int32_t imm = 0;     // sign-extended immediate for the insn's format
+  uint8_t rd = 0;
+  uint8_t rs1 = 0;
+  uint8_t rs2 = 0;
+  uint8_t len = 4;     // 2 for an RV32C instruction, held here expanded
+};
+
+/**
+ * @class predecode_cache
+ * @brief A PC-indexed cache of predecoded instructions.
+ *
+ * Slots are allocated a memory page at a time, the first time code in that
+ * page is fetched. Each cached word is watched, so a store into code drops
+ * the stale entry and the next fetch decodes it again.
+ *
+ * A store into code from another thread cannot touch the slots while the
+ * owner may be reading them, so it only sets a flag and the owner flushes
+ * the whole cache at its next sync(). FENCE.I sets the same flag.
+ ********************************************************************************/
+class predecode_cache : public memory_watcher {
+public:
+  /**
+   * @brief Constructs a cache covering all of the given memory.
+   * @param m The memory the cached instructions are fetched from.
+   ****************************************************************************/
+  predecode_cache(memory &m);
+
+  /**
+   * @brief Unregisters the cache from its memory.
+   ****************************************************************************/
+  ~predecode_cache();
+
+  predecode_cache(const predecode_cache &) = delete;
+  predecode_cache &operator=(const predecode_cache &) = delete;
+
+  /**
+   * @brief Looks up the instruction at pc.
+   * @param pc The address of the instruction.
+   * @return The cached record, or nullptr on a miss.
+   ****************************************************************************/
+  const decoded_insn *lookup(uint32_t pc) const {
+    uint32_t i = pc >> memory::page_bits;
+    if (i >= pages.size() || !pages[i])
+      return nullptr;
+    const decoded_insn *d = &pages[i][slot(pc)];
+    return d->handler == nullptr ? nullptr : d;
+  }
+
+  /**
+   * @brief Stores a decoded instruction for pc.
+   *
+   * Addresses outside of memory are not cached; the record is copied to a
+   * scratch slot instead so the caller always gets something to run. The
+   * caller must have watched the instruction's words before reading them.
+   *
+   * @param pc The address of the instruction.
+   * @param d The decoded instruction.
+   * @return A pointer to the stored record.
+   ****************************************************************************/
+  const decoded_insn *insert(uint32_t pc, const decoded_insn &d);
+
+  /**
+   * @brief Sets whether instructions may start on any halfword.
+   *
+   * With RV32C a page needs a slot per halfword instead of one per word.
+   * Drops every cached entry.
+   *
+   * @param on true to allow 2-byte aligned instructions.
+   ****************************************************************************/
+  void set_compressed(bool on);
+
+  /**
+   * @brief Drops the entry for a word that was overwritten.
+   *
+   * With RV32C this also drops the halfword after it and a 32-bit
+   * instruction that started in the halfword before it.
+   *
+   * @param addr The word-aligned address that was modified.
+   ****************************************************************************/
+  void invalidate(uint32_t addr) override;
+
+  /**
+   * @brief Drops every cached entry.
+   ****************************************************************************/
+  void flush();
+
+  /**
+   * @brief Has the next sync() drop every cached entry.
+   *
+   * Entries may still be in use until then, so nothing is freed here.
+   ****************************************************************************/
+  void mark_stale() { remote.store(true, std::memory_order_relaxed); }
+
+  /**
+   * @brief Picks up writes to cached code made by other threads.
+   *
+   * Flushes the cache if there were any. Call this between blocks.
+   *
+   * @return true if the cache was flushed.
+   ****************************************************************************/
+  bool sync() {
+    if (!remote.load(std::memory_order_relaxed) ||
+        !remote.exchange(false, std::memory_order_acquire))
+      return false;
+    flush();
+    return true;
+  }
+
+private:
+  uint32_t slot(uint32_t pc) const {
+    return (pc & (memory::page_size - 1)) >> slot_shift;
+  }
+  void drop(uint32_t pc);
+
+  memory &mem;
+  std::vector<std::unique_ptr<decoded_insn[]>> pages;  // one per memory page
+  decoded_insn scratch;
+  uint32_t slot_shift = 2;              // 1 when instructions can be 2 bytes
+  std::atomic<bool> remote = {false};   // other threads' writes, FENCE.I
+};
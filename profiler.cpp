@@ -0,0 +1,308 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file profiler.cpp
+ * @brief Implementation of the guest code profiler.
+ ********************************************************************************/
+#include "profiler.h"
+#include "hex.h"
+#include "rv32i_decode.h"
+#include <algorithm>
+#include <iomanip>
+
+/**
+ * @brief Sets up an empty profile.
+ * @param syms The program's symbols, or nullptr.
+ * @param entry The address execution starts at.
+ ********************************************************************************/
+profiler::profiler(const symbol_table *syms, uint32_t entry) : syms(syms) {
+  entries.insert(entry);
+}
+
+/**
+ * @brief Makes the profile record of a block on its first run.
+ * @param b The block.
+ * @return The new record, which b now points at.
+ ********************************************************************************/
+block_profile *profiler::add_block(basic_block &b) {
+  blocks.emplace_back();
+  block_profile &p = blocks.back();
+  p.start = b.start;
+  uint32_t addr = b.start;
+  for (size_t k = 0; k < b.length(); ++k) {
+    p.pcs.push_back(addr);
+    p.insns.push_back(b.insns[k].insn);
+    addr += b.insns[k].len;
+  }
+  b.profile = &p;
+  return &p;
+}
+
+/**
+ * @brief Counts a single-stepped instruction.
+ * @param pc The instruction's address.
+ * @param d The instruction.
+ * @param next_pc The pc after it ran.
+ * @param ends true if d has to be the last instruction in a block.
+ ********************************************************************************/
+void profiler::note_insn(uint32_t pc, const decoded_insn &d, uint32_t next_pc,
+                         bool ends) {
+  ++total;
+  if (stepped.pcs.empty())
+    stepped.start = pc;
+  stepped.pcs.push_back(pc);
+  stepped.insns.push_back(d.insn);
+  if (ends || stepped.pcs.size() == block_cache::max_block_insns)
+    end_stepped();
+  if (d.op == op_jal || d.op == op_jalr)
+    note_jump(pc, d, next_pc);
+}
+
+/**
+ * @brief Counts the steps held back as one run of a block.
+ *
+ * The record is shared by every run from the same start, unless the code
+ * there has changed, in which case the new version gets its own.
+ ********************************************************************************/
+void profiler::end_stepped() {
+  block_profile *&p = stepped_blocks[stepped.start];
+  if (p == nullptr || p->pcs != stepped.pcs || p->insns != stepped.insns) {
+    blocks.push_back(stepped);
+    p = &blocks.back();
+  }
+  ++p->runs;
+  stepped.pcs.clear();
+  stepped.insns.clear();
+}
+
+/**
+ * @brief Counts the steps held back one instruction at a time, as they
+ * never reached the end of a block.
+ ********************************************************************************/
+void profiler::flush_stepped() {
+  for (size_t k = 0; k < stepped.pcs.size(); ++k) {
+    ++pc_counts[stepped.pcs[k]];
+    insns[stepped.pcs[k]] = stepped.insns[k];
+  }
+  stepped.pcs.clear();
+  stepped.insns.clear();
+}
+
+/**
+ * @brief Follows a call or return.
+ *
+ * These are the hints the RISC-V spec gives return-address predictors,
+ * without the case of a jalr that both pops and pushes, which is counted
+ * as a plain call. A return pops the innermost call whatever its return
+ * address, so code that unwinds several frames at once is charged to the
+ * innermost one.
+ *
+ * @param pc The address of the jal or jalr.
+ * @param d The jal or jalr.
+ * @param next_pc Where it jumped to.
+ ********************************************************************************/
+void profiler::note_jump(uint32_t pc, const decoded_insn &d,
+                         uint32_t next_pc) {
+  bool rd_link = d.rd == 1 || d.rd == 5;
+  bool rs1_link = d.op == op_jalr && (d.rs1 == 1 || d.rs1 == 5);
+  if (rd_link) {
+    entries.insert(next_pc);
+    stack.push_back({pc, next_pc, total});
+  } else if (rs1_link && !stack.empty()) {
+    const frame &f = stack.back();
+    arc &a = arcs[{f.site, f.target}];
+    ++a.calls;
+    a.inclusive += total - f.start;
+    stack.pop_back();
+  }
+}
+
+/**
+ * @brief Closes the calls that never returned.
+ ********************************************************************************/
+void profiler::finish() {
+  flush_stepped();
+  while (!stack.empty()) {
+    const frame &f = stack.back();
+    arc &a = arcs[{f.site, f.target}];
+    ++a.calls;
+    a.inclusive += total - f.start;
+    stack.pop_back();
+  }
+}
+
+/**
+ * @brief Adds up the executions of every instruction.
+ * @return The count for each address that ran, in address order.
+ ********************************************************************************/
+std::map<uint32_t, uint64_t> profiler::pc_totals() const {
+  std::map<uint32_t, uint64_t> counts(pc_counts.begin(), pc_counts.end());
+  for (const block_profile &p : blocks)
+    if (p.runs != 0)
+      for (uint32_t pc : p.pcs)
+        counts[pc] += p.runs;
+  return counts;
+}
+
+/**
+ * @brief Finds the function an address belongs to.
+ * @param addr A code address.
+ * @return The address the function starts at.
+ ********************************************************************************/
+uint32_t profiler::function_of(uint32_t addr) const {
+  const symbol *s = syms != nullptr ? syms->containing(addr) : nullptr;
+  if (s != nullptr)
+    return s->addr;
+  auto it = entries.upper_bound(addr);
+  return it == entries.begin() ? *it : *--it;
+}
+
+/**
+ * @brief Names a function.
+ * @param addr The address the function starts at.
+ * @return Its symbol, or its address in hex.
+ ********************************************************************************/
+std::string profiler::function_name(uint32_t addr) const {
+  const symbol *s = syms != nullptr ? syms->at(addr) : nullptr;
+  return s != nullptr ? s->name : hex::to_hex0x32(addr);
+}
+
+/**
+ * @brief Orders (count, address) pairs by count, then address.
+ * @param a One pair.
+ * @param b The other.
+ * @return true if a has the higher count, or the same count and the lower
+ * address.
+ ********************************************************************************/
+static bool hotter(const std::pair<uint64_t, uint32_t> &a,
+                   const std::pair<uint64_t, uint32_t> &b) {
+  return a.first != b.first ? a.first > b.first : a.second < b.second;
+}
+
+/**
+ * @brief Writes a flat profile.
+ *
+ * Functions are sorted by the instructions run in them, not counting
+ * their callees; instructions and blocks by how often they ran. A block
+ * that was rebuilt after its code changed is listed once per version.
+ *
+ * @param os Where to write the report.
+ ********************************************************************************/
+void profiler::write_flat(std::ostream &os) const {
+  std::map<uint32_t, uint64_t> counts = pc_totals();
+
+  std::map<uint32_t, uint64_t> self;
+  for (const std::pair<const uint32_t, uint64_t> &c : counts)
+    self[function_of(c.first)] += c.second;
+  std::map<uint32_t, uint64_t> calls;
+  for (const auto &a : arcs)
+    calls[function_of(a.first.second)] += a.second.calls;
+
+  std::vector<std::pair<uint64_t, uint32_t>> funcs;
+  for (const std::pair<const uint32_t, uint64_t> &f : self)
+    funcs.emplace_back(f.second, f.first);
+  std::sort(funcs.begin(), funcs.end(), hotter);
+
+  os << "Flat profile: " << total << " instructions\n\n"
+     << "  % insns           self      calls  function\n";
+  for (const std::pair<uint64_t, uint32_t> &f : funcs) {
+    auto c = calls.find(f.second);
+    os << std::right << std::fixed << std::setprecision(2) << std::setw(9)
+       << (total ? 100.0 * f.first / total : 0.0) << std::setw(15) << f.first
+       << std::setw(11) << (c == calls.end() ? 0 : c->second) << "  "
+       << function_name(f.second) << '\n';
+  }
+
+  std::unordered_map<uint32_t, uint32_t> words(insns);
+  for (const block_profile &p : blocks)
+    for (size_t k = 0; k < p.pcs.size(); ++k)
+      words[p.pcs[k]] = p.insns[k];
+
+  std::vector<std::pair<uint64_t, uint32_t>> hot;
+  for (const std::pair<const uint32_t, uint64_t> &c : counts)
+    hot.emplace_back(c.second, c.first);
+  size_t n = std::min(hot_count, hot.size());
+  std::partial_sort(hot.begin(), hot.begin() + n, hot.end(), hotter);
+
+  os << "\nHottest instructions:\n"
+     << "          count  instruction\n";
+  for (size_t i = 0; i < n; ++i)
+    os << std::setw(15) << hot[i].first << "  " << hex::to_hex32(hot[i].second)
+       << ": " << rv32i_decode::decode(hot[i].second, words[hot[i].second])
+       << '\n';
+
+  std::vector<const block_profile *> runs;
+  for (const block_profile &p : blocks)
+    if (p.runs != 0)
+      runs.push_back(&p);
+  n = std::min(hot_count, runs.size());
+  std::partial_sort(runs.begin(), runs.begin() + n, runs.end(),
+                    [](const block_profile *a, const block_profile *b) {
+                      return hotter({a->runs, a->start}, {b->runs, b->start});
+                    });
+
+  os << "\nHottest basic blocks:\n"
+     << "           runs  insns  block\n";
+  for (size_t i = 0; i < n; ++i) {
+    os << std::setw(15) << runs[i]->runs << std::setw(7)
+       << runs[i]->pcs.size() << "  " << hex::to_hex32(runs[i]->start);
+    if (syms != nullptr && syms->containing(runs[i]->start) != nullptr)
+      os << " <" << syms->name_of(runs[i]->start) << ">";
+    os << '\n';
+  }
+  os.flush();
+}
+
+/**
+ * @brief Writes the profile in callgrind's format.
+ *
+ * Positions are instruction addresses. Each function lists the cost of
+ * each of its instructions and, after the instruction that makes it,
+ * every call it made with that call's inclusive cost.
+ *
+ * @param os Where to write the profile.
+ * @param cmd The program that was profiled.
+ ********************************************************************************/
+void profiler::write_callgrind(std::ostream &os,
+                               const std::string &cmd) const {
+  // one line per instruction or call site, grouped by function
+  struct line {
+    uint64_t self = 0;
+    std::vector<std::pair<uint32_t, const arc *>> calls;   // by target
+  };
+  std::map<uint32_t, std::map<uint32_t, line>> funcs;
+  for (const std::pair<const uint32_t, uint64_t> &c : pc_totals())
+    funcs[function_of(c.first)][c.first].self = c.second;
+  for (const auto &a : arcs)
+    funcs[function_of(a.first.first)][a.first.first].calls.emplace_back(
+        a.first.second, &a.second);
+
+  os << "# callgrind format\n"
+     << "version: 1\n"
+     << "creator: rv32i\n"
+     << "cmd: " << cmd << '\n'
+     << "positions: instr\n"
+     << "events: Ir\n"
+     << "summary: " << total << "\n\n";
+
+  for (const auto &f : funcs) {
+    os << "fn=" << function_name(f.first) << '\n';
+    for (const auto &l : f.second) {
+      std::string pos = hex::to_hex0x32(l.first);
+      if (l.second.self != 0)
+        os << pos << ' ' << l.second.self << '\n';
+      for (const std::pair<uint32_t, const arc *> &c : l.second.calls)
+        os << "cfn=" << function_name(function_of(c.first)) << '\n'
+           << "calls=" << c.second->calls << ' ' << hex::to_hex0x32(c.first)
+           << '\n'
+           << pos << ' ' << c.second->inclusive << '\n';
+    }
+    os << '\n';
+  }
+  os.flush();
+}
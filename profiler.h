@@ -0,0 +1,169 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "block_cache.h"
+#include "predecode_cache.h"
+#include "symbol_table.h"
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @struct block_profile
+ * @brief What a profiler knows about one basic block.
+ *
+ * The block points back at this record, so counting a run of it is a
+ * single increment. Runs that a store into code cut short are counted
+ * per instruction by the profiler instead.
+ ********************************************************************************/
+struct block_profile {
+  uint32_t start = 0;
+  std::vector<uint32_t> pcs;          // address of each instruction
+  std::vector<uint32_t> insns;        // its word, expanded if compressed
+  uint64_t runs = 0;                  // complete runs
+};
+
+/**
+ * @class profiler
+ * @brief Counts where a hart spends its instructions.
+ *
+ * The hart reports every basic block it finishes and every instruction it
+ * single-steps; stepped instructions are gathered back into blocks with
+ * the same boundaries. From that the profiler keeps a count per pc and per
+ * block, and follows calls and returns the way the RISC-V calling
+ * convention marks them: a jal or jalr that links into ra (or t0) is a
+ * call, and a jalr through ra (or t0) that doesn't link is a return. A
+ * shadow call stack turns those into call counts and inclusive costs per
+ * call site.
+ *
+ * Code is grouped into functions by the ELF symbol table when there is
+ * one. Otherwise, and for code outside every symbol, a function runs from
+ * a call target, or the entry point, up to the next one.
+ ********************************************************************************/
+class profiler {
+public:
+  /**
+   * @brief Sets up an empty profile.
+   * @param syms The program's symbols, or nullptr. It must outlive the
+   * profiler.
+   * @param entry The address execution starts at.
+   ****************************************************************************/
+  profiler(const symbol_table *syms, uint32_t entry);
+
+  /**
+   * @brief Counts a run of a basic block.
+   * @param b The block.
+   * @param n The number of its instructions that ran, at least 1.
+   * @param next_pc The pc after the last of them.
+   ****************************************************************************/
+  void note_block(basic_block &b, size_t n, uint32_t next_pc) {
+    if (!stepped.pcs.empty())
+      flush_stepped();
+    block_profile *p = b.profile != nullptr ? b.profile : add_block(b);
+    total += n;
+    if (n == b.length())
+      ++p->runs;
+    else
+      for (size_t k = 0; k < n; ++k)
+        ++pc_counts[p->pcs[k]];
+    const decoded_insn &last = b.insns[n - 1];
+    if (last.op == op_jal || last.op == op_jalr)
+      note_jump(p->pcs[n - 1], last, next_pc);
+  }
+
+  /**
+   * @brief Counts a single-stepped instruction.
+   *
+   * Consecutive steps are counted as a run of a block once one of them
+   * ends it; until then they are held back.
+   *
+   * @param pc The instruction's address.
+   * @param d The instruction.
+   * @param next_pc The pc after it ran.
+   * @param ends true if d has to be the last instruction in a block.
+   ****************************************************************************/
+  void note_insn(uint32_t pc, const decoded_insn &d, uint32_t next_pc,
+                 bool ends);
+
+  /**
+   * @brief Closes the calls that never returned.
+   *
+   * Call once the run is over, before writing any report; every open call
+   * is charged with the instructions run since it was made, and steps
+   * still held back are counted.
+   ****************************************************************************/
+  void finish();
+
+  /**
+   * @brief Writes a flat profile.
+   *
+   * Lists every function by the instructions run in it, then the hottest
+   * instructions and basic blocks.
+   *
+   * @param os Where to write the report.
+   ****************************************************************************/
+  void write_flat(std::ostream &os) const;
+
+  /**
+   * @brief Writes the profile in callgrind's format.
+   *
+   * Costs are instructions (Ir) per instruction address, with a call
+   * record for every call site, so KCachegrind and callgrind_annotate can
+   * show both self and inclusive costs.
+   *
+   * @param os Where to write the profile.
+   * @param cmd The program that was profiled, for the header.
+   ****************************************************************************/
+  void write_callgrind(std::ostream &os, const std::string &cmd) const;
+
+private:
+  static constexpr size_t hot_count = 20;     // rows in the hot lists
+
+  /**
+   * @struct frame
+   * @brief A call that has not returned yet.
+   **************************************************************************/
+  struct frame {
+    uint32_t site;            // address of the call instruction
+    uint32_t target;          // address called
+    uint64_t start;           // total when the call was made
+  };
+
+  /**
+   * @struct arc
+   * @brief The calls made from one call site to one target.
+   **************************************************************************/
+  struct arc {
+    uint64_t calls = 0;
+    uint64_t inclusive = 0;   // instructions run inside the calls
+  };
+
+  block_profile *add_block(basic_block &b);
+  void end_stepped();
+  void flush_stepped();
+  void note_jump(uint32_t pc, const decoded_insn &d, uint32_t next_pc);
+  std::map<uint32_t, uint64_t> pc_totals() const;
+  uint32_t function_of(uint32_t addr) const;
+  std::string function_name(uint32_t addr) const;
+
+  const symbol_table *syms;
+  uint64_t total = {0};
+  std::deque<block_profile> blocks;
+  block_profile stepped;                              // steps not yet counted
+  std::unordered_map<uint32_t, block_profile *> stepped_blocks;   // by start
+  std::unordered_map<uint32_t, uint64_t> pc_counts;   // outside full runs
+  std::unordered_map<uint32_t, uint32_t> insns;       // words single-stepped
+  std::set<uint32_t> entries;                         // known function starts
+  std::vector<frame> stack;
+  std::map<std::pair<uint32_t, uint32_t>, arc> arcs;  // by (site, target)
+};
@@ -62,14 +62,20 @@ void registerfile::dump(const string &hdr) const {
     if (reg != 0)
       std::cout << '\n';
 
-    std::string rname = "x" + std::to_string(reg);
-    std::cout << hdr << std::setw(3) << std::right << rname;
+    // "xNN" right-aligned in 3 columns + 8 * " hhhhhhhh" + the middle gap
+    char line[4 + 8 * 9 + 1];
+    char *p = line;
+    *p++ = reg < 10 ? ' ' : 'x';
+    *p++ = reg < 10 ? 'x' : char('0' + reg / 10);
+    *p++ = char('0' + reg % 10);
 
     for (uint32_t i = 0; i < 8 && (reg + i) < regs.size(); i++) {
       if (i == 4)
-        std::cout << " ";
-
-      std::cout << std::right << std::setw(9) << hex::to_hex32(regs[i + reg]);
+        *p++ = ' ';
+      *p++ = ' ';
+      p = hex::fmt_hex32(p, regs[i + reg]);
     }
+    std::cout << hdr;
+    std::cout.write(line, p - line);
   }
 }
@@ -55,6 +55,16 @@ public:
    ****************************************************************************/
   int32_t get(uint32_t r) const;
 
+  /**
+   * @brief Gives direct access to the 32 registers.
+   *
+   * Meant for generated code that reads and writes registers without going
+   * through get() and set(). Callers must never write to x0.
+   *
+   * @return A pointer to register x0.
+   ****************************************************************************/
+  int32_t *data() { return regs.data(); }
+
   /**
    * @brief Dumps the contents of the register file to stdout.
    *
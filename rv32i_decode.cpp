@@ -79,7 +79,69 @@ string rv32i_decode::decode(uint32_t addr, uint32_t insn) {
     assert(0 && "system fucked");
   }
 
+  case opcode_amo: {
+    if (get_funct3(insn) != funct3_amo_w)
+      return render_illegal_insn();
+    switch (get_funct7(insn) >> 2) {
+    case funct5_lr: {
+      if (get_rs2(insn) != 0)
+        return render_illegal_insn();
+      return render_amo(insn, "lr.w");
+    }
+    case funct5_sc: {
+      return render_amo(insn, "sc.w");
+    }
+    case funct5_amoswap: {
+      return render_amo(insn, "amoswap.w");
+    }
+    case funct5_amoadd: {
+      return render_amo(insn, "amoadd.w");
+    }
+    case funct5_amoxor: {
+      return render_amo(insn, "amoxor.w");
+    }
+    case funct5_amoand: {
+      return render_amo(insn, "amoand.w");
+    }
+    case funct5_amoor: {
+      return render_amo(insn, "amoor.w");
+    }
+    case funct5_amomin: {
+      return render_amo(insn, "amomin.w");
+    }
+    case funct5_amomax: {
+      return render_amo(insn, "amomax.w");
+    }
+    case funct5_amominu: {
+      return render_amo(insn, "amominu.w");
+    }
+    case funct5_amomaxu: {
+      return render_amo(insn, "amomaxu.w");
+    }
+    default: {
+      return render_illegal_insn();
+    }
+    }
+  }
+
+  case opcode_fence: {
+    switch (get_funct3(insn)) {
+    case funct3_fence:
+    case funct3_fence_i: {
+      return render_fence(insn);
+    }
+    default: {
+      return render_illegal_insn();
+    }
+    }
+  }
+
   case opcode_rtype: {
+    if (get_funct7(insn) == funct7_muldiv) {
+      static const char *const muldiv[] = {"mul", "mulh", "mulhsu", "mulhu",
+                                           "div", "divu", "rem",  "remu"};
+      return render_rtype(insn, muldiv[get_funct3(insn)]);
+    }
     switch (get_funct3(insn)) {
     case funct3_add: {
       uint32_t f7 = get_funct7(insn);
@@ -88,7 +150,7 @@ string rv32i_decode::decode(uint32_t addr, uint32_t insn) {
       else if (f7 == funct7_sub)
         return render_rtype(insn, "sub");
       else
-        assert(0 && "unrecognized funct7");
+        return render_illegal_insn();
     }
     case funct3_and: {
       return render_rtype(insn, "and");
@@ -115,7 +177,7 @@ string rv32i_decode::decode(uint32_t addr, uint32_t insn) {
       else if (f7 == funct7_srl)
         return render_rtype(insn, "srl");
       else
-        assert(0 && "unrecognized funct7");
+        return render_illegal_insn();
     }
     case funct3_xor: {
       return render_rtype(insn, "xor");
@@ -242,6 +304,287 @@ string rv32i_decode::decode(uint32_t addr, uint32_t insn) {
   assert(0 && "you fucked up. oopsies!");
 }
 
+/**
+ * @brief Decodes a 16-bit RV32C instruction.
+ *
+ * The operands are taken from the 32-bit expansion and shown the way the
+ * compressed form is written, e.g. "c.addi x8,-1" or "c.jr x1", leaving
+ * out the registers the compressed encoding implies.
+ *
+ * @param addr The memory address of the instruction.
+ * @param insn The 16-bit instruction to decode.
+ * @return A string representation of the disassembled instruction.
+ ********************************************************************************/
+string rv32i_decode::decode_compressed(uint32_t addr, uint16_t insn) {
+  const char *name = nullptr;
+  uint32_t w = expand_compressed(insn, &name);
+  if (name == nullptr)
+    return render_illegal_insn();
+
+  string m = name;
+  if (m == "c.nop" || m == "c.ebreak")
+    return m;
+
+  uint32_t rd = get_rd(w);
+  ostringstream os;
+  os << render_mnemonic(m);
+  switch (get_opcode(w)) {
+  case opcode_load_imm:
+    return render_itype_load(w, name);
+  case opcode_stype:
+    return render_stype(w, name);
+  case opcode_alu_imm:
+    if (m == "c.addi4spn")
+      os << render_reg(rd) << "," << render_reg(get_rs1(w)) << ",";
+    else
+      os << render_reg(rd) << ",";
+    if (get_funct3(w) == funct3_sll || get_funct3(w) == funct3_srx)
+      os << (get_imm_i(w) & 0x1f);
+    else
+      os << get_imm_i(w);
+    break;
+  case opcode_lui:
+    os << render_reg(rd) << "," << to_hex0x20(get_imm_u(w));
+    break;
+  case opcode_rtype:
+    os << render_reg(rd) << "," << render_reg(get_rs2(w));
+    break;
+  case opcode_btype:
+    os << render_reg(get_rs1(w)) << "," << to_hex0x32(addr + get_imm_b(w));
+    break;
+  case opcode_jal:
+    os << to_hex0x32(addr + get_imm_j(w));
+    break;
+  case opcode_jalr:
+    os << render_reg(get_rs1(w));
+    break;
+  }
+  return os.str();
+}
+
+/**
+ * @brief Extracts bits hi..lo of v, shifted down to bit 0.
+ ********************************************************************************/
+static uint32_t bits(uint32_t v, int hi, int lo) {
+  return (v >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+/**
+ * @brief Sign-extends the low n bits of v.
+ ********************************************************************************/
+static int32_t sx(uint32_t v, int n) {
+  return int32_t(v << (32 - n)) >> (32 - n);
+}
+
+/**
+ * @brief Builds 32-bit instruction words from their fields.
+ ********************************************************************************/
+static uint32_t enc_r(uint32_t f7, uint32_t rs2, uint32_t rs1, uint32_t f3,
+                      uint32_t rd, uint32_t op) {
+  return f7 << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+
+static uint32_t enc_i(int32_t imm, uint32_t rs1, uint32_t f3, uint32_t rd,
+                      uint32_t op) {
+  return (uint32_t(imm) & 0xfff) << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+
+static uint32_t enc_s(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t f3,
+                      uint32_t op) {
+  return bits(imm, 11, 5) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 |
+         bits(imm, 4, 0) << 7 | op;
+}
+
+static uint32_t enc_b(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t f3,
+                      uint32_t op) {
+  return bits(imm, 12, 12) << 31 | bits(imm, 10, 5) << 25 | rs2 << 20 |
+         rs1 << 15 | f3 << 12 | bits(imm, 4, 1) << 8 | bits(imm, 11, 11) << 7 |
+         op;
+}
+
+static uint32_t enc_u(int32_t imm, uint32_t rd, uint32_t op) {
+  return (uint32_t(imm) & 0xfffff000) | rd << 7 | op;
+}
+
+static uint32_t enc_j(int32_t imm, uint32_t rd, uint32_t op) {
+  return bits(imm, 20, 20) << 31 | bits(imm, 10, 1) << 21 |
+         bits(imm, 11, 11) << 20 | bits(imm, 19, 12) << 12 | rd << 7 | op;
+}
+
+/**
+ * @brief Expands a 16-bit RV32C instruction to its 32-bit equivalent.
+ *
+ * Covers every RV32C instruction except the floating point loads and
+ * stores. HINT encodings (e.g. c.li x0,imm) expand to the harmless
+ * instruction they name; reserved ones come back as 0.
+ *
+ * @param insn The 16-bit instruction.
+ * @param mnemonic If not null, set to the compressed mnemonic, or to
+ * nullptr for an illegal instruction.
+ * @return The 32-bit instruction, or 0.
+ ********************************************************************************/
+uint32_t rv32i_decode::expand_compressed(uint16_t insn, const char **mnemonic) {
+  uint32_t c = insn;
+  uint32_t rd = bits(c, 11, 7);         // also rs1 in the CR/CI formats
+  uint32_t rs2 = bits(c, 6, 2);
+  uint32_t rs1p = bits(c, 9, 7) + 8;    // x8-x15 in the three-bit fields
+  uint32_t rs2p = bits(c, 4, 2) + 8;
+  int32_t imm6 = sx(bits(c, 12, 12) << 5 | bits(c, 6, 2), 6);
+  int32_t off_j = sx(bits(c, 12, 12) << 11 | bits(c, 11, 11) << 4 |
+                     bits(c, 10, 9) << 8 | bits(c, 8, 8) << 10 |
+                     bits(c, 7, 7) << 6 | bits(c, 6, 6) << 7 |
+                     bits(c, 5, 3) << 1 | bits(c, 2, 2) << 5, 12);
+  int32_t off_b = sx(bits(c, 12, 12) << 8 | bits(c, 11, 10) << 3 |
+                     bits(c, 6, 5) << 6 | bits(c, 4, 3) << 1 |
+                     bits(c, 2, 2) << 5, 9);
+
+  const char *m = nullptr;
+  uint32_t w = 0;
+  // quadrant (bits 1-0) and funct3 (bits 15-13)
+  switch (bits(c, 1, 0) << 3 | bits(c, 15, 13)) {
+  case 0b00000: {
+    uint32_t imm = bits(c, 12, 11) << 4 | bits(c, 10, 7) << 6 |
+                   bits(c, 6, 6) << 2 | bits(c, 5, 5) << 3;
+    if (imm != 0) {
+      m = "c.addi4spn";
+      w = enc_i(imm, 2, funct3_add, rs2p, opcode_alu_imm);
+    }
+    break;
+  }
+  case 0b00010: {
+    uint32_t imm =
+        bits(c, 12, 10) << 3 | bits(c, 6, 6) << 2 | bits(c, 5, 5) << 6;
+    m = "c.lw";
+    w = enc_i(imm, rs1p, funct3_lw, rs2p, opcode_load_imm);
+    break;
+  }
+  case 0b00110: {
+    uint32_t imm =
+        bits(c, 12, 10) << 3 | bits(c, 6, 6) << 2 | bits(c, 5, 5) << 6;
+    m = "c.sw";
+    w = enc_s(imm, rs2p, rs1p, funct3_sw, opcode_stype);
+    break;
+  }
+
+  case 0b01000:
+    m = rd == 0 ? "c.nop" : "c.addi";
+    w = enc_i(rd == 0 ? 0 : imm6, rd, funct3_add, rd, opcode_alu_imm);
+    break;
+  case 0b01001:
+    m = "c.jal";
+    w = enc_j(off_j, 1, opcode_jal);
+    break;
+  case 0b01010:
+    m = "c.li";
+    w = enc_i(imm6, 0, funct3_add, rd, opcode_alu_imm);
+    break;
+  case 0b01011:
+    if (rd == 2) {
+      int32_t imm = sx(bits(c, 12, 12) << 9 | bits(c, 6, 6) << 4 |
+                       bits(c, 5, 5) << 6 | bits(c, 4, 3) << 7 |
+                       bits(c, 2, 2) << 5, 10);
+      if (imm != 0) {
+        m = "c.addi16sp";
+        w = enc_i(imm, 2, funct3_add, 2, opcode_alu_imm);
+      }
+    } else if (imm6 != 0) {
+      m = "c.lui";
+      w = enc_u(imm6 << 12, rd, opcode_lui);
+    }
+    break;
+  case 0b01100:
+    switch (bits(c, 11, 10)) {
+    case 0b00:
+      if (bits(c, 12, 12) == 0) {
+        m = "c.srli";
+        w = enc_i(rs2, rs1p, funct3_srx, rs1p, opcode_alu_imm);
+      }
+      break;
+    case 0b01:
+      if (bits(c, 12, 12) == 0) {
+        m = "c.srai";
+        w = enc_i(funct7_sra << 5 | rs2, rs1p, funct3_srx, rs1p,
+                  opcode_alu_imm);
+      }
+      break;
+    case 0b10:
+      m = "c.andi";
+      w = enc_i(imm6, rs1p, funct3_and, rs1p, opcode_alu_imm);
+      break;
+    case 0b11: {
+      static const char *const names[] = {"c.sub", "c.xor", "c.or", "c.and"};
+      static const uint32_t f3[] = {funct3_add, funct3_xor, funct3_or,
+                                    funct3_and};
+      if (bits(c, 12, 12) == 0) {
+        uint32_t i = bits(c, 6, 5);
+        m = names[i];
+        w = enc_r(i == 0 ? funct7_sub : 0, rs2p, rs1p, f3[i], rs1p,
+                  opcode_rtype);
+      }
+      break;
+    }
+    }
+    break;
+  case 0b01101:
+    m = "c.j";
+    w = enc_j(off_j, 0, opcode_jal);
+    break;
+  case 0b01110:
+    m = "c.beqz";
+    w = enc_b(off_b, 0, rs1p, funct3_beq, opcode_btype);
+    break;
+  case 0b01111:
+    m = "c.bnez";
+    w = enc_b(off_b, 0, rs1p, funct3_bne, opcode_btype);
+    break;
+
+  case 0b10000:
+    if (bits(c, 12, 12) == 0) {
+      m = "c.slli";
+      w = enc_i(rs2, rd, funct3_sll, rd, opcode_alu_imm);
+    }
+    break;
+  case 0b10010:
+    if (rd != 0) {
+      uint32_t imm =
+          bits(c, 12, 12) << 5 | bits(c, 6, 4) << 2 | bits(c, 3, 2) << 6;
+      m = "c.lwsp";
+      w = enc_i(imm, 2, funct3_lw, rd, opcode_load_imm);
+    }
+    break;
+  case 0b10100:
+    if (bits(c, 12, 12) == 0) {
+      if (rs2 != 0) {
+        m = "c.mv";
+        w = enc_r(funct7_add, rs2, 0, funct3_add, rd, opcode_rtype);
+      } else if (rd != 0) {
+        m = "c.jr";
+        w = enc_i(0, rd, 0, 0, opcode_jalr);
+      }
+    } else if (rs2 != 0) {
+      m = "c.add";
+      w = enc_r(funct7_add, rs2, rd, funct3_add, rd, opcode_rtype);
+    } else if (rd != 0) {
+      m = "c.jalr";
+      w = enc_i(0, rd, 0, 1, opcode_jalr);
+    } else {
+      m = "c.ebreak";
+      w = insn_ebreak;
+    }
+    break;
+  case 0b10110: {
+    uint32_t imm = bits(c, 12, 9) << 2 | bits(c, 8, 7) << 6;
+    m = "c.swsp";
+    w = enc_s(imm, rs2, 2, funct3_sw, opcode_stype);
+    break;
+  }
+  }
+
+  if (mnemonic != nullptr)
+    *mnemonic = m;
+  return w;
+}
+
 /**
  * @brief Returns an error string for illegal instructions.
  * @return String "ERROR: UNIMPLEMENTED INSTRUCTION".
@@ -453,6 +796,66 @@ string rv32i_decode::render_csrrxi(uint32_t insn, const char *m) {
   return os.str();
 }
 
+/**
+ * @brief Decodes an RV32A instruction.
+ *
+ * LR.W has no rs2 operand. The address register is shown in parentheses,
+ * as the assembler expects it.
+ *
+ * @param insn The instruction to decode.
+ * @param m The mnemonic string, without the ordering suffixes.
+ * @return The formatted assembly string.
+ ********************************************************************************/
+string rv32i_decode::render_amo(uint32_t insn, const char *m) {
+  ostringstream os;
+  uint32_t rd = get_rd(insn);
+  uint32_t r1 = get_rs1(insn);
+  uint32_t r2 = get_rs2(insn);
+  bool aq = insn & (1u << 26);
+  bool rl = insn & (1u << 25);
+
+  string mn = m;
+  if (aq || rl)
+    mn += string(".") + (aq ? "aq" : "") + (rl ? "rl" : "");
+
+  os << render_mnemonic(mn) << render_reg(rd) << ",";
+  if (get_funct7(insn) >> 2 != funct5_lr)
+    os << render_reg(r2) << ",";
+  os << "(" << render_reg(r1) << ")";
+  return os.str();
+}
+
+/**
+ * @brief Decodes a FENCE, FENCE.TSO or FENCE.I instruction.
+ *
+ * The predecessor and successor sets are shown as the letters of the
+ * access types they order: i(nput), o(utput), r(ead) and w(rite).
+ *
+ * @param insn The instruction to decode.
+ * @return The formatted assembly string.
+ ********************************************************************************/
+string rv32i_decode::render_fence(uint32_t insn) {
+  if (get_funct3(insn) == funct3_fence_i)
+    return render_mnemonic("fence.i");
+
+  auto set = [](uint32_t bits) {
+    string s;
+    const char *names = "iorw";
+    for (int i = 0; i < 4; ++i)
+      if (bits & (8 >> i))
+        s += names[i];
+    return s.empty() ? string("0") : s;
+  };
+  uint32_t fm = insn >> 28;
+  uint32_t pred = (insn >> 24) & 0xf;
+  uint32_t succ = (insn >> 20) & 0xf;
+
+  ostringstream os;
+  os << render_mnemonic(fm == 0b1000 ? "fence.tso" : "fence") << set(pred)
+     << "," << set(succ);
+  return os.str();
+}
+
 /**
  * @brief Extracts the opcode (bits 0-6).
  * @param insn The instruction.
@@ -619,8 +1022,9 @@ string rv32i_decode::render_base_disp(uint32_t base, int32_t disp) {
  ********************************************************************************/
 string rv32i_decode::render_mnemonic(const string &m) {
   ostringstream os;
-  if (m != "ecall" && m != "ebreak")
-    os << std::setw(mnemonic_width) << std::left << m;
+  // long mnemonics like amomaxu.w still get one space before the operands
+  if (m != "ecall" && m != "ebreak" && m != "fence.i")
+    os << std::setw(mnemonic_width - 1) << std::left << m << ' ';
   else
     os << std::left << m;
 
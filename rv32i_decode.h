@@ -29,6 +29,34 @@ public:
      ****************************************************************************/
     static std::string decode(uint32_t addr, uint32_t insn);
 
+    /**
+     * @brief Decodes a 16-bit RV32C instruction.
+     *
+     * Shows the compressed mnemonic and operands, e.g. "c.addi x8,-1".
+     *
+     * @param addr The memory address where the instruction is located.
+     * @param insn The 16-bit instruction to decode.
+     * @return A std::string containing the disassembled instruction.
+     ****************************************************************************/
+    static std::string decode_compressed(uint32_t addr, uint16_t insn);
+
+    /**
+     * @brief Checks if the low half of an instruction is a 16-bit one.
+     * @param insn The instruction, or just its first 16 bits.
+     * @return true if the low two bits are not 11.
+     ****************************************************************************/
+    static bool is_compressed(uint32_t insn) { return (insn & 3) != 3; }
+
+    /**
+     * @brief Expands a 16-bit RV32C instruction to its 32-bit equivalent.
+     * @param insn The 16-bit instruction.
+     * @param mnemonic If not null, set to the compressed mnemonic.
+     * @return The 32-bit instruction, or 0 (an illegal instruction) for a
+     * reserved encoding or one from an extension that is not supported.
+     ****************************************************************************/
+    static uint32_t expand_compressed(uint16_t insn,
+                                      const char **mnemonic = nullptr);
+
 protected:
     static constexpr int mnemonic_width             = 8;
 
@@ -42,6 +70,8 @@ protected:
     static constexpr uint32_t opcode_alu_imm        = 0b0010011; //0x13
     static constexpr uint32_t opcode_rtype          = 0b0110011; //0x33
     static constexpr uint32_t opcode_system         = 0b1110011; //0x73
+    static constexpr uint32_t opcode_amo            = 0b0101111; //0x2f
+    static constexpr uint32_t opcode_fence          = 0b0001111; //0x0f
 
     static constexpr uint32_t funct3_beq            = 0b000;
     static constexpr uint32_t funct3_bne            = 0b001;
@@ -75,6 +105,18 @@ protected:
     static constexpr uint32_t funct7_add            = 0b0000000;
     static constexpr uint32_t funct7_sub            = 0b0100000;
 
+    // funct7 of the RV32M multiply/divide group, which reuses the R-type funct3s
+    static constexpr uint32_t funct7_muldiv         = 0b0000001;
+
+    static constexpr uint32_t funct3_mul            = 0b000;
+    static constexpr uint32_t funct3_mulh           = 0b001;
+    static constexpr uint32_t funct3_mulhsu         = 0b010;
+    static constexpr uint32_t funct3_mulhu          = 0b011;
+    static constexpr uint32_t funct3_div            = 0b100;
+    static constexpr uint32_t funct3_divu           = 0b101;
+    static constexpr uint32_t funct3_rem            = 0b110;
+    static constexpr uint32_t funct3_remu           = 0b111;
+
     static constexpr uint32_t insn_ecall            = 0x00000073;
     static constexpr uint32_t insn_ebreak           = 0x00100073;
 
@@ -85,6 +127,24 @@ protected:
     static constexpr uint32_t funct3_csrrsi         = 0b110;
     static constexpr uint32_t funct3_csrrci         = 0b111;
 
+    static constexpr uint32_t funct3_fence          = 0b000;
+    static constexpr uint32_t funct3_fence_i        = 0b001;
+
+    static constexpr uint32_t funct3_amo_w          = 0b010;
+
+    // funct5, the top five bits of funct7, picks the atomic operation
+    static constexpr uint32_t funct5_lr             = 0b00010;
+    static constexpr uint32_t funct5_sc             = 0b00011;
+    static constexpr uint32_t funct5_amoswap        = 0b00001;
+    static constexpr uint32_t funct5_amoadd         = 0b00000;
+    static constexpr uint32_t funct5_amoxor         = 0b00100;
+    static constexpr uint32_t funct5_amoand         = 0b01100;
+    static constexpr uint32_t funct5_amoor          = 0b01000;
+    static constexpr uint32_t funct5_amomin         = 0b10000;
+    static constexpr uint32_t funct5_amomax         = 0b10100;
+    static constexpr uint32_t funct5_amominu        = 0b11000;
+    static constexpr uint32_t funct5_amomaxu        = 0b11100;
+
     /**
      * @brief Extracts the opcode field (bits 0-6).
      * @param insn The instruction.
@@ -269,6 +329,24 @@ protected:
      ****************************************************************************/
     static std::string render_csrrxi(uint32_t insn, const char *mnemonic);
 
+    /**
+     * @brief Renders an RV32A instruction (LR.W, SC.W and the AMOs).
+     *
+     * The aq and rl bits are shown as .aq, .rl or .aqrl suffixes.
+     *
+     * @param insn The instruction.
+     * @param mnemonic The instruction mnemonic, without the suffixes.
+     * @return The formatted string.
+     ****************************************************************************/
+    static std::string render_amo(uint32_t insn, const char *mnemonic);
+
+    /**
+     * @brief Renders FENCE, FENCE.TSO or FENCE.I.
+     * @param insn The instruction.
+     * @return The formatted string.
+     ****************************************************************************/
+    static std::string render_fence(uint32_t insn);
+
     /**
      * @brief Helper to format a register name (e.g., "x1").
      * @param r The register index.
@@ -8,289 +8,242 @@
 #include "rv32i_hart.h"
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 
 /**
- * @brief Decodes and executes a single instruction.
+ * @brief The decode table.
  *
- * @param insn The 32-bit instruction to execute.
- * @param pos Pointer to an ostream for logging instruction execution details.
- * If nullptr, no logging is performed.
+ * Exact encodings come before the looser ones that share their opcode and
+ * funct3, e.g. add and sub before nothing else matches funct7 0b0000000, and
+ * the RV32M group before the R-type rules that ignore funct7.
+ * Any word not matched here is an illegal instruction.
  ********************************************************************************/
-void rv32i_hart::exec(uint32_t insn, std::ostream *pos) {
-  switch (get_opcode(insn)) {
-  case opcode_lui: {
-    exec_lui(insn, pos);
-    return;
-  }
+const rv32i_hart::decode_rule rv32i_hart::decode_rules[] = {
+    {0x0000007f, opcode_lui, op_lui, fmt_u},
+    {0x0000007f, opcode_auipc, op_auipc, fmt_u},
+    {0x0000007f, opcode_jal, op_jal, fmt_j},
+    {0x0000007f, opcode_jalr, op_jalr, fmt_i},
 
-  case opcode_auipc: {
-    exec_auipc(insn, pos);
-    return;
-  }
+    {0xffffffff, insn_ecall, op_ecall, fmt_none},
+    {0xffffffff, insn_ebreak, op_ebreak, fmt_none},
+    {0x0000707f, funct3_csrrw << 12 | opcode_system, op_csrrw, fmt_csr},
+    {0x0000707f, funct3_csrrs << 12 | opcode_system, op_csrrs, fmt_csr},
+    {0x0000707f, funct3_csrrc << 12 | opcode_system, op_csrrc, fmt_csr},
+    {0x0000707f, funct3_csrrwi << 12 | opcode_system, op_csrrwi, fmt_csr},
+    {0x0000707f, funct3_csrrsi << 12 | opcode_system, op_csrrsi, fmt_csr},
+    {0x0000707f, funct3_csrrci << 12 | opcode_system, op_csrrci, fmt_csr},
 
-  case opcode_jal: {
-    exec_jal(insn, pos);
-    return;
-  }
+    {0xfe00707f, funct7_muldiv << 25 | funct3_mul << 12 | opcode_rtype,
+     op_mul, fmt_none},
+    {0xfe00707f, funct7_muldiv << 25 | funct3_mulh << 12 | opcode_rtype,
+     op_mulh, fmt_none},
+    {0xfe00707f, funct7_muldiv << 25 | funct3_mulhsu << 12 | opcode_rtype,
+     op_mulhsu, fmt_none},
+    {0xfe00707f, funct7_muldiv << 25 | funct3_mulhu << 12 | opcode_rtype,
+     op_mulhu, fmt_none},
+    {0xfe00707f, funct7_muldiv << 25 | funct3_div << 12 | opcode_rtype,
+     op_div, fmt_none},
+    {0xfe00707f, funct7_muldiv << 25 | funct3_divu << 12 | opcode_rtype,
+     op_divu, fmt_none},
+    {0xfe00707f, funct7_muldiv << 25 | funct3_rem << 12 | opcode_rtype,
+     op_rem, fmt_none},
+    {0xfe00707f, funct7_muldiv << 25 | funct3_remu << 12 | opcode_rtype,
+     op_remu, fmt_none},
 
-  case opcode_jalr: {
-    exec_jalr(insn, pos);
-    return;
-  }
+    {0xfe00707f, funct7_add << 25 | funct3_add << 12 | opcode_rtype,
+     op_add, fmt_none},
+    {0xfe00707f, funct7_sub << 25 | funct3_add << 12 | opcode_rtype,
+     op_sub, fmt_none},
+    {0xfe00707f, funct7_srl << 25 | funct3_srx << 12 | opcode_rtype,
+     op_srl, fmt_none},
+    {0xfe00707f, funct7_sra << 25 | funct3_srx << 12 | opcode_rtype,
+     op_sra, fmt_none},
+    {0x0000707f, funct3_and << 12 | opcode_rtype, op_and, fmt_none},
+    {0x0000707f, funct3_or << 12 | opcode_rtype, op_or, fmt_none},
+    {0x0000707f, funct3_sll << 12 | opcode_rtype, op_sll, fmt_none},
+    {0x0000707f, funct3_slt << 12 | opcode_rtype, op_slt, fmt_none},
+    {0x0000707f, funct3_sltu << 12 | opcode_rtype, op_sltu, fmt_none},
+    {0x0000707f, funct3_xor << 12 | opcode_rtype, op_xor, fmt_none},
 
-  case opcode_system: {
-    if (insn == insn_ecall) {
-      exec_ecall(pos);
-      return;
-    }
+    {0x0000707f, funct3_add << 12 | opcode_alu_imm, op_addi, fmt_i},
+    {0x0000707f, funct3_and << 12 | opcode_alu_imm, op_andi, fmt_i},
+    {0x0000707f, funct3_or << 12 | opcode_alu_imm, op_ori, fmt_i},
+    {0x0000707f, funct3_sll << 12 | opcode_alu_imm, op_slli, fmt_shamt},
+    {0x0000707f, funct3_slt << 12 | opcode_alu_imm, op_slti, fmt_i},
+    {0x0000707f, funct3_sltu << 12 | opcode_alu_imm, op_sltiu, fmt_i},
+    {0x4000707f, funct7_sra << 25 | funct3_srx << 12 | opcode_alu_imm,
+     op_srai, fmt_shamt},
+    {0x4000707f, funct7_srl << 25 | funct3_srx << 12 | opcode_alu_imm,
+     op_srli, fmt_shamt},
+    {0x0000707f, funct3_xor << 12 | opcode_alu_imm, op_xori, fmt_i},
 
-    else if (insn == insn_ebreak) {
-      exec_ebreak(pos);
-      return;
-    }
+    {0x0000707f, funct3_lb << 12 | opcode_load_imm, op_lb, fmt_i},
+    {0x0000707f, funct3_lh << 12 | opcode_load_imm, op_lh, fmt_i},
+    {0x0000707f, funct3_lw << 12 | opcode_load_imm, op_lw, fmt_i},
+    {0x0000707f, funct3_lbu << 12 | opcode_load_imm, op_lbu, fmt_i},
+    {0x0000707f, funct3_lhu << 12 | opcode_load_imm, op_lhu, fmt_i},
 
-    else
-      switch (get_funct3(insn)) {
-      case funct3_csrrw: {
-        exec_csrrw(insn, pos);
-        return;
-      }
-      case funct3_csrrs: {
-        exec_csrrs(insn, pos);
-        return;
-      }
-      case funct3_csrrc: {
-        exec_csrrc(insn, pos);
-        return;
-      }
-      case funct3_csrrwi: {
-        exec_csrrwi(insn, pos);
-        return;
-      }
-      case funct3_csrrsi: {
-        exec_csrrsi(insn, pos);
-        return;
-      }
-      case funct3_csrrci: {
-        exec_csrrci(insn, pos);
-        return;
-      }
-      default: {
-        exec_illegal_insn(pos);
-        return;
-      }
-        assert(0 && "unrecognized funct3 system");
-      }
-    assert(0 && "system fucked");
-  }
-
-  case opcode_rtype: {
-    switch (get_funct3(insn)) {
-    case funct3_add: {
-      uint32_t f7 = get_funct7(insn);
-      if (f7 == funct7_add) {
-        exec_add(insn, pos);
-        return;
-      } else if (f7 == funct7_sub) {
-        exec_sub(insn, pos);
-        return;
-      } else
-        assert(0 && "unrecognized funct7");
-    }
-    case funct3_and: {
-      exec_and(insn, pos);
-      return;
-    }
+    {0x0000707f, funct3_beq << 12 | opcode_btype, op_beq, fmt_b},
+    {0x0000707f, funct3_bne << 12 | opcode_btype, op_bne, fmt_b},
+    {0x0000707f, funct3_blt << 12 | opcode_btype, op_blt, fmt_b},
+    {0x0000707f, funct3_bge << 12 | opcode_btype, op_bge, fmt_b},
+    {0x0000707f, funct3_bltu << 12 | opcode_btype, op_bltu, fmt_b},
+    {0x0000707f, funct3_bgeu << 12 | opcode_btype, op_bgeu, fmt_b},
 
-    case funct3_or: {
-      exec_or(insn, pos);
-      return;
-    }
+    {0x0000707f, funct3_sb << 12 | opcode_stype, op_sb, fmt_s},
+    {0x0000707f, funct3_sh << 12 | opcode_stype, op_sh, fmt_s},
+    {0x0000707f, funct3_sw << 12 | opcode_stype, op_sw, fmt_s},
 
-    case funct3_sll: {
-      exec_sll(insn, pos);
-      return;
-    }
-    case funct3_slt: {
-      exec_slt(insn, pos);
-      return;
-    }
-    case funct3_sltu: {
-      exec_sltu(insn, pos);
-      return;
-    }
+    {0x0000707f, funct3_fence << 12 | opcode_fence, op_fence, fmt_none},
+    {0x0000707f, funct3_fence_i << 12 | opcode_fence, op_fence_i, fmt_none},
 
-    case funct3_srx: {
-      uint32_t f7 = get_funct7(insn);
-      if (f7 == funct7_sra) {
-        exec_sra(insn, pos);
-        return;
-      } else if (f7 == funct7_srl) {
-        exec_srl(insn, pos);
-        return;
-      } else {
-        exec_illegal_insn(pos);
-        return;
-      }
-      assert(0 && "unrecognized funct7");
-    }
-    case funct3_xor: {
-      exec_xor(insn, pos);
-      return;
-    }
-    default: {
-      exec_illegal_insn(pos);
-      return;
-    }
-      assert(0 && "unrecognized funct3 srx");
-    }
-  }
-  case opcode_alu_imm: {
-    switch (get_funct3(insn)) {
-    case funct3_add: {
-      exec_addi(insn, pos);
-      return;
-    }
-    case funct3_and: {
-      exec_andi(insn, pos);
-      return;
-    }
-    case funct3_or: {
-      exec_ori(insn, pos);
-      return;
-    }
-    case funct3_sll: {
-      exec_slli(insn, pos);
-      return;
-    }
-    case funct3_slt: {
-      exec_slti(insn, pos);
-      return;
-    }
-    case funct3_sltu: {
-      exec_sltiu(insn, pos);
-      return;
-    }
+    {0xf9f0707f, funct5_lr << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_lr_w, fmt_none},
+    {0xf800707f, funct5_sc << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_sc_w, fmt_none},
+    {0xf800707f, funct5_amoswap << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_amoswap_w, fmt_none},
+    {0xf800707f, funct5_amoadd << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_amoadd_w, fmt_none},
+    {0xf800707f, funct5_amoxor << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_amoxor_w, fmt_none},
+    {0xf800707f, funct5_amoand << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_amoand_w, fmt_none},
+    {0xf800707f, funct5_amoor << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_amoor_w, fmt_none},
+    {0xf800707f, funct5_amomin << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_amomin_w, fmt_none},
+    {0xf800707f, funct5_amomax << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_amomax_w, fmt_none},
+    {0xf800707f, funct5_amominu << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_amominu_w, fmt_none},
+    {0xf800707f, funct5_amomaxu << 27 | funct3_amo_w << 12 | opcode_amo,
+     op_amomaxu_w, fmt_none},
 
-    case funct3_srx: {
-      uint32_t f7 = (get_funct7(insn) & funct7_sra);
-      if (f7 == funct7_sra) {
-        exec_srai(insn, pos);
-        return;
-      } else if (f7 == funct7_srl) {
-        exec_srli(insn, pos);
-        return;
-      } else {
-        exec_illegal_insn(pos);
-        return;
-      }
-      assert(0 && "unrecognized funct7 alu_srx");
-    }
-    case funct3_xor: {
-      exec_xori(insn, pos);
-      return;
-    }
-    default: {
-      exec_illegal_insn(pos);
-      return;
-    }
-      assert(0 && "unrecognized funct3 alu_srx");
+    {0, 0, op_illegal_insn, fmt_none},
+};
+
+#define STEP_HANDLER(NAME) &rv32i_hart::exec_##NAME<false, false>,
+#define CHAIN_HANDLER(NAME) &rv32i_hart::exec_##NAME<true, false>,
+#define TRACE_HANDLER(NAME) &rv32i_hart::exec_##NAME<false, true>,
+
+/**
+ * @brief Handlers for running one record at a time, indexed by insn_op.
+ ********************************************************************************/
+const rv32i_hart::handler rv32i_hart::step_handlers[op_count] = {
+    RV32I_OPS(STEP_HANDLER)};
+
+/**
+ * @brief Threaded handlers for records inside a basic block.
+ ********************************************************************************/
+const rv32i_hart::handler rv32i_hart::chain_handlers[op_count] = {
+    RV32I_OPS(CHAIN_HANDLER)};
+
+/**
+ * @brief Handlers that render the instruction as they run it, for -i.
+ ********************************************************************************/
+const rv32i_hart::handler rv32i_hart::trace_handlers[op_count] = {
+    RV32I_OPS(TRACE_HANDLER)};
+
+#undef STEP_HANDLER
+#undef CHAIN_HANDLER
+#undef TRACE_HANDLER
+
+/**
+ * @brief step() instantiations indexed by insns | regs << 1 | binary << 2 |
+ * caches << 3.
+ ********************************************************************************/
+const rv32i_hart::stepper rv32i_hart::steppers[16] = {
+    &rv32i_hart::step<trace_policy<false, false, false, false>>,
+    &rv32i_hart::step<trace_policy<true, false, false, false>>,
+    &rv32i_hart::step<trace_policy<false, true, false, false>>,
+    &rv32i_hart::step<trace_policy<true, true, false, false>>,
+    &rv32i_hart::step<trace_policy<false, false, true, false>>,
+    &rv32i_hart::step<trace_policy<true, false, true, false>>,
+    &rv32i_hart::step<trace_policy<false, true, true, false>>,
+    &rv32i_hart::step<trace_policy<true, true, true, false>>,
+    &rv32i_hart::step<trace_policy<false, false, false, true>>,
+    &rv32i_hart::step<trace_policy<true, false, false, true>>,
+    &rv32i_hart::step<trace_policy<false, true, false, true>>,
+    &rv32i_hart::step<trace_policy<true, true, false, true>>,
+    &rv32i_hart::step<trace_policy<false, false, true, true>>,
+    &rv32i_hart::step<trace_policy<true, false, true, true>>,
+    &rv32i_hart::step<trace_policy<false, true, true, true>>,
+    &rv32i_hart::step<trace_policy<true, true, true, true>>,
+};
+
+/**
+ * @brief Decodes a single instruction into a record for the predecode cache.
+ *
+ * Looks the word up in decode_rules, then pulls out the register numbers
+ * and the sign-extended immediate for the rule's format so executing it
+ * later does not have to look at the instruction word again. The rules
+ * are grouped by opcode the first time through so a lookup only tries
+ * the handful that share the word's opcode.
+ *
+ * @param insn The 32-bit instruction to decode.
+ * @return The decoded instruction, with its single-step handler.
+ ********************************************************************************/
+decoded_insn rv32i_hart::predecode(uint32_t insn) {
+  static const std::vector<const decode_rule *> *by_opcode = [] {
+    static std::vector<const decode_rule *> v[128];
+    for (const decode_rule *r = decode_rules; r->mask != 0; ++r)
+      v[r->match & 0x7f].push_back(r);
+    return v;
+  }();
+
+  const decode_rule *rule = nullptr;
+  for (const decode_rule *r : by_opcode[get_opcode(insn)]) {
+    if ((insn & r->mask) == r->match) {
+      rule = r;
+      break;
     }
-    assert(0 && "alu_imm fucked");
   }
 
-  case opcode_load_imm: {
-    switch (get_funct3(insn)) {
-    case funct3_lb: {
-      exec_lb(insn, pos);
-      return;
-    }
-    case funct3_lh: {
-      exec_lh(insn, pos);
-      return;
-    }
-    case funct3_lw: {
-      exec_lw(insn, pos);
-      return;
-    }
-    case funct3_lbu: {
-      exec_lbu(insn, pos);
-      return;
-    }
-    case funct3_lhu: {
-      exec_lhu(insn, pos);
-      return;
-    }
-    default: {
-      exec_illegal_insn(pos);
-      return;
-    }
-      assert(0 && "unrecognized funct3");
-    }
-    assert(0 && "load_imm fucked");
+  decoded_insn d;
+  d.insn = insn;
+  d.rd = get_rd(insn);
+  d.rs1 = get_rs1(insn);
+  d.rs2 = get_rs2(insn);
+  d.op = rule ? rule->op : op_illegal_insn;
+  d.handler = step_handlers[d.op];
+
+  switch (rule ? rule->fmt : fmt_none) {
+  case fmt_i: {
+    d.imm = get_imm_i(insn);
+    break;
   }
-  case opcode_btype: {
-    switch (get_funct3(insn)) {
-    case funct3_beq: {
-      exec_beq(insn, pos);
-      return;
-    }
-    case funct3_bne: {
-      exec_bne(insn, pos);
-      return;
-    }
-    case funct3_blt: {
-      exec_blt(insn, pos);
-      return;
-    }
-    case funct3_bge: {
-      exec_bge(insn, pos);
-      return;
-    }
-    case funct3_bltu: {
-      exec_bltu(insn, pos);
-      return;
-    }
-    case funct3_bgeu: {
-      exec_bgeu(insn, pos);
-      return;
-    }
-    default:
-      exec_illegal_insn(pos);
-      return;
-      assert(0 && "unrecognized funct3");
-    }
-    assert(0 && "btype fucked");
+  case fmt_s: {
+    d.imm = get_imm_s(insn);
+    break;
   }
-  case opcode_stype: {
-    switch (get_funct3(insn)) {
-    case funct3_sb: {
-      exec_sb(insn, pos);
-      return;
-    }
-    case funct3_sh: {
-      exec_sh(insn, pos);
-      return;
-    }
-    case funct3_sw: {
-      exec_sw(insn, pos);
-      return;
-    }
-    default:
-      exec_illegal_insn(pos);
-      return;
-      assert(0 && "unrecognized funct3 stype");
-    }
-    assert(0 && "stype fucked");
+  case fmt_b: {
+    d.imm = get_imm_b(insn);
+    break;
   }
-  default: {
-    exec_illegal_insn(pos);
-    return;
+  case fmt_u: {
+    d.imm = get_imm_u(insn) << 12;
+    break;
   }
+  case fmt_j: {
+    d.imm = get_imm_j(insn);
+    break;
   }
-  assert(0 && "you fucked up. oopsies!");
+  case fmt_shamt: {
+    d.imm = get_imm_i(insn) & 0x1f;
+    break;
+  }
+  case fmt_csr: {
+    d.imm = get_imm_i(insn) & 0xfff;
+    break;
+  }
+  case fmt_none:
+    break;
+  }
+  return d;
 }
 
 /**
@@ -299,45 +252,533 @@ void rv32i_hart::exec(uint32_t insn, std::ostream *pos) {
  * Sets the halt flag and records the reason for halting.
  * @param pos Pointer to ostream for logging error message.
  ********************************************************************************/
-void rv32i_hart::exec_illegal_insn(std::ostream *pos) {
-  if (pos)
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_illegal_insn(const decoded_insn &, std::ostream *pos) {
+  if (TRACE)
     *pos << render_illegal_insn();
   halt = true;
   halt_reason = "Illegal instruction";
 }
 
+/**
+ * @brief Marks the end of a basic block.
+ *
+ * Every block ends with a record for this handler so the last threaded
+ * handler has something to jump to. It returns to the block dispatcher.
+ ********************************************************************************/
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_block_end(const decoded_insn &, std::ostream *) {}
+
 /**
  * @brief Performs one simulation tick (instruction fetch, decode, execute).
  *
  * Checks for halt conditions and PC alignment before fetching.
- * Updates instruction counter and PC.
+ * The instruction is taken from the predecode cache when possible and only
+ * fetched and decoded on a miss. Updates instruction counter and PC.
+ * Traced instructions at the start of a known symbol get a label line.
+ *
+ * Everything POLICY turns off is compiled out, so the silent instantiation
+ * has no trace tests in it.
+ *
  * @param hdr String prefix for output logging (e.g., address).
  ********************************************************************************/
-void rv32i_hart::tick(const string &hdr) {
+template <class POLICY> void rv32i_hart::step(const char *hdr) {
   if (halt == true)
     return;
 
-  if (show_regs) {
-    regs.dump();
-    std::cout << "\n pc " << to_hex32(pc) << std::endl;
+  if (POLICY::regs) {
+    regs.dump(hdr);
+    std::cout << '\n' << hdr << " pc " << to_hex32(pc) << std::endl;
   }
 
-  int32_t pc_check = pc % 4;
-  if (pc_check != 0) {
+  if (pc & align_mask) {
     halt = true;
     halt_reason = "PC alignment error";
     return;
   }
 
   ++insn_counter;
-  int32_t insn = mem.get32(pc);
+  if (icache.sync())
+    bcache.mark_stale();
+  const decoded_insn *d = fetch(pc);
 
-  if (show_insns) {
-    std::cout << hdr << to_hex32(pc) << ": " << to_hex32(insn) << "  ";
-    exec(insn, &std::cout);
+  trace_record rec;
+  if (POLICY::binary)
+    begin_trace(*d, rec);
+  else if (POLICY::caches)
+    trace_access(*d, rec);
+  if (POLICY::caches)
+    caches->fetch(pc, d->len);
+
+  if (POLICY::insns) {
+    const symbol *sym = symbols ? symbols->at(pc) : nullptr;
+    if (sym != nullptr)
+      std::cout << hdr << "<" << sym->name << ">:" << std::endl;
+    if (d->len == 2)
+      trace_compressed(*d, hdr);
+    else {
+      std::cout << hdr << to_hex32(pc) << ": " << to_hex32(d->insn) << "  ";
+      (this->*trace_handlers[d->op])(*d, &std::cout);
+    }
     std::cout << std::endl;
   } else
-    exec(insn, nullptr);
+    (this->*d->handler)(*d, nullptr);
+
+  if (POLICY::caches && rec.mem_size != 0 && !halt) {
+    bool store = rec.flags & trace_record::mem_store;
+    caches->data(rec.mem_addr, rec.mem_size,
+                 store && (d->op != op_sc_w || sc_ok));
+  }
+
+  if (POLICY::binary)
+    end_trace(*d, rec);
+}
+
+/**
+ * @brief Runs and prints a compressed instruction for -i.
+ *
+ * The handler renders the expanded instruction, so its text is collected
+ * first and the instruction part replaced with the compressed form; the
+ * comment after it is kept as it is.
+ *
+ * @param d The instruction to run.
+ * @param hdr String prefix for the line.
+ ********************************************************************************/
+void rv32i_hart::trace_compressed(const decoded_insn &d, const char *hdr) {
+  uint32_t addr = pc;
+  uint16_t raw = mem.get16(addr);
+  std::ostringstream os;
+  (this->*trace_handlers[d.op])(d, &os);
+  std::string s = os.str();
+  size_t comment = s.find("//");
+
+  std::cout << hdr << to_hex32(addr) << ": " << to_hex16(raw) << "      "
+            << std::setw(instruction_width) << std::setfill(' ') << std::left
+            << decode_compressed(addr, raw);
+  if (comment != std::string::npos)
+    std::cout << s.substr(comment);
+}
+
+/**
+ * @brief Fills in the parts of a trace record known before d executes.
+ *
+ * The effective address and store value have to be taken now, since the
+ * instruction may overwrite the registers they come from. So does the
+ * value a load or AMO reads: rd may be x0, and an AMO overwrites it.
+ *
+ * @param d The instruction about to execute.
+ * @param r The record to fill in.
+ ********************************************************************************/
+void rv32i_hart::begin_trace(const decoded_insn &d, trace_record &r) const {
+  r.pc = pc;
+  r.insn = d.insn;
+  r.hart = uint8_t(mhartid);
+  if (d.len == 2) {
+    r.insn = mem.get16(pc);
+    r.flags |= trace_record::compressed;
+  }
+  trace_access(d, r);
+  if (r.flags & trace_record::mem_load)
+    r.mem_value = loaded_value(d, r.mem_addr, r.mem_size);
+}
+
+/**
+ * @brief Reads the value a load or AMO is about to read.
+ *
+ * Bytes outside of memory read as zero, as they do for the instruction,
+ * but without repeating its warning.
+ *
+ * @param d The load or AMO.
+ * @param addr The effective address.
+ * @param size The access size in bytes.
+ * @return The value, extended the way d extends it into rd.
+ ********************************************************************************/
+uint32_t rv32i_hart::loaded_value(const decoded_insn &d, uint32_t addr,
+                                  uint32_t size) const {
+  uint32_t v = 0;
+  for (uint32_t i = 0; i < size; ++i)
+    if (uint64_t(addr) + i < mem.get_size())
+      v |= uint32_t(mem.get8(addr + i)) << (8 * i);
+  if (d.op == op_lb)
+    return uint32_t(int32_t(int8_t(v)));
+  if (d.op == op_lh)
+    return uint32_t(int32_t(int16_t(v)));
+  return v;
+}
+
+/**
+ * @brief Fills in the memory access d is about to make, if any.
+ *
+ * Also used without a trace, to feed the cache model.
+ *
+ * @param d The instruction about to execute.
+ * @param r The record to fill in.
+ ********************************************************************************/
+void rv32i_hart::trace_access(const decoded_insn &d, trace_record &r) const {
+  switch (d.op) {
+  case op_lb: case op_lbu: case op_sb:
+    r.mem_size = 1;
+    break;
+  case op_lh: case op_lhu: case op_sh:
+    r.mem_size = 2;
+    break;
+  case op_lw: case op_sw:
+  case op_lr_w: case op_sc_w: case op_amoswap_w: case op_amoadd_w:
+  case op_amoxor_w: case op_amoand_w: case op_amoor_w: case op_amomin_w:
+  case op_amomax_w: case op_amominu_w: case op_amomaxu_w:
+    r.mem_size = 4;
+    break;
+  default:
+    return;
+  }
+
+  r.mem_addr = regs.get(d.rs1) + d.imm;
+  switch (d.op) {
+  case op_sb: case op_sh: case op_sw: case op_sc_w: {
+    r.flags |= trace_record::mem_store;
+    uint32_t v = regs.get(d.rs2);
+    r.mem_value = r.mem_size == 4 ? v : v & ((1u << (8 * r.mem_size)) - 1);
+    break;
+  }
+  case op_lb: case op_lh: case op_lw: case op_lbu: case op_lhu: case op_lr_w:
+    r.flags |= trace_record::mem_load;
+    break;
+  default:
+    // the AMOs read the word and write it back
+    r.flags |= trace_record::mem_load | trace_record::mem_store;
+  }
+}
+
+/**
+ * @brief Completes a trace record after d executed and writes it.
+ * @param d The instruction that executed.
+ * @param r The record started by begin_trace().
+ ********************************************************************************/
+void rv32i_hart::end_trace(const decoded_insn &d, trace_record &r) {
+  if (halt) {
+    // an instruction that halts the hart has no effect
+    r.flags &= trace_record::compressed;
+    trace->write(r);
+    return;
+  }
+
+  switch (d.op) {
+  case op_illegal_insn: case op_block_end:
+  case op_beq: case op_bne: case op_blt: case op_bge: case op_bltu:
+  case op_bgeu:
+  case op_sb: case op_sh: case op_sw:
+  case op_ecall: case op_ebreak:
+  case op_fence: case op_fence_i:
+    break;
+  case op_sc_w:
+    if (!sc_ok)
+      r.flags &= ~trace_record::mem_store;
+    r.flags |= trace_record::has_rd;
+    r.rd = d.rd;
+    r.rd_value = regs.get(d.rd);
+    break;
+  default:
+    r.flags |= trace_record::has_rd;
+    r.rd = d.rd;
+    r.rd_value = regs.get(d.rd);
+  }
+  trace->write(r);
+}
+
+/**
+ * @brief Turns RV32C compressed instructions on or off.
+ * @param on true to run 16-bit instructions and allow 2-byte aligned pcs.
+ ********************************************************************************/
+void rv32i_hart::set_compressed(bool on) {
+  compressed = on;
+  align_mask = on ? 1 : 3;
+  csrs.set_compressed(on);
+  icache.set_compressed(on);
+  bcache.flush();
+}
+
+/**
+ * @brief Turns on translation of hot blocks into native code.
+ * @param threshold The number of runs before a block is translated.
+ ********************************************************************************/
+void rv32i_hart::enable_jit(uint32_t threshold) {
+  if (!rv32i_jit::is_supported())
+    return;
+  jit.reset(new rv32i_jit(regs.data(), mem, bcache, threshold));
+}
+
+/**
+ * @brief Fetches the predecoded instruction at addr.
+ *
+ * Decodes and caches the word on a predecode cache miss. With RV32C on,
+ * a 16-bit instruction is expanded to its 32-bit form first, and only its
+ * own halfword is read.
+ *
+ * Each word is watched before it is read, so a store from another hart
+ * either lands before the read or finds the watch and invalidates the
+ * entry; it can't slip in between and leave a stale decode behind.
+ *
+ * @param addr The address to fetch from.
+ * @return The decoded instruction.
+ ********************************************************************************/
+const decoded_insn *rv32i_hart::fetch(uint32_t addr) {
+  const decoded_insn *d = icache.lookup(addr);
+  if (d != nullptr)
+    return d;
+
+  mem.watch(addr);
+  if (compressed) {
+    uint16_t low = mem.get16(addr);
+    if (is_compressed(low)) {
+      decoded_insn c = predecode(expand_compressed(low));
+      c.len = 2;
+      return icache.insert(addr, c);
+    }
+    if (addr & 2)
+      mem.watch(addr + 2);                // a 32-bit insn at a halfword
+  }
+  return icache.insert(addr, predecode(mem.get32(addr)));
+}
+
+/**
+ * @brief Checks if an instruction has to be the last one in a basic block.
+ *
+ * Anything that can change the pc other than by falling through, or that
+ * can halt the hart, ends a block.
+ *
+ * @param d The decoded instruction.
+ * @return true if d ends a block.
+ ********************************************************************************/
+bool rv32i_hart::ends_block(const decoded_insn &d) {
+  switch (get_opcode(d.insn)) {
+  case opcode_btype:
+  case opcode_jal:
+  case opcode_jalr:
+  case opcode_system:
+  case opcode_amo:              // halts on a misaligned address
+    return true;
+  default:
+    return d.op == op_illegal_insn || d.op == op_fence_i;
+  }
+}
+
+/**
+ * @brief Decodes the basic block starting at start and caches it.
+ *
+ * Stops at the first block-ending instruction, at max_block_insns, or at
+ * the end of memory so nothing past it is fetched early. The copies in
+ * the block get threaded handlers and are followed by a block_end record.
+ *
+ * @param start The address of the first instruction.
+ * @return The new block, or nullptr if start is outside of memory.
+ ********************************************************************************/
+basic_block *rv32i_hart::build_block(uint32_t start) {
+  if (start >= mem.get_size())
+    return nullptr;
+
+  std::unique_ptr<basic_block> b(new basic_block);
+  b->start = start;
+  decoded_insn d;
+  for (uint32_t addr = start; addr < mem.get_size(); addr += d.len) {
+    d = *fetch(addr);
+    d.handler = chain_handlers[d.op];
+    b->insns.push_back(d);
+    b->last = addr;
+    if (ends_block(d) || b->insns.size() == block_cache::max_block_insns)
+      break;
+  }
+
+  decoded_insn end;
+  end.op = op_block_end;
+  end.handler = chain_handlers[op_block_end];
+  b->insns.push_back(end);
+  return bcache.insert(std::move(b));
+}
+
+/**
+ * @brief Runs until the hart halts or exec_limit instructions have run.
+ *
+ * A block runs by calling the threaded handler of its first record; each
+ * handler jumps to the next until the block_end sentinel returns. Once a
+ * block finishes, its successor is taken from the block's chain
+ * links when possible and only looked up (or built) on a miss. A store
+ * into code ends the current block early so the flushed cache is rebuilt
+ * before anything else runs.
+ *
+ * With the JIT enabled, hot blocks run as native code first and whatever
+ * the translation could not cover is finished off by the interpreter.
+ *
+ * A stop request is only noticed between blocks, so it costs one load
+ * per block rather than one per instruction.
+ *
+ * @param exec_limit The instruction count to stop at, or 0 for no limit.
+ ********************************************************************************/
+void rv32i_hart::run_blocks(uint64_t exec_limit) {
+  if (is_traced()) {
+    stepper s = get_stepper();
+    while (!halt && !stop.load(std::memory_order_relaxed) &&
+           (exec_limit == 0 || insn_counter != exec_limit)) {
+      uint32_t at = pc;
+      uint64_t count = insn_counter;
+      (this->*s)("");
+      if (prof || bpred)
+        note_step(at, count);
+    }
+    return;
+  }
+
+  basic_block *prev = nullptr;
+  while (!halt && !stop.load(std::memory_order_relaxed) &&
+         (exec_limit == 0 || insn_counter != exec_limit)) {
+    // blocks are copied from icache entries, so they are dropped with it;
+    // a write from another hart can land between the two syncs
+    if (icache.sync())
+      bcache.mark_stale();
+    bcache.sync();
+    if (bcache.is_stale() || (jit && jit->is_full())) {
+      bcache.flush();
+      if (jit)
+        jit->reset();
+      prev = nullptr;
+    }
+
+    basic_block *b = nullptr;
+    if (prev != nullptr) {
+      if (prev->succ[0] != nullptr && prev->succ[0]->start == pc)
+        b = prev->succ[0];
+      else if (prev->succ[1] != nullptr && prev->succ[1]->start == pc)
+        b = prev->succ[1];
+    }
+    if (b == nullptr && (pc & align_mask) == 0) {
+      b = bcache.lookup(pc);
+      if (b == nullptr)
+        b = build_block(pc);
+      if (b != nullptr && prev != nullptr)
+        block_cache::chain(prev, b);
+    }
+
+    if (b == nullptr ||
+        (exec_limit != 0 && exec_limit - insn_counter < b->length())) {
+      uint32_t at = pc;
+      uint64_t count = insn_counter;
+      step<trace_silent>("");
+      if (prof || bpred)
+        note_step(at, count);
+      prev = nullptr;
+      continue;
+    }
+
+    // counted up front so a CSR read at the end of the block sees the
+    // same count as in step(); corrected below if the block stops early
+    uint64_t base = insn_counter;
+    insn_counter += b->length();
+    size_t n = 0;
+    if (jit) {
+      jit->note_run(*b);
+      if (b->native != nullptr)
+        n = jit->run(*b, pc);
+    }
+    if (n < b->length() && !bcache.is_stale()) {
+      const decoded_insn &d = b->insns[n];
+      (this->*d.handler)(d, nullptr);
+      // only a store into code can stop a block before its last insn
+      n = bcache.is_stale() ? b->count_to(pc) : b->length();
+    }
+    insn_counter = base + n;
+    if (prof && n != 0)
+      prof->note_block(*b, n, pc);
+    if (bpred && n == b->length())
+      bpred->note(b->last, b->insns[n - 1], pc);
+    prev = b;
+  }
+}
+
+/**
+ * @brief Reports a single-stepped instruction to the profiler and the
+ * branch model.
+ *
+ * step() left the instruction in the predecode cache, so it is looked up
+ * there rather than fetched again, which could repeat an out-of-range
+ * warning.
+ *
+ * @param at The pc before the step.
+ * @param count The instruction count before the step; nothing ran if it
+ * is unchanged.
+ ********************************************************************************/
+void rv32i_hart::note_step(uint32_t at, uint64_t count) {
+  const decoded_insn *d = icache.lookup(at);
+  if (insn_counter == count || d == nullptr)
+    return;
+  if (prof)
+    prof->note_insn(at, *d, pc, ends_block(*d));
+  if (bpred)
+    bpred->note(at, *d, pc);
+}
+
+/**
+ * @brief Resets the hart's state.
+ *
+ * Memory is left alone, but the caches are flushed so nothing decoded
+ * before the reset runs after it.
+ ********************************************************************************/
+void rv32i_hart::reset() {
+  regs.reset();
+  pc = 0;
+  halt = false;
+  halt_reason = " none ";
+  insn_counter = 0;
+  csrs.reset();
+  reserved = false;
+  sc_ok = false;
+  icache.flush();
+  bcache.flush();
+  if (jit)
+    jit->reset();
+}
+
+/**
+ * @brief Copies the hart's state out for a snapshot.
+ * @param s Filled in with everything restore() needs.
+ ********************************************************************************/
+void rv32i_hart::save(snapshot_hart &s) const {
+  s = snapshot_hart();
+  s.insn_counter = insn_counter;
+  csrs.save(s);
+  s.pc = pc;
+  s.mhartid = mhartid;
+  for (uint32_t r = 0; r < 32; ++r)
+    s.regs[r] = regs.get(r);
+  s.reserved = reserved;
+  s.reserve_addr = reserve_addr;
+  s.reserve_value = reserve_value;
+  s.halt = halt;
+  s.compressed = compressed;
+  halt_reason.copy(s.halt_reason, sizeof(s.halt_reason) - 1);
+}
+
+/**
+ * @brief Puts the hart back into a state saved by save().
+ *
+ * Starts from reset(), since the memory under the caches has usually
+ * been replaced by the snapshot's.
+ *
+ * @param s The saved state.
+ ********************************************************************************/
+void rv32i_hart::restore(const snapshot_hart &s) {
+  reset();
+  set_compressed(s.compressed);
+  insn_counter = s.insn_counter;
+  csrs.restore(s);
+  pc = s.pc;
+  mhartid = s.mhartid;
+  for (uint32_t r = 1; r < 32; ++r)
+    regs.set(r, s.regs[r]);
+  reserved = s.reserved;
+  reserve_addr = s.reserve_addr;
+  reserve_value = s.reserve_value;
+  halt = s.halt;
+  halt_reason.assign(s.halt_reason,
+                     strnlen(s.halt_reason, sizeof(s.halt_reason)));
 }
 
 /**
@@ -345,93 +786,105 @@ void rv32i_hart::tick(const string &hdr) {
  * @param hdr String prefix for the register dump.
  ********************************************************************************/
 void rv32i_hart::dump(const string &hdr) const {
-  regs.dump(hdr);
-  std::cout << "\n pc " << to_hex32(pc) << '\n';
+  dump_regs(hdr);
   mem.dump();
 }
 
+/**
+ * @brief Dumps the registers and pc of the hart to stdout.
+ * @param hdr String prefix for the register dump.
+ ********************************************************************************/
+void rv32i_hart::dump_regs(const string &hdr) const {
+  regs.dump(hdr);
+  std::cout << '\n' << hdr << " pc " << to_hex32(pc) << '\n';
+}
+
 /**
  * @brief Executes the LUI (Load Upper Immediate) instruction.
- * @param insn The instruction to execute.
+ * @param d The predecoded instruction to execute.
  * @param pos Pointer to ostream for logging.
  ********************************************************************************/
-void rv32i_hart::exec_lui(uint32_t insn, std::ostream *pos) {
-  uint32_t rd = get_rd(insn);
-  uint32_t imm_u = get_imm_u(insn);
-  imm_u <<= (0 + 12);
-  if (pos) {
-    string s = render_lui(insn);
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_lui(const decoded_insn &d, std::ostream *pos) {
+  uint32_t rd = d.rd;
+  uint32_t imm_u = d.imm;
+  if (TRACE) {
+    string s = render_lui(d.insn);
     *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     *pos << "// " << render_reg(rd) << " = " << to_hex0x32(imm_u);
   }
 
   regs.set(rd, imm_u);
-  pc += 4;
+  pc += d.len;
+  dispatch_next<CHAIN>(d, pos);
 }
 
 /**
  * @brief Executes the AUIPC (Add Upper Immediate to PC) instruction.
- * @param insn The instruction to execute.
+ * @param d The predecoded instruction to execute.
  * @param pos Pointer to ostream for logging.
  ********************************************************************************/
-void rv32i_hart::exec_auipc(uint32_t insn, std::ostream *pos) {
-  uint32_t rd = get_rd(insn);
-  uint32_t imm_u = get_imm_u(insn);
-  imm_u <<= (0 + 12);
-  if (pos) {
-    string s = render_auipc(insn);
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_auipc(const decoded_insn &d, std::ostream *pos) {
+  uint32_t rd = d.rd;
+  uint32_t imm_u = d.imm;
+  if (TRACE) {
+    string s = render_auipc(d.insn);
     *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     *pos << "// " << render_reg(rd) << " = " << to_hex0x32(pc) << " + "
          << to_hex0x32(imm_u) << " = " << to_hex0x32(pc + imm_u);
   }
 
   regs.set(rd, (pc + imm_u));
-  pc += 4;
+  pc += d.len;
+  dispatch_next<CHAIN>(d, pos);
 }
 
 /**
  * @brief Executes the JAL (Jump and Link) instruction.
- * @param insn The instruction to execute.
+ * @param d The predecoded instruction to execute.
  * @param pos Pointer to ostream for logging.
  ********************************************************************************/
-void rv32i_hart::exec_jal(uint32_t insn, std::ostream *pos) {
-  uint32_t rd = get_rd(insn);
-  int32_t imm_j = get_imm_j(insn);
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_jal(const decoded_insn &d, std::ostream *pos) {
+  uint32_t rd = d.rd;
+  int32_t imm_j = d.imm;
 
-  if (pos) {
-    string s = render_jal(pc, insn);
+  if (TRACE) {
+    string s = render_jal(pc, d.insn);
     *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
-    *pos << "// " << render_reg(rd) << " = " << to_hex0x32(pc + 4)
+    *pos << "// " << render_reg(rd) << " = " << to_hex0x32(pc + d.len)
          << ",  pc = " << to_hex0x32(pc) << " + " << to_hex0x32(imm_j) << " = "
          << to_hex0x32(pc + imm_j);
   }
 
-  regs.set(rd, (pc + 4));
+  regs.set(rd, (pc + d.len));
   pc = pc + imm_j;
 }
 
 /**
  * @brief Executes the JALR (Jump and Link Register) instruction.
- * @param insn The instruction to execute.
+ * @param d The predecoded instruction to execute.
  * @param pos Pointer to ostream for logging.
  ********************************************************************************/
-void rv32i_hart::exec_jalr(uint32_t insn, std::ostream *pos) {
-  uint32_t rd = get_rd(insn);
-  uint32_t r1 = get_rs1(insn);
-  uint32_t imm_i = get_imm_i(insn);
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_jalr(const decoded_insn &d, std::ostream *pos) {
+  uint32_t rd = d.rd;
+  uint32_t r1 = d.rs1;
+  uint32_t imm_i = d.imm;
 
   uint32_t next_pc = (regs.get(r1) + imm_i) & 0xfffffffe;
 
-  if (pos) {
-    string s = render_jalr(insn);
+  if (TRACE) {
+    string s = render_jalr(d.insn);
     *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
-    *pos << "// " << render_reg(rd) << " = " << to_hex0x32(pc + 4)
+    *pos << "// " << render_reg(rd) << " = " << to_hex0x32(pc + d.len)
          << ",  pc = (" << to_hex0x32(imm_i) << " + "
          << to_hex0x32(regs.get(r1)) << ") & " << to_hex0x32(0xfffffffe)
          << " = " << to_hex0x32(next_pc);
   }
 
-  regs.set(rd, (pc + 4));
+  regs.set(rd, (pc + d.len));
   pc = next_pc;
 }
 
@@ -439,9 +892,10 @@ void rv32i_hart::exec_jalr(uint32_t insn, std::ostream *pos) {
  * @brief Executes the EBREAK (Environment Break) instruction.
  * @param pos Pointer to ostream for logging.
  ********************************************************************************/
-void rv32i_hart::exec_ebreak(std::ostream *pos) {
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_ebreak(const decoded_insn &, std::ostream *pos) {
 
-  if (pos) {
+  if (TRACE) {
     string s = render_ebreak();
     *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     *pos << "// HALT";
@@ -454,9 +908,10 @@ void rv32i_hart::exec_ebreak(std::ostream *pos) {
  * @brief Executes the ECALL (Environment Call) instruction.
  * @param pos Pointer to ostream for logging.
  ********************************************************************************/
-void rv32i_hart::exec_ecall(std::ostream *pos) {
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_ecall(const decoded_insn &, std::ostream *pos) {
 
-  if (pos) {
+  if (TRACE) {
     string s = render_ecall();
     *pos << std::setw(instruction_width) << std::setfill(' ') << std::left << s;
     *pos << "// HALT";
@@ -469,79 +924,266 @@ void rv32i_hart::exec_ecall(std::ostream *pos) {
  * @brief Macro to define CSR execution functions.
  *
  * Generates functions to execute CSRRW, CSRRS, CSRRC, CSRRWI, CSRRSI, CSRRCI.
- * Handles the special case for reading the mhartid CSR (0xf14).
+ * SRC is the source operand, NEW the value written from it and old_csr_val,
+ * and WRITES whether the instruction writes the CSR at all; CSRRS and CSRRC
+ * with x0 or a zero immediate only read it. Accessing a missing CSR, or
+ * writing a read-only one, halts the hart.
  ********************************************************************************/
-#define CSR_OP(NAME)                                                           \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rd = get_rd(insn);                                                \
-    int32_t csr_addr = get_imm_i(insn);                                        \
+#define CSR_OP(NAME, UPPER, RENDER, SRC, NEW, WRITES)                          \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rd = d.rd;                                                        \
+    uint32_t csr_addr = d.imm;                                                 \
+    uint32_t src = SRC;                                                        \
                                                                                \
     uint32_t old_csr_val = 0;                                                  \
-    if ((csr_addr & 0xfff) == 0xf14) {                                         \
-      old_csr_val = mhartid;                                                   \
-    } else {                                                                   \
-      halt = true;                                                             \
-      halt_reason = "Illegal CSR in CSRRS instruction";                        \
-    }                                                                          \
-                                                                               \
-    if (csr_addr == 0xf14) {                                                   \
-    }                                                                          \
+    bool ok = csrs.read(csr_addr, old_csr_val);                                \
+    if (ok && (WRITES))                                                        \
+      ok = csrs.write(csr_addr, NEW);                                          \
                                                                                \
-    if (pos) {                                                                 \
-      std::string s = render_csrrx(insn, #NAME);                               \
+    if (TRACE) {                                                               \
+      std::string s = RENDER(d.insn, #NAME);                                   \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
-      *pos << "// " << render_reg(rd) << " = " << old_csr_val;                 \
+      if (ok)                                                                  \
+        *pos << "// " << render_reg(rd) << " = " << old_csr_val;               \
+      else                                                                     \
+        *pos << "// HALT";                                                     \
+    }                                                                          \
+    if (!ok) {                                                                 \
+      halt = true;                                                             \
+      halt_reason = "Illegal CSR in " UPPER " instruction";                    \
+      return;                                                                  \
     }                                                                          \
     regs.set(rd, old_csr_val);                                                 \
-    pc += 4;                                                                   \
+    pc += d.len;                                                               \
   }
 
-CSR_OP(csrrw)
-CSR_OP(csrrs)
-CSR_OP(csrrc)
+CSR_OP(csrrw, "CSRRW", render_csrrx, regs.get(d.rs1), src, true)
+CSR_OP(csrrs, "CSRRS", render_csrrx, regs.get(d.rs1), old_csr_val | src,
+       d.rs1 != 0)
+CSR_OP(csrrc, "CSRRC", render_csrrx, regs.get(d.rs1), old_csr_val & ~src,
+       d.rs1 != 0)
 
-CSR_OP(csrrwi)
-CSR_OP(csrrsi)
-CSR_OP(csrrci)
+// the immediate forms take a 5-bit zero-extended immediate in the rs1 field
+CSR_OP(csrrwi, "CSRRWI", render_csrrxi, d.rs1, src, true)
+CSR_OP(csrrsi, "CSRRSI", render_csrrxi, d.rs1, old_csr_val | src, d.rs1 != 0)
+CSR_OP(csrrci, "CSRRCI", render_csrrxi, d.rs1, old_csr_val & ~src, d.rs1 != 0)
 
 #undef CSR_OP
 
+/**
+ * @brief Executes FENCE and FENCE.TSO.
+ *
+ * Harts on other threads see memory through the host's memory model, so
+ * a full host fence covers every predecessor and successor set.
+ *
+ * @param d The predecoded instruction to execute.
+ * @param pos Pointer to ostream for logging.
+ ********************************************************************************/
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_fence(const decoded_insn &d, std::ostream *pos) {
+  memory::fence();
+  if (TRACE)
+    *pos << render_fence(d.insn);
+  pc += d.len;
+  dispatch_next<CHAIN>(d, pos);
+}
+
+/**
+ * @brief Executes FENCE.I.
+ *
+ * Stores into code normally reach the caches through the memory watchers
+ * on their own. FENCE.I also throws away everything this hart has decoded,
+ * so the guest can always get its own view of code back in sync. The
+ * caches are only marked here: the block holding the FENCE.I is still
+ * running, and they are flushed once it returns to run_blocks(), or
+ * before the next step.
+ *
+ * @param d The predecoded instruction to execute.
+ * @param pos Pointer to ostream for logging.
+ ********************************************************************************/
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_fence_i(const decoded_insn &d, std::ostream *pos) {
+  memory::fence();
+  icache.mark_stale();
+  bcache.mark_stale();
+  if (TRACE)
+    *pos << render_fence(d.insn);
+  pc += d.len;
+  dispatch_next<CHAIN>(d, pos);
+}
+
+/**
+ * @brief Halts the hart if an atomic's address is not word aligned.
+ * @param addr The address in rs1.
+ * @return true if the address is aligned.
+ ********************************************************************************/
+bool rv32i_hart::check_amo_alignment(uint32_t addr) {
+  if (addr % 4 == 0)
+    return true;
+  halt = true;
+  halt_reason = "Misaligned atomic memory operation";
+  return false;
+}
+
+/**
+ * @brief Executes LR.W (Load Reserved).
+ *
+ * Records the address and the value read. The reservation is kept in the
+ * hart rather than in memory: SC.W later succeeds only if the word still
+ * holds that value, checked with a host compare-and-swap, so it holds up
+ * with harts on other threads. Like other emulators that do this, a
+ * store that writes back the same value goes unnoticed.
+ *
+ * @param d The predecoded instruction to execute.
+ * @param pos Pointer to ostream for logging.
+ ********************************************************************************/
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_lr_w(const decoded_insn &d, std::ostream *pos) {
+  uint32_t addr = regs.get(d.rs1);
+  if (TRACE)
+    *pos << std::setw(instruction_width) << std::setfill(' ') << std::left
+         << render_amo(d.insn, "lr.w");
+  if (!check_amo_alignment(addr)) {
+    if (TRACE)
+      *pos << "// HALT";
+    return;
+  }
+
+  uint32_t val = mem.load32_seq(addr);
+  reserved = true;
+  reserve_addr = addr;
+  reserve_value = val;
+  if (TRACE)
+    *pos << "// " << render_reg(d.rd) << " = m32(" << to_hex0x32(addr)
+         << ") = " << to_hex0x32(val);
+  regs.set(d.rd, val);
+  pc += d.len;
+  dispatch_next<CHAIN>(d, pos);
+}
+
+/**
+ * @brief Executes SC.W (Store Conditional).
+ *
+ * Stores rs2 and writes 0 to rd if this hart holds a reservation on the
+ * address and the word is unchanged since LR.W; otherwise writes 1. The
+ * reservation is gone afterwards either way.
+ *
+ * @param d The predecoded instruction to execute.
+ * @param pos Pointer to ostream for logging.
+ ********************************************************************************/
+template <bool CHAIN, bool TRACE>
+void rv32i_hart::exec_sc_w(const decoded_insn &d, std::ostream *pos) {
+  uint32_t addr = regs.get(d.rs1);
+  uint32_t val = regs.get(d.rs2);
+  sc_ok = false;
+  if (TRACE)
+    *pos << std::setw(instruction_width) << std::setfill(' ') << std::left
+         << render_amo(d.insn, "sc.w");
+  if (!check_amo_alignment(addr)) {
+    if (TRACE)
+      *pos << "// HALT";
+    return;
+  }
+
+  sc_ok = reserved && reserve_addr == addr &&
+          mem.cas32(addr, reserve_value, val);
+  reserved = false;
+  if (TRACE) {
+    *pos << "// ";
+    if (sc_ok)
+      *pos << "m32(" << to_hex0x32(addr) << ") = " << to_hex0x32(val) << ", ";
+    *pos << render_reg(d.rd) << " = " << (sc_ok ? 0 : 1);
+  }
+  regs.set(d.rd, sc_ok ? 0 : 1);
+  pc += d.len;
+  if (!bcache.is_stale())
+    dispatch_next<CHAIN>(d, pos);
+}
+
+/**
+ * @brief Macro to define the AMO execution functions.
+ *
+ * Each one atomically applies its operation to the word at rs1 with rs2
+ * and writes the old value to rd. Like a store, one that overwrites
+ * cached code stops a threaded block right there.
+ ********************************************************************************/
+#define AMO_OP(NAME, MNEMONIC, OP)                                             \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t addr = regs.get(d.rs1);                                           \
+    uint32_t val = regs.get(d.rs2);                                            \
+    if (TRACE)                                                                 \
+      *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
+           << render_amo(d.insn, MNEMONIC);                                    \
+    if (!check_amo_alignment(addr)) {                                          \
+      if (TRACE)                                                               \
+        *pos << "// HALT";                                                     \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    uint32_t old = mem.amo32(addr, memory::OP, val);                           \
+    if (TRACE)                                                                 \
+      *pos << "// " << render_reg(d.rd) << " = m32(" << to_hex0x32(addr)       \
+           << ") = " << to_hex0x32(old) << ", m32(" << to_hex0x32(addr)        \
+           << ") = " << to_hex0x32(mem.get32(addr));                           \
+    regs.set(d.rd, old);                                                       \
+    pc += d.len;                                                               \
+    if (!bcache.is_stale())                                                    \
+      dispatch_next<CHAIN>(d, pos);                                            \
+  }
+
+AMO_OP(amoswap_w, "amoswap.w", amo_swap)
+AMO_OP(amoadd_w, "amoadd.w", amo_add)
+AMO_OP(amoxor_w, "amoxor.w", amo_xor)
+AMO_OP(amoand_w, "amoand.w", amo_and)
+AMO_OP(amoor_w, "amoor.w", amo_or)
+AMO_OP(amomin_w, "amomin.w", amo_min)
+AMO_OP(amomax_w, "amomax.w", amo_max)
+AMO_OP(amominu_w, "amominu.w", amo_minu)
+AMO_OP(amomaxu_w, "amomaxu.w", amo_maxu)
+
+#undef AMO_OP
+
 /**
  * @brief Macro to define R-type ALU execution functions (ADD, SUB, AND, OR, XOR).
  ********************************************************************************/
 #define R_TYPE_ALU(NAME, OP, TYPE, MNEMONIC)                                   \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rd = get_rd(insn);                                                \
-    uint32_t rs1 = get_rs1(insn);                                              \
-    uint32_t rs2 = get_rs2(insn);                                              \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rd = d.rd;                                                        \
+    uint32_t rs1 = d.rs1;                                                      \
+    uint32_t rs2 = d.rs2;                                                      \
     TYPE val1 = (TYPE)regs.get(rs1);                                           \
     TYPE val2 = (TYPE)regs.get(rs2);                                           \
     int32_t result = (int32_t)(val1 OP val2);                                  \
-    if (pos) {                                                                 \
-      std::string s = render_rtype(insn, MNEMONIC);                            \
+    if (TRACE) {                                                               \
+      std::string s = render_rtype(d.insn, MNEMONIC);                          \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
       *pos << "// " << render_reg(rd) << " = " << to_hex0x32(val1)             \
            << " " #OP " " << to_hex0x32(val2) << " = " << to_hex0x32(result);  \
     }                                                                          \
     regs.set(rd, result);                                                      \
-    pc += 4;                                                                   \
+    pc += d.len;                                                               \
+    dispatch_next<CHAIN>(d, pos);                                              \
   }
 
 /**
  * @brief Macro to define R-type comparison functions (SLT, SLTU).
  ********************************************************************************/
 #define R_TYPE_SLT(NAME, OP, TYPE, MNEMONIC, LOG_OP)                           \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rd = get_rd(insn);                                                \
-    uint32_t rs1 = get_rs1(insn);                                              \
-    uint32_t rs2 = get_rs2(insn);                                              \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rd = d.rd;                                                        \
+    uint32_t rs1 = d.rs1;                                                      \
+    uint32_t rs2 = d.rs2;                                                      \
     TYPE val1 = (TYPE)regs.get(rs1);                                           \
     TYPE val2 = (TYPE)regs.get(rs2);                                           \
     int32_t result = (val1 OP val2) ? 1 : 0;                                   \
-    if (pos) {                                                                 \
-      std::string s = render_rtype(insn, MNEMONIC);                            \
+    if (TRACE) {                                                               \
+      std::string s = render_rtype(d.insn, MNEMONIC);                          \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
       *pos << "// " << render_reg(rd) << " = (" << to_hex0x32(val1)            \
@@ -549,22 +1191,24 @@ CSR_OP(csrrci)
            << ") ? 1 : 0 = " << to_hex0x32(result);                            \
     }                                                                          \
     regs.set(rd, result);                                                      \
-    pc += 4;                                                                   \
+    pc += d.len;                                                               \
+    dispatch_next<CHAIN>(d, pos);                                              \
   }
 
 /**
  * @brief Macro to define R-type shift functions (SLL, SRL, SRA).
  ********************************************************************************/
 #define R_TYPE_SHIFT(NAME, OP, TYPE, MNEMONIC)                                 \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rd = get_rd(insn);                                                \
-    uint32_t rs1 = get_rs1(insn);                                              \
-    uint32_t rs2 = get_rs2(insn);                                              \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rd = d.rd;                                                        \
+    uint32_t rs1 = d.rs1;                                                      \
+    uint32_t rs2 = d.rs2;                                                      \
     TYPE val1 = (TYPE)regs.get(rs1);                                           \
     uint32_t amount = regs.get(rs2) & 0x1f;                                    \
     int32_t result = (int32_t)(val1 OP amount);                                \
-    if (pos) {                                                                 \
-      std::string s = render_rtype(insn, MNEMONIC);                            \
+    if (TRACE) {                                                               \
+      std::string s = render_rtype(d.insn, MNEMONIC);                          \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
       *pos << "// " << render_reg(rd) << " = " << to_hex0x32(val1)             \
@@ -572,7 +1216,8 @@ CSR_OP(csrrci)
            << to_hex0x32(result);                                              \
     }                                                                          \
     regs.set(rd, result);                                                      \
-    pc += 4;                                                                   \
+    pc += d.len;                                                               \
+    dispatch_next<CHAIN>(d, pos);                                              \
   }
 
 R_TYPE_ALU(add, +, int32_t, "add")
@@ -591,41 +1236,123 @@ R_TYPE_SHIFT(sra, >>, int32_t, "sra")
 #undef R_TYPE_ALU
 #undef R_TYPE_SHIFT
 
+/**
+ * @brief The RV32M operations on host arithmetic.
+ *
+ * The high-half multiplies widen to 64 bits. Division by zero and the one
+ * signed overflow (INT32_MIN / -1) are caught first, since they trap on the
+ * host, and give the results the spec requires instead.
+ ********************************************************************************/
+static uint32_t muldiv_mul(uint32_t a, uint32_t b) { return a * b; }
+
+static uint32_t muldiv_mulh(uint32_t a, uint32_t b) {
+  return uint32_t(uint64_t(int64_t(int32_t(a)) * int64_t(int32_t(b))) >> 32);
+}
+
+static uint32_t muldiv_mulhsu(uint32_t a, uint32_t b) {
+  return uint32_t(uint64_t(int64_t(int32_t(a)) * int64_t(b)) >> 32);
+}
+
+static uint32_t muldiv_mulhu(uint32_t a, uint32_t b) {
+  return uint32_t((uint64_t(a) * uint64_t(b)) >> 32);
+}
+
+static uint32_t muldiv_div(uint32_t a, uint32_t b) {
+  if (b == 0)
+    return 0xffffffff;
+  if (a == 0x80000000 && b == 0xffffffff)
+    return a;
+  return uint32_t(int32_t(a) / int32_t(b));
+}
+
+static uint32_t muldiv_divu(uint32_t a, uint32_t b) {
+  return b == 0 ? 0xffffffff : a / b;
+}
+
+static uint32_t muldiv_rem(uint32_t a, uint32_t b) {
+  if (b == 0)
+    return a;
+  if (a == 0x80000000 && b == 0xffffffff)
+    return 0;
+  return uint32_t(int32_t(a) % int32_t(b));
+}
+
+static uint32_t muldiv_remu(uint32_t a, uint32_t b) {
+  return b == 0 ? a : a % b;
+}
+
+/**
+ * @brief Macro to define the RV32M multiply/divide functions.
+ ********************************************************************************/
+#define R_TYPE_MULDIV(NAME, OP_TEXT)                                           \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rd = d.rd;                                                        \
+    uint32_t val1 = regs.get(d.rs1);                                           \
+    uint32_t val2 = regs.get(d.rs2);                                           \
+    int32_t result = (int32_t)muldiv_##NAME(val1, val2);                       \
+    if (TRACE) {                                                               \
+      std::string s = render_rtype(d.insn, #NAME);                             \
+      *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
+           << s;                                                               \
+      *pos << "// " << render_reg(rd) << " = " << to_hex0x32(val1)             \
+           << " " OP_TEXT " " << to_hex0x32(val2) << " = "                     \
+           << to_hex0x32(result);                                              \
+    }                                                                          \
+    regs.set(rd, result);                                                      \
+    pc += d.len;                                                               \
+    dispatch_next<CHAIN>(d, pos);                                              \
+  }
+
+R_TYPE_MULDIV(mul, "*")
+R_TYPE_MULDIV(mulh, "*H")
+R_TYPE_MULDIV(mulhsu, "*HSU")
+R_TYPE_MULDIV(mulhu, "*HU")
+R_TYPE_MULDIV(div, "/")
+R_TYPE_MULDIV(divu, "/U")
+R_TYPE_MULDIV(rem, "%")
+R_TYPE_MULDIV(remu, "%U")
+
+#undef R_TYPE_MULDIV
+
 /**
  * @brief Macro to define I-type ALU functions with immediate values (ADDI, ANDI, ORI, XORI).
  ********************************************************************************/
 #define ALU_IMM(NAME, OP, TYPE)                                                \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rd = get_rd(insn);                                                \
-    uint32_t rs1 = get_rs1(insn);                                              \
-    int32_t imm_i = get_imm_i(insn);                                           \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rd = d.rd;                                                        \
+    uint32_t rs1 = d.rs1;                                                      \
+    int32_t imm_i = d.imm;                                                     \
     TYPE val1 = (TYPE)regs.get(rs1);                                           \
     TYPE val2 = (TYPE)imm_i;                                                   \
     int32_t result = (int32_t)(val1 OP val2);                                  \
-    if (pos) {                                                                 \
-      std::string s = render_itype_alu(insn, #NAME, imm_i);                    \
+    if (TRACE) {                                                               \
+      std::string s = render_itype_alu(d.insn, #NAME, imm_i);                  \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
       *pos << "// " << render_reg(rd) << " = " << to_hex0x32(val1)             \
            << " " #OP " " << to_hex0x32(val2) << " = " << to_hex0x32(result);  \
     }                                                                          \
     regs.set(rd, result);                                                      \
-    pc += 4;                                                                   \
+    pc += d.len;                                                               \
+    dispatch_next<CHAIN>(d, pos);                                              \
   }
 
 /**
  * @brief Macro to define I-type comparison functions with immediates (SLTI, SLTIU).
  ********************************************************************************/
 #define ALU_SLT_IMM(NAME, OP, TYPE, LOG_OP)                                    \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rd = get_rd(insn);                                                \
-    uint32_t rs1 = get_rs1(insn);                                              \
-    int32_t imm_i = get_imm_i(insn);                                           \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rd = d.rd;                                                        \
+    uint32_t rs1 = d.rs1;                                                      \
+    int32_t imm_i = d.imm;                                                     \
     TYPE val1 = (TYPE)regs.get(rs1);                                           \
     TYPE val2 = (TYPE)imm_i;                                                   \
     int32_t result = (val1 OP val2) ? 1 : 0;                                   \
-    if (pos) {                                                                 \
-      std::string s = render_itype_alu(insn, #NAME, imm_i);                    \
+    if (TRACE) {                                                               \
+      std::string s = render_itype_alu(d.insn, #NAME, imm_i);                  \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
       *pos << "// " << render_reg(rd) << " = (" << to_hex0x32(val1)            \
@@ -633,29 +1360,31 @@ R_TYPE_SHIFT(sra, >>, int32_t, "sra")
            << ") ? 1 : 0 = " << to_hex0x32(result);                            \
     }                                                                          \
     regs.set(rd, result);                                                      \
-    pc += 4;                                                                   \
+    pc += d.len;                                                               \
+    dispatch_next<CHAIN>(d, pos);                                              \
   }
 
 /**
  * @brief Macro to define I-type shift functions with immediates (SLLI, SRLI, SRAI).
  ********************************************************************************/
 #define ALU_SHIFT_IMM(NAME, OP, TYPE)                                          \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rd = get_rd(insn);                                                \
-    uint32_t rs1 = get_rs1(insn);                                              \
-    int32_t imm_i = get_imm_i(insn);                                           \
-    uint32_t shamt = imm_i & 0x1f;                                             \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rd = d.rd;                                                        \
+    uint32_t rs1 = d.rs1;                                                      \
+    uint32_t shamt = d.imm;                                                    \
     TYPE val1 = (TYPE)regs.get(rs1);                                           \
     int32_t result = (int32_t)(val1 OP shamt);                                 \
-    if (pos) {                                                                 \
-      std::string s = render_itype_alu(insn, #NAME, shamt);                    \
+    if (TRACE) {                                                               \
+      std::string s = render_itype_alu(d.insn, #NAME, shamt);                  \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
       *pos << "// " << render_reg(rd) << " = " << to_hex0x32(val1)             \
            << " " #OP " " << std::dec << shamt << " = " << to_hex0x32(result); \
     }                                                                          \
     regs.set(rd, result);                                                      \
-    pc += 4;                                                                   \
+    pc += d.len;                                                               \
+    dispatch_next<CHAIN>(d, pos);                                              \
   }
 
 ALU_IMM(addi, +, int32_t)
@@ -678,14 +1407,15 @@ ALU_SHIFT_IMM(srai, >>, int32_t)
  * @brief Macro to define Load instructions (LB, LH, LW, LBU, LHU).
  ********************************************************************************/
 #define LOAD_OP(NAME, MEM_FUNC, LOG_OP, WIDTH)                                 \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rd = get_rd(insn);                                                \
-    uint32_t rs1 = get_rs1(insn);                                              \
-    int32_t imm_i = get_imm_i(insn);                                           \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rd = d.rd;                                                        \
+    uint32_t rs1 = d.rs1;                                                      \
+    int32_t imm_i = d.imm;                                                     \
     uint32_t addr = regs.get(rs1) + imm_i;                                     \
     int32_t val = mem.MEM_FUNC(addr);                                          \
-    if (pos) {                                                                 \
-      std::string s = render_itype_load(insn, #NAME);                          \
+    if (TRACE) {                                                               \
+      std::string s = render_itype_load(d.insn, #NAME);                        \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
       *pos << "// " << render_reg(rd) << " = " LOG_OP "(m" << std::dec         \
@@ -693,7 +1423,8 @@ ALU_SHIFT_IMM(srai, >>, int32_t)
            << to_hex0x32(imm_i) << ")) = " << to_hex0x32(val);                 \
     }                                                                          \
     regs.set(rd, val);                                                         \
-    pc += 4;                                                                   \
+    pc += d.len;                                                               \
+    dispatch_next<CHAIN>(d, pos);                                              \
   }
 
 LOAD_OP(lb, get8_sx, "sx", 8);
@@ -708,21 +1439,22 @@ LOAD_OP(lhu, get16, "zx", 16);
  * @brief Macro to define Branch instructions (BEQ, BNE, BLT, BGE, BLTU, BGEU).
  ********************************************************************************/
 #define B_TYPE_IMPL(NAME, OP, TYPE, MNEMONIC, LOG_OP)                          \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rs1 = get_rs1(insn);                                              \
-    uint32_t rs2 = get_rs2(insn);                                              \
-    int32_t imm_b = get_imm_b(insn);                                           \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rs1 = d.rs1;                                                      \
+    uint32_t rs2 = d.rs2;                                                      \
+    int32_t imm_b = d.imm;                                                     \
     TYPE val1 = (TYPE)regs.get(rs1);                                           \
     TYPE val2 = (TYPE)regs.get(rs2);                                           \
     bool take = (val1 OP val2);                                                \
-    int32_t offset = take ? imm_b : 4;                                         \
-    if (pos) {                                                                 \
-      std::string s = render_btype(pc, insn, MNEMONIC);                        \
+    int32_t offset = take ? imm_b : d.len;                                     \
+    if (TRACE) {                                                               \
+      std::string s = render_btype(pc, d.insn, MNEMONIC);                      \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
       *pos << "// pc += (" << to_hex0x32(val1) << " " LOG_OP " "               \
-           << to_hex0x32(val2) << " ? " << to_hex0x32(imm_b)                   \
-           << " : 4) = " << to_hex0x32(pc + offset);                           \
+           << to_hex0x32(val2) << " ? " << to_hex0x32(imm_b) << " : "          \
+           << std::dec << unsigned(d.len) << ") = " << to_hex0x32(pc + offset);\
     }                                                                          \
     pc += offset;                                                              \
   }
@@ -739,16 +1471,20 @@ B_TYPE_IMPL(bgeu, >=, uint32_t, "bgeu", ">=U")
 
 /**
  * @brief Macro to define Store instructions (SB, SH, SW).
+ *
+ * A store that overwrites cached code stops a threaded block right there,
+ * so nothing decoded from the old code runs after it.
  ********************************************************************************/
 #define STORE_OP(NAME, MEM_FUNC, M_TYPE)                                       \
-  void rv32i_hart::exec_##NAME(uint32_t insn, std::ostream *pos) {             \
-    uint32_t rs1 = get_rs1(insn);                                              \
-    uint32_t rs2 = get_rs2(insn);                                              \
-    int32_t imm_s = get_imm_s(insn);                                           \
+  template <bool CHAIN, bool TRACE>                                            \
+  void rv32i_hart::exec_##NAME(const decoded_insn &d, std::ostream *pos) {     \
+    uint32_t rs1 = d.rs1;                                                      \
+    uint32_t rs2 = d.rs2;                                                      \
+    int32_t imm_s = d.imm;                                                     \
     uint32_t addr = regs.get(rs1) + imm_s;                                     \
     mem.MEM_FUNC(addr, regs.get(rs2));                                         \
-    if (pos) {                                                                 \
-      std::string s = render_stype(insn, #NAME);                               \
+    if (TRACE) {                                                               \
+      std::string s = render_stype(d.insn, #NAME);                             \
       *pos << std::setw(instruction_width) << std::setfill(' ') << std::left   \
            << s;                                                               \
       uint32_t val = regs.get(rs2);                                            \
@@ -759,7 +1495,9 @@ B_TYPE_IMPL(bgeu, >=, uint32_t, "bgeu", ">=U")
       *pos << "// " M_TYPE "(" << to_hex0x32(regs.get(rs1)) << " + "           \
            << to_hex0x32(imm_s) << ") = " << to_hex0x32(val);                  \
     }                                                                          \
-    pc += 4;                                                                   \
+    pc += d.len;                                                               \
+    if (!bcache.is_stale())                                                    \
+      dispatch_next<CHAIN>(d, pos);                                            \
   }
 
 STORE_OP(sb, set8, "m8")
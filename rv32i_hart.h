@@ -6,9 +6,21 @@
 	of the starter code provided for the assignment.
 */
 #pragma once
+#include "block_cache.h"
+#include "branch_model.h"
+#include "cache_model.h"
+#include "csr_file.h"
 #include "memory.h"
+#include "predecode_cache.h"
+#include "profiler.h"
 #include "registerfile.h"
 #include "rv32i_decode.h"
+#include "rv32i_jit.h"
+#include "snapshot_format.h"
+#include "symbol_table.h"
+#include "trace_writer.h"
+#include <atomic>
+#include <memory>
 
 /**
  * @class rv32i_hart
@@ -24,7 +36,7 @@ public:
    * @brief Constructs a new rv32i_hart object.
    * @param m Reference to the memory object to be used by the hart.
    ****************************************************************************/
-  rv32i_hart(memory &m) : mem(m) {};
+  rv32i_hart(memory &m) : mem(m), icache(m), bcache(m) {};
 
   /**
    * @brief Sets the flag to show instructions during execution.
@@ -38,6 +50,82 @@ public:
    ****************************************************************************/
   void set_show_registers(bool b) { show_regs = b; };
 
+  /**
+   * @brief Gives the hart a symbol table to label traced functions with.
+   * @param s The symbol table, or nullptr for none. It must outlive the
+   * hart.
+   ****************************************************************************/
+  void set_symbols(const symbol_table *s) { symbols = s; }
+
+  /**
+   * @brief Sends a binary record of every executed instruction to t.
+   * @param t The trace writer, or nullptr to stop tracing. It must outlive
+   * the hart.
+   ****************************************************************************/
+  void set_trace(trace_writer *t) { trace = t; }
+
+  /**
+   * @brief Reports every instruction the hart runs to a profiler.
+   * @param p The profiler, or nullptr to stop profiling. It must outlive
+   * the hart.
+   ****************************************************************************/
+  void set_profiler(profiler *p) { prof = p; }
+
+  /**
+   * @brief Feeds every instruction fetch, load and store to a cache model.
+   *
+   * The hart then runs a step at a time, like a traced one, so a run
+   * without a model pays nothing for it.
+   *
+   * @param c The cache model, or nullptr to stop. It must outlive the hart.
+   ****************************************************************************/
+  void set_caches(cache_hierarchy *c) { caches = c; }
+
+  /**
+   * @brief Reports every branch and jump the hart runs to a branch model.
+   * @param m The branch model, or nullptr to stop. It must outlive the
+   * hart.
+   ****************************************************************************/
+  void set_branch_model(branch_model *m) { bpred = m; }
+
+  /**
+   * @brief Sets the address execution starts at.
+   * @param addr The new pc.
+   ****************************************************************************/
+  void set_pc(uint32_t addr) { pc = addr; }
+
+  /**
+   * @brief Gets the address of the next instruction to run.
+   * @return The pc.
+   ****************************************************************************/
+  uint32_t get_pc() const { return pc; }
+
+  /**
+   * @brief Turns RV32C compressed instructions on or off.
+   *
+   * With it on, 16-bit instructions are expanded to their 32-bit forms as
+   * they are predecoded, and the pc only has to be 2-byte aligned.
+   *
+   * @param on true to enable RV32C.
+   ****************************************************************************/
+  void set_compressed(bool on);
+
+  /**
+   * @brief Checks if RV32C compressed instructions are enabled.
+   * @return true if they are.
+   ****************************************************************************/
+  bool get_compressed() const { return compressed; }
+
+  /**
+   * @brief Turns on translation of hot blocks into native code.
+   *
+   * Has no effect on hosts the JIT does not support, or on traced runs,
+   * which always go through tick().
+   *
+   * @param threshold The number of runs before a block is translated.
+   ****************************************************************************/
+  void enable_jit(uint32_t threshold = rv32i_jit::default_threshold);
+
   /**
    * @brief Checks if the hart is halted.
    * @return true if halted, false otherwise.
@@ -56,17 +144,40 @@ public:
    ****************************************************************************/
   uint64_t get_insn_counter() const { return insn_counter; };
 
+  /**
+   * @brief Checks if the hart prints, records or models every instruction
+   * it runs.
+   * @return true if -i, -r, a binary trace or a cache model is turned on.
+   ****************************************************************************/
+  bool is_traced() const {
+    return show_insns || show_regs || trace || caches;
+  }
+
   /**
    * @brief Sets the hart ID (mhartid CSR).
    * @param i The hart ID.
    ****************************************************************************/
   void set_mhartid(int i) { mhartid = i; }
 
+  /**
+   * @brief Makes the calling thread the one that runs this hart.
+   *
+   * Stores into code made by harts on other threads are then picked up
+   * between blocks instead of touching this hart's caches directly.
+   ****************************************************************************/
+  void claim_thread() {
+    icache.set_owner();
+    bcache.set_owner();
+  }
+
   /**
    * @brief Executes a single instruction cycle.
+   *
+   * Runs the step instantiation that matches the current trace settings.
+   *
    * @param hdr Optional header string for output.
    ****************************************************************************/
-  void tick(const std::string &hdr = "");
+  void tick(const char *hdr = "") { (this->*get_stepper())(hdr); }
 
   /**
    * @brief Dumps the current state of the hart (registers and memory).
@@ -74,80 +185,308 @@ public:
    ****************************************************************************/
   void dump(const std::string &hdr = "") const;
 
+  /**
+   * @brief Dumps the registers and pc without the memory.
+   * @param hdr Optional header string for output.
+   ****************************************************************************/
+  void dump_regs(const std::string &hdr = "") const;
+
   /**
    * @brief Resets the hart's state.
+   *
+   * Clears the registers, pc, instruction count, halt state and LR.W
+   * reservation, and drops every cached decoding of memory.
    ****************************************************************************/
   void reset();
 
+  /**
+   * @brief Copies the hart's state out for a snapshot.
+   * @param s Filled in with everything restore() needs.
+   ****************************************************************************/
+  void save(snapshot_hart &s) const;
+
+  /**
+   * @brief Puts the hart back into a state saved by save().
+   * @param s The saved state.
+   ****************************************************************************/
+  void restore(const snapshot_hart &s);
+
+  /**
+   * @brief Asks run_blocks() to return at the next block boundary.
+   *
+   * Only sets an atomic flag, so it may be called from a signal handler
+   * or another thread.
+   ****************************************************************************/
+  void request_stop() { stop.store(true, std::memory_order_relaxed); }
+
+  /**
+   * @brief Checks for a stop request and clears it.
+   * @return true if request_stop() was called since the last check.
+   ****************************************************************************/
+  bool take_stop() { return stop.exchange(false, std::memory_order_relaxed); }
+
 protected:
+  /**
+   * @brief Runs until the hart halts or exec_limit instructions have run.
+   *
+   * Executes whole basic blocks at a time, following chained successors,
+   * and only falls back to tick() for traced runs (text or binary), the
+   * last few instructions before the limit, or code outside of memory.
+   *
+   * @param exec_limit The instruction count to stop at, or 0 for no limit.
+   ****************************************************************************/
+  void run_blocks(uint64_t exec_limit);
+
   registerfile regs;
   memory &mem;
 
 private:
   static constexpr int instruction_width = 35;
-  void exec(uint32_t insn, std::ostream *);
+
+  typedef void (rv32i_hart::*handler)(const decoded_insn &, std::ostream *);
+
+  /**
+   * @brief How an instruction format's immediate is extracted.
+   ****************************************************************************/
+  enum imm_format {
+    fmt_none, fmt_i, fmt_s, fmt_b, fmt_u, fmt_j, fmt_shamt, fmt_csr
+  };
+
+  /**
+   * @brief One entry of the decode table.
+   *
+   * An instruction word w is op when (w & mask) == match. Rules are tried
+   * in table order, so more specific encodings have to come first.
+   ****************************************************************************/
+  struct decode_rule {
+    uint32_t mask;
+    uint32_t match;
+    insn_op op;
+    imm_format fmt;
+  };
+
+  /**
+   * @brief What a step traces, fixed at compile time.
+   *
+   * Each combination gets its own instantiation of step(), so a silent
+   * run has no trace tests in it at all.
+   ****************************************************************************/
+  template <bool INSNS, bool REGS, bool BINARY, bool CACHES>
+  struct trace_policy {
+    static constexpr bool insns = INSNS;      // -i text trace
+    static constexpr bool regs = REGS;        // -r register dumps
+    static constexpr bool binary = BINARY;    // -t binary records
+    static constexpr bool caches = CACHES;    // -C cache model
+  };
+  typedef trace_policy<false, false, false, false> trace_silent;
+
+  typedef void (rv32i_hart::*stepper)(const char *);
+
+  static const decode_rule decode_rules[];
+  static const handler step_handlers[op_count];
+  static const handler chain_handlers[op_count];
+  static const handler trace_handlers[op_count];
+  static const stepper steppers[16];
+
+  /**
+   * @brief Picks the step instantiation for the current trace settings.
+   * @return The stepper.
+   ****************************************************************************/
+  stepper get_stepper() const {
+    return steppers[show_insns | show_regs << 1 | (trace != nullptr) << 2 |
+                    (caches != nullptr) << 3];
+  }
+
+  template <class POLICY> void step(const char *hdr);
+
+  decoded_insn predecode(uint32_t insn);
+
+  /**
+   * @brief Jumps to the handler of the record after d in a basic block.
+   *
+   * Does nothing for single-step handlers. The call is in tail position in
+   * every handler, so an optimizing build turns it into a plain jump.
+   *
+   * @param d The record that just executed.
+   * @param pos Passed through to the next handler.
+   ****************************************************************************/
+  template <bool CHAIN>
+  void dispatch_next(const decoded_insn &d, std::ostream *pos) {
+    if (CHAIN) {
+      const decoded_insn &n = (&d)[1];
+      (this->*n.handler)(n, pos);
+    }
+  }
+
+  const decoded_insn *fetch(uint32_t addr);
+  void note_step(uint32_t at, uint64_t count);
+  void begin_trace(const decoded_insn &d, trace_record &r) const;
+  uint32_t loaded_value(const decoded_insn &d, uint32_t addr,
+                        uint32_t size) const;
+  void trace_access(const decoded_insn &d, trace_record &r) const;
+  void end_trace(const decoded_insn &d, trace_record &r);
+  void trace_compressed(const decoded_insn &d, const char *hdr);
+  static bool ends_block(const decoded_insn &d);
+  basic_block *build_block(uint32_t start);
 
   // misc
-  void exec_illegal_insn(std::ostream *);
-  void exec_lui(uint32_t insn, std::ostream *);
-  void exec_auipc(uint32_t insn, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_illegal_insn(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_block_end(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_lui(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_auipc(const decoded_insn &, std::ostream *);
 
   // j type
-  void exec_jal(uint32_t insn, std::ostream *);
-  void exec_jalr(uint32_t insn, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_jal(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_jalr(const decoded_insn &, std::ostream *);
 
   // opcode rtype
-  void exec_add(uint32_t insn, std::ostream *);
-  void exec_sub(uint32_t insn, std::ostream *);
-  void exec_and(uint32_t insn, std::ostream *);
-  void exec_or(uint32_t insn, std::ostream *);
-  void exec_sll(uint32_t insn, std::ostream *);
-  void exec_slt(uint32_t insn, std::ostream *);
-  void exec_sltu(uint32_t insn, std::ostream *);
-  void exec_sra(uint32_t insn, std::ostream *);
-  void exec_srl(uint32_t insn, std::ostream *);
-  void exec_xor(uint32_t insn, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_add(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_sub(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_and(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_or(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_sll(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_slt(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_sltu(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_sra(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_srl(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_xor(const decoded_insn &, std::ostream *);
+
+  // opcode rtype, RV32M
+  template <bool CHAIN, bool TRACE>
+  void exec_mul(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_mulh(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_mulhsu(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_mulhu(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_div(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_divu(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_rem(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_remu(const decoded_insn &, std::ostream *);
 
   // opcode alu imm
-  void exec_addi(uint32_t insn, std::ostream *);
-  void exec_andi(uint32_t insn, std::ostream *);
-  void exec_ori(uint32_t insn, std::ostream *);
-  void exec_slli(uint32_t insn, std::ostream *);
-  void exec_slti(uint32_t insn, std::ostream *);
-  void exec_sltiu(uint32_t insn, std::ostream *);
-  void exec_srai(uint32_t insn, std::ostream *);
-  void exec_srli(uint32_t insn, std::ostream *);
-  void exec_xori(uint32_t insn, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_addi(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_andi(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_ori(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_slli(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_slti(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_sltiu(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_srai(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_srli(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_xori(const decoded_insn &, std::ostream *);
 
   // opcode load_imm
-  void exec_lb(uint32_t insn, std::ostream *);
-  void exec_lh(uint32_t insn, std::ostream *);
-  void exec_lw(uint32_t insn, std::ostream *);
-  void exec_lbu(uint32_t insn, std::ostream *);
-  void exec_lhu(uint32_t insn, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_lb(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_lh(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_lw(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_lbu(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_lhu(const decoded_insn &, std::ostream *);
 
   // opcode btype
-  void exec_beq(uint32_t insn, std::ostream *);
-  void exec_bne(uint32_t insn, std::ostream *);
-  void exec_blt(uint32_t insn, std::ostream *);
-  void exec_bge(uint32_t insn, std::ostream *);
-  void exec_bltu(uint32_t insn, std::ostream *);
-  void exec_bgeu(uint32_t insn, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_beq(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_bne(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_blt(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_bge(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_bltu(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_bgeu(const decoded_insn &, std::ostream *);
 
   // opcode stype
-  void exec_sb(uint32_t insn, std::ostream *);
-  void exec_sh(uint32_t insn, std::ostream *);
-  void exec_sw(uint32_t insn, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_sb(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_sh(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_sw(const decoded_insn &, std::ostream *);
 
   // opcode system
-  void exec_ecall(std::ostream *);
-  void exec_ebreak(std::ostream *);
-  void exec_csrrw(uint32_t insn, std::ostream *);
-  void exec_csrrs(uint32_t insn, std::ostream *);
-  void exec_csrrc(uint32_t insn, std::ostream *);
-  void exec_csrrwi(uint32_t insn, std::ostream *);
-  void exec_csrrsi(uint32_t insn, std::ostream *);
-  void exec_csrrci(uint32_t insn, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_ecall(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_ebreak(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_csrrw(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_csrrs(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_csrrc(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_csrrwi(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_csrrsi(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_csrrci(const decoded_insn &, std::ostream *);
+
+  // opcode fence
+  template <bool CHAIN, bool TRACE>
+  void exec_fence(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_fence_i(const decoded_insn &, std::ostream *);
+
+  // opcode amo
+  bool check_amo_alignment(uint32_t addr);
+  template <bool CHAIN, bool TRACE>
+  void exec_lr_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_sc_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_amoswap_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_amoadd_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_amoxor_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_amoand_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_amoor_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_amomin_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_amomax_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_amominu_w(const decoded_insn &, std::ostream *);
+  template <bool CHAIN, bool TRACE>
+  void exec_amomaxu_w(const decoded_insn &, std::ostream *);
 
   bool halt = {false};
   std::string halt_reason = {" none "};
@@ -155,7 +494,27 @@ private:
   uint64_t insn_counter = {0};
   uint32_t pc = {0x0};
   uint32_t mhartid = {0x0};
+  csr_file csrs = {insn_counter, mhartid};
+  bool compressed = {false};            // RV32C enabled
+  uint32_t align_mask = {3};            // pc bits that must be clear
+
+  // LR.W reservation; SC.W succeeds if the word still holds reserve_value
+  bool reserved = {false};
+  uint32_t reserve_addr = {0x0};
+  uint32_t reserve_value = {0x0};
+  bool sc_ok = {false};                 // how the last SC.W went, for -t
+
+  std::atomic<bool> stop = {false};     // see request_stop()
 
   bool show_regs = {false};
   bool show_insns = {false};
+  const symbol_table *symbols = nullptr;
+  trace_writer *trace = nullptr;
+  profiler *prof = nullptr;
+  cache_hierarchy *caches = nullptr;
+  branch_model *bpred = nullptr;
+
+  predecode_cache icache;
+  block_cache bcache;
+  std::unique_ptr<rv32i_jit> jit;
 };
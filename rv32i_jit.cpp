@@ -0,0 +1,527 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+
+	I certify that this is my own work and where appropriate an extension
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file rv32i_jit.cpp
+ * @brief Implementation of the x86-64 block translator.
+ *
+ * Generated code uses the System V calling convention. rbx holds the guest
+ * register array and r12 the jit_context for the whole block; eax, ecx and
+ * edx are scratch. Guest registers live in memory and are loaded and stored
+ * around every instruction, which keeps the translator simple and still
+ * removes all of the dispatch and decode work.
+ ********************************************************************************/
+#include "rv32i_jit.h"
+#include <cstring>
+#include <sys/mman.h>
+
+namespace {
+
+// host register numbers used in ModRM bytes
+constexpr int host_eax = 0;
+constexpr int host_ecx = 1;
+
+// condition codes for jcc/setcc
+constexpr uint8_t cc_b = 0x2;
+constexpr uint8_t cc_ae = 0x3;
+constexpr uint8_t cc_e = 0x4;
+constexpr uint8_t cc_ne = 0x5;
+constexpr uint8_t cc_l = 0xc;
+constexpr uint8_t cc_ge = 0xd;
+
+/*
+ * Memory helpers called from generated code. The store helpers return
+ * non-zero when the store hit watched code so the block can bail out.
+ */
+uint32_t jit_lb(jit_context *c, uint32_t addr) { return c->mem->get8_sx(addr); }
+uint32_t jit_lh(jit_context *c, uint32_t addr) { return c->mem->get16_sx(addr); }
+uint32_t jit_lw(jit_context *c, uint32_t addr) { return c->mem->get32_sx(addr); }
+uint32_t jit_lbu(jit_context *c, uint32_t addr) { return c->mem->get8(addr); }
+uint32_t jit_lhu(jit_context *c, uint32_t addr) { return c->mem->get16(addr); }
+
+uint32_t jit_sb(jit_context *c, uint32_t addr, uint32_t val) {
+  c->mem->set8(addr, val);
+  return c->bcache->is_stale();
+}
+
+uint32_t jit_sh(jit_context *c, uint32_t addr, uint32_t val) {
+  c->mem->set16(addr, val);
+  return c->bcache->is_stale();
+}
+
+uint32_t jit_sw(jit_context *c, uint32_t addr, uint32_t val) {
+  c->mem->set32(addr, val);
+  return c->bcache->is_stale();
+}
+
+} // namespace
+
+/**
+ * @brief Constructs a JIT for one hart.
+ *
+ * The code buffer is mapped up front. If that fails the JIT quietly
+ * never compiles anything.
+ *
+ * @param regs The hart's register array.
+ * @param m The memory the hart runs in.
+ * @param bc The hart's block cache.
+ * @param threshold The number of runs before a block is compiled.
+ ********************************************************************************/
+rv32i_jit::rv32i_jit(int32_t *regs, memory &m, block_cache &bc,
+                     uint32_t threshold)
+    : threshold(threshold) {
+  ctx.regs = regs;
+  ctx.mem = &m;
+  ctx.bcache = &bc;
+
+  if (!is_supported())
+    return;
+
+  void *p = mmap(nullptr, code_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p != MAP_FAILED)
+    buf = static_cast<uint8_t *>(p);
+}
+
+/**
+ * @brief Releases the executable code buffer.
+ ********************************************************************************/
+rv32i_jit::~rv32i_jit() {
+  if (buf != nullptr)
+    munmap(buf, code_size);
+}
+
+/**
+ * @brief Checks if native code can be generated on this host.
+ * @return true on x86-64.
+ ********************************************************************************/
+bool rv32i_jit::is_supported() {
+#if defined(__x86_64__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Throws away all generated code.
+ ********************************************************************************/
+void rv32i_jit::reset() {
+  used = 0;
+  full = false;
+}
+
+/**
+ * @brief Translates a block and installs it in the code buffer.
+ *
+ * Translation stops at the first instruction that has no native
+ * equivalent; the generated code then returns that instruction's address
+ * so the hart can interpret the rest of the block. A block whose first
+ * instruction cannot be translated is marked so it is never tried again.
+ *
+ * @param b The block to translate.
+ ********************************************************************************/
+void rv32i_jit::compile(basic_block &b) {
+  if (buf == nullptr) {
+    b.no_native = true;
+    return;
+  }
+  if (code_size - used < max_block_code) {
+    full = true;
+    return;
+  }
+
+  code.clear();
+  emit8(0x53);                                  // push rbx
+  emit8(0x41); emit8(0x54);                     // push r12
+  emit8(0x48); emit8(0x83); emit8(0xec); emit8(0x08); // sub rsp,8
+  emit8(0x49); emit8(0x89); emit8(0xfc);        // mov r12,rdi
+  emit8(0x48); emit8(0x8b); emit8(0x1f);        // mov rbx,[rdi]
+
+  uint32_t pc = b.start;
+  uint32_t n = 0;
+  bool ends = false;
+  for (const decoded_insn &d : b.insns) {
+    if (!emit_insn(d, pc, n + 1, ends))
+      break;
+    ++n;
+    pc += d.len;
+    if (ends)
+      break;
+  }
+
+  if (n == 0) {
+    b.no_native = true;
+    return;
+  }
+  if (!ends)
+    emit_exit(pc, n);
+
+  // flip just the pages being written so the rest stays executable
+  uint8_t *dst = buf + used;
+  uintptr_t lo = reinterpret_cast<uintptr_t>(dst) & ~uintptr_t(4095);
+  uintptr_t hi = (reinterpret_cast<uintptr_t>(dst) + code.size() + 4095) &
+                 ~uintptr_t(4095);
+  void *page = reinterpret_cast<void *>(lo);
+  mprotect(page, hi - lo, PROT_READ | PROT_WRITE);
+  std::memcpy(dst, code.data(), code.size());
+  mprotect(page, hi - lo, PROT_READ | PROT_EXEC);
+
+  used += (code.size() + 15) & ~size_t(15);
+  b.native = reinterpret_cast<uint64_t (*)(jit_context *)>(dst);
+}
+
+/**
+ * @brief Emits native code for one instruction.
+ *
+ * Field decoding mirrors rv32i_hart::predecode so the translation always
+ * agrees with the interpreter about what an instruction word means. The
+ * block_end sentinel and words the decode table rejected are never
+ * translated.
+ *
+ * @param d The decoded instruction.
+ * @param pc The guest address of the instruction.
+ * @param count The number of instructions retired once this one is done.
+ * @param ends Set to true if the code emitted leaves the block.
+ * @return false if the instruction has no native translation.
+ ********************************************************************************/
+bool rv32i_jit::emit_insn(const decoded_insn &d, uint32_t pc, uint32_t count,
+                          bool &ends) {
+  if (d.op == op_block_end || d.op == op_illegal_insn)
+    return false;
+
+  uint32_t insn = d.insn;
+  uint32_t funct3 = get_funct3(insn);
+  uint32_t funct7 = get_funct7(insn);
+
+  switch (get_opcode(insn)) {
+  case opcode_lui: {
+    emit8(0xb8);                                // mov eax,imm32
+    emit32(d.imm);
+    emit_store_reg(d.rd);
+    return true;
+  }
+
+  case opcode_auipc: {
+    emit8(0xb8);                                // mov eax,imm32
+    emit32(pc + d.imm);
+    emit_store_reg(d.rd);
+    return true;
+  }
+
+  case opcode_jal: {
+    if (d.rd != 0) {
+      emit8(0xc7); emit8(0x43); emit8(d.rd * 4); // mov dword [rbx+rd*4],imm32
+      emit32(pc + d.len);
+    }
+    emit_exit(pc + d.imm, count);
+    ends = true;
+    return true;
+  }
+
+  case opcode_jalr: {
+    emit_load_reg(host_eax, d.rs1);
+    emit8(0x05);                                // add eax,imm32
+    emit32(d.imm);
+    emit8(0x25);                                // and eax,0xfffffffe
+    emit32(0xfffffffe);
+    if (d.rd != 0) {
+      emit8(0xc7); emit8(0x43); emit8(d.rd * 4); // mov dword [rbx+rd*4],imm32
+      emit32(pc + d.len);
+    }
+    emit_exit_eax(count);
+    ends = true;
+    return true;
+  }
+
+  case opcode_btype: {
+    uint8_t cc;
+    switch (funct3) {
+    case funct3_beq:  cc = cc_e;  break;
+    case funct3_bne:  cc = cc_ne; break;
+    case funct3_blt:  cc = cc_l;  break;
+    case funct3_bge:  cc = cc_ge; break;
+    case funct3_bltu: cc = cc_b;  break;
+    case funct3_bgeu: cc = cc_ae; break;
+    default:
+      return false;
+    }
+    emit_load_reg(host_eax, d.rs1);
+    emit_load_reg(host_ecx, d.rs2);
+    emit8(0x39); emit8(0xc8);                   // cmp eax,ecx
+    size_t taken = emit_jcc32(cc);
+    emit_exit(pc + d.len, count);
+    patch32(taken);
+    emit_exit(pc + d.imm, count);
+    ends = true;
+    return true;
+  }
+
+  case opcode_load_imm: {
+    uint64_t fn;
+    switch (funct3) {
+    case funct3_lb:  fn = reinterpret_cast<uint64_t>(&jit_lb);  break;
+    case funct3_lh:  fn = reinterpret_cast<uint64_t>(&jit_lh);  break;
+    case funct3_lw:  fn = reinterpret_cast<uint64_t>(&jit_lw);  break;
+    case funct3_lbu: fn = reinterpret_cast<uint64_t>(&jit_lbu); break;
+    case funct3_lhu: fn = reinterpret_cast<uint64_t>(&jit_lhu); break;
+    default:
+      return false;
+    }
+    emit_load_reg(host_eax, d.rs1);
+    emit8(0x05);                                // add eax,imm32
+    emit32(d.imm);
+    emit8(0x4c); emit8(0x89); emit8(0xe7);      // mov rdi,r12
+    emit8(0x89); emit8(0xc6);                   // mov esi,eax
+    emit_call(fn);
+    emit_store_reg(d.rd);
+    return true;
+  }
+
+  case opcode_stype: {
+    uint64_t fn;
+    switch (funct3) {
+    case funct3_sb: fn = reinterpret_cast<uint64_t>(&jit_sb); break;
+    case funct3_sh: fn = reinterpret_cast<uint64_t>(&jit_sh); break;
+    case funct3_sw: fn = reinterpret_cast<uint64_t>(&jit_sw); break;
+    default:
+      return false;
+    }
+    emit_load_reg(host_eax, d.rs1);
+    emit8(0x05);                                // add eax,imm32
+    emit32(d.imm);
+    emit_load_reg(host_ecx, d.rs2);
+    emit8(0x4c); emit8(0x89); emit8(0xe7);      // mov rdi,r12
+    emit8(0x89); emit8(0xc6);                   // mov esi,eax
+    emit8(0x89); emit8(0xca);                   // mov edx,ecx
+    emit_call(fn);
+    emit8(0x85); emit8(0xc0);                   // test eax,eax
+    size_t skip = emit_jcc8(cc_e);
+    emit_exit(pc + d.len, count);
+    patch8(skip);
+    return true;
+  }
+
+  case opcode_rtype: {
+    emit_load_reg(host_eax, d.rs1);
+    emit_load_reg(host_ecx, d.rs2);
+    if (funct7 == funct7_muldiv) {
+      // divide and mulhsu stay in the interpreter, which checks the cases
+      // that would fault on the host
+      switch (funct3) {
+      case funct3_mul:
+        emit8(0x0f); emit8(0xaf); emit8(0xc1); // imul eax,ecx
+        break;
+      case funct3_mulh:
+        emit8(0xf7); emit8(0xe9);               // imul ecx
+        emit8(0x89); emit8(0xd0);               // mov eax,edx
+        break;
+      case funct3_mulhu:
+        emit8(0xf7); emit8(0xe1);               // mul ecx
+        emit8(0x89); emit8(0xd0);               // mov eax,edx
+        break;
+      default:
+        return false;
+      }
+      emit_store_reg(d.rd);
+      return true;
+    }
+    switch (funct3) {
+    case funct3_add:
+      if (funct7 == funct7_add) {
+        emit8(0x01); emit8(0xc8);               // add eax,ecx
+      } else if (funct7 == funct7_sub) {
+        emit8(0x29); emit8(0xc8);               // sub eax,ecx
+      } else
+        return false;
+      break;
+    case funct3_and: emit8(0x21); emit8(0xc8); break; // and eax,ecx
+    case funct3_or:  emit8(0x09); emit8(0xc8); break; // or eax,ecx
+    case funct3_xor: emit8(0x31); emit8(0xc8); break; // xor eax,ecx
+    case funct3_sll: emit8(0xd3); emit8(0xe0); break; // shl eax,cl
+    case funct3_srx:
+      if (funct7 == funct7_sra) {
+        emit8(0xd3); emit8(0xf8);               // sar eax,cl
+      } else if (funct7 == funct7_srl) {
+        emit8(0xd3); emit8(0xe8);               // shr eax,cl
+      } else
+        return false;
+      break;
+    case funct3_slt:
+    case funct3_sltu:
+      emit8(0x39); emit8(0xc8);                 // cmp eax,ecx
+      emit8(0x0f); emit8(0x90 | (funct3 == funct3_slt ? cc_l : cc_b));
+      emit8(0xc0);                              // setcc al
+      emit8(0x0f); emit8(0xb6); emit8(0xc0);    // movzx eax,al
+      break;
+    default:
+      return false;
+    }
+    emit_store_reg(d.rd);
+    return true;
+  }
+
+  case opcode_alu_imm: {
+    emit_load_reg(host_eax, d.rs1);
+    switch (funct3) {
+    case funct3_add: emit8(0x05); emit32(d.imm); break; // add eax,imm32
+    case funct3_and: emit8(0x25); emit32(d.imm); break; // and eax,imm32
+    case funct3_or:  emit8(0x0d); emit32(d.imm); break; // or eax,imm32
+    case funct3_xor: emit8(0x35); emit32(d.imm); break; // xor eax,imm32
+    case funct3_sll:
+      emit8(0xc1); emit8(0xe0); emit8(d.imm);   // shl eax,imm8
+      break;
+    case funct3_srx:
+      emit8(0xc1);
+      emit8((funct7 & funct7_sra) ? 0xf8 : 0xe8); // sar/shr eax,imm8
+      emit8(d.imm);
+      break;
+    case funct3_slt:
+    case funct3_sltu:
+      emit8(0x3d); emit32(d.imm);               // cmp eax,imm32
+      emit8(0x0f); emit8(0x90 | (funct3 == funct3_slt ? cc_l : cc_b));
+      emit8(0xc0);                              // setcc al
+      emit8(0x0f); emit8(0xb6); emit8(0xc0);    // movzx eax,al
+      break;
+    default:
+      return false;
+    }
+    emit_store_reg(d.rd);
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
+
+/**
+ * @brief Appends a little-endian 32-bit value.
+ * @param v The value.
+ ********************************************************************************/
+void rv32i_jit::emit32(uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    emit8(v >> (8 * i));
+}
+
+/**
+ * @brief Appends a little-endian 64-bit value.
+ * @param v The value.
+ ********************************************************************************/
+void rv32i_jit::emit64(uint64_t v) {
+  for (int i = 0; i < 8; ++i)
+    emit8(v >> (8 * i));
+}
+
+/**
+ * @brief Loads a guest register into a host register.
+ * @param host The host register number (eax or ecx).
+ * @param r The guest register number.
+ ********************************************************************************/
+void rv32i_jit::emit_load_reg(int host, uint32_t r) {
+  if (r == 0) {
+    emit8(0x31);                                // xor host,host
+    emit8(0xc0 | (host << 3) | host);
+  } else {
+    emit8(0x8b);                                // mov host,[rbx+r*4]
+    emit8(0x43 | (host << 3));
+    emit8(r * 4);
+  }
+}
+
+/**
+ * @brief Stores eax into a guest register. Writes to x0 are dropped.
+ * @param r The guest register number.
+ ********************************************************************************/
+void rv32i_jit::emit_store_reg(uint32_t r) {
+  if (r == 0)
+    return;
+  emit8(0x89); emit8(0x43); emit8(r * 4);       // mov [rbx+r*4],eax
+}
+
+/**
+ * @brief Calls a helper through rax.
+ * @param fn The address of the helper.
+ ********************************************************************************/
+void rv32i_jit::emit_call(uint64_t fn) {
+  emit8(0x48); emit8(0xb8);                     // mov rax,imm64
+  emit64(fn);
+  emit8(0xff); emit8(0xd0);                     // call rax
+}
+
+/**
+ * @brief Returns a constant pc and retired instruction count.
+ * @param pc The next pc.
+ * @param count The number of instructions retired.
+ ********************************************************************************/
+void rv32i_jit::emit_exit(uint32_t pc, uint32_t count) {
+  emit8(0x48); emit8(0xb8);                     // mov rax,imm64
+  emit64((uint64_t(count) << 32) | pc);
+  emit_epilogue();
+}
+
+/**
+ * @brief Returns the pc in eax and a constant retired instruction count.
+ * @param count The number of instructions retired.
+ ********************************************************************************/
+void rv32i_jit::emit_exit_eax(uint32_t count) {
+  emit8(0x89); emit8(0xc0);                     // mov eax,eax
+  emit8(0x48); emit8(0xba);                     // mov rdx,imm64
+  emit64(uint64_t(count) << 32);
+  emit8(0x48); emit8(0x09); emit8(0xd0);        // or rax,rdx
+  emit_epilogue();
+}
+
+/**
+ * @brief Undoes the prologue and returns.
+ ********************************************************************************/
+void rv32i_jit::emit_epilogue() {
+  emit8(0x48); emit8(0x83); emit8(0xc4); emit8(0x08); // add rsp,8
+  emit8(0x41); emit8(0x5c);                     // pop r12
+  emit8(0x5b);                                  // pop rbx
+  emit8(0xc3);                                  // ret
+}
+
+/**
+ * @brief Emits a jcc with a 32-bit displacement to be patched later.
+ * @param cc The condition code.
+ * @return The offset of the displacement.
+ ********************************************************************************/
+size_t rv32i_jit::emit_jcc32(uint8_t cc) {
+  emit8(0x0f); emit8(0x80 | cc);
+  size_t at = code.size();
+  emit32(0);
+  return at;
+}
+
+/**
+ * @brief Emits a short jcc with an 8-bit displacement to be patched later.
+ * @param cc The condition code.
+ * @return The offset of the displacement.
+ ********************************************************************************/
+size_t rv32i_jit::emit_jcc8(uint8_t cc) {
+  emit8(0x70 | cc);
+  size_t at = code.size();
+  emit8(0);
+  return at;
+}
+
+/**
+ * @brief Points a 32-bit displacement at the current end of the code.
+ * @param at The offset of the displacement.
+ ********************************************************************************/
+void rv32i_jit::patch32(size_t at) {
+  uint32_t rel = code.size() - (at + 4);
+  for (int i = 0; i < 4; ++i)
+    code[at + i] = rel >> (8 * i);
+}
+
+/**
+ * @brief Points an 8-bit displacement at the current end of the code.
+ * @param at The offset of the displacement.
+ ********************************************************************************/
+void rv32i_jit::patch8(size_t at) { code[at] = code.size() - (at + 1); }
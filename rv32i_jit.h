@@ -0,0 +1,141 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+
+	I certify that this is my own work and where appropriate an extension
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "block_cache.h"
+#include "memory.h"
+#include "rv32i_decode.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct jit_context
+ * @brief State handed to every piece of generated code.
+ *
+ * The generated code keeps a pointer to this in a callee-saved register and
+ * passes it along to the load and store helpers.
+ ********************************************************************************/
+struct jit_context {
+  int32_t *regs = nullptr;        // must stay first, the prologue loads it
+  memory *mem = nullptr;
+  block_cache *bcache = nullptr;
+};
+
+/**
+ * @class rv32i_jit
+ * @brief Translates hot basic blocks into native x86-64 code.
+ *
+ * Every RV32I instruction the hart executes is translated except the
+ * system instructions (ecall, ebreak and the CSR group) and illegal
+ * instructions. A block ending in one of those gets native code for
+ * everything before it and the hart interprets the rest.
+ *
+ * Generated code returns the next pc in the low 32 bits and the number of
+ * guest instructions it retired in the high 32 bits. A store that hits
+ * watched code returns early so the caller can flush its caches.
+ *
+ * On hosts other than x86-64 nothing is ever compiled and every block
+ * keeps running in the interpreter.
+ ********************************************************************************/
+class rv32i_jit : public rv32i_decode {
+public:
+  static constexpr uint32_t default_threshold = 50;
+
+  /**
+   * @brief Constructs a JIT for one hart.
+   * @param regs The hart's register array.
+   * @param m The memory the hart runs in.
+   * @param bc The hart's block cache.
+   * @param threshold The number of runs before a block is compiled.
+   ****************************************************************************/
+  rv32i_jit(int32_t *regs, memory &m, block_cache &bc,
+            uint32_t threshold = default_threshold);
+
+  /**
+   * @brief Releases the executable code buffer.
+   ****************************************************************************/
+  ~rv32i_jit();
+
+  rv32i_jit(const rv32i_jit &) = delete;
+  rv32i_jit &operator=(const rv32i_jit &) = delete;
+
+  /**
+   * @brief Checks if native code can be generated on this host.
+   * @return true on x86-64.
+   ****************************************************************************/
+  static bool is_supported();
+
+  /**
+   * @brief Counts one run of a block and compiles it once it is hot.
+   * @param b The block that is about to run.
+   ****************************************************************************/
+  void note_run(basic_block &b) {
+    if (b.native == nullptr && !b.no_native && ++b.hits >= threshold)
+      compile(b);
+  }
+
+  /**
+   * @brief Runs the native code for a compiled block.
+   * @param b A block with native code.
+   * @param pc Set to the pc the native code stopped at.
+   * @return The number of guest instructions retired.
+   ****************************************************************************/
+  uint32_t run(const basic_block &b, uint32_t &pc) {
+    uint64_t r = b.native(&ctx);
+    pc = static_cast<uint32_t>(r);
+    return static_cast<uint32_t>(r >> 32);
+  }
+
+  /**
+   * @brief Checks if the code buffer ran out of space.
+   *
+   * The owner should flush its block cache and call reset(), since blocks
+   * can no longer be compiled until it does.
+   *
+   * @return true if the code buffer is full.
+   ****************************************************************************/
+  bool is_full() const { return full; }
+
+  /**
+   * @brief Throws away all generated code.
+   *
+   * Only call this after the block cache has been flushed, since cached
+   * blocks point into the code buffer.
+   ****************************************************************************/
+  void reset();
+
+private:
+  static constexpr size_t code_size = 16 * 1024 * 1024;
+  static constexpr size_t max_block_code = 8 * 1024;
+
+  void compile(basic_block &b);
+  bool emit_insn(const decoded_insn &d, uint32_t pc, uint32_t count,
+                 bool &ends);
+
+  // x86-64 encoding helpers
+  void emit8(uint8_t b) { code.push_back(b); }
+  void emit32(uint32_t v);
+  void emit64(uint64_t v);
+  void emit_load_reg(int host, uint32_t r);
+  void emit_store_reg(uint32_t r);
+  void emit_call(uint64_t fn);
+  void emit_exit(uint32_t pc, uint32_t count);
+  void emit_exit_eax(uint32_t count);
+  void emit_epilogue();
+  size_t emit_jcc32(uint8_t cc);
+  size_t emit_jcc8(uint8_t cc);
+  void patch32(size_t at);
+  void patch8(size_t at);
+
+  jit_context ctx;
+  uint32_t threshold;
+
+  uint8_t *buf = nullptr;          // executable code buffer
+  size_t used = 0;
+  bool full = {false};
+  std::vector<uint8_t> code;       // the block being assembled
+};
@@ -0,0 +1,145 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file snapshot.cpp
+ * @brief Implementation of snapshot saving and restoring.
+ ********************************************************************************/
+#include "snapshot.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @brief Reads and checks a snapshot's header.
+ * @param fd The open snapshot file.
+ * @param h Set to the header.
+ * @return true if the header is one this version can read.
+ ********************************************************************************/
+static bool read_header(int fd, snapshot_header &h) {
+  snapshot_header want;
+  return pread(fd, &h, sizeof(h), 0) == ssize_t(sizeof(h)) &&
+         std::memcmp(h.magic, want.magic, sizeof(h.magic)) == 0 &&
+         h.version == snapshot_header::current_version;
+}
+
+/**
+ * @brief Writes a snapshot of a hart and its memory.
+ * @param fname The path of the snapshot file.
+ * @param h The hart.
+ * @param mem The memory the hart runs in.
+ * @return true if the snapshot was written.
+ ********************************************************************************/
+bool snapshot::save(const std::string &fname, const rv32i_hart &h,
+                    const memory &mem) {
+  std::vector<snapshot_page> pages = mem.get_pages();
+
+  snapshot_header hdr;
+  hdr.page_count = uint32_t(pages.size());
+  hdr.memory_size = mem.get_size();
+  uint64_t index_end = sizeof(snapshot_header) + sizeof(snapshot_hart) +
+                       pages.size() * sizeof(snapshot_page);
+  hdr.data_offset = (index_end + memory::page_size - 1) &
+                    ~uint64_t(memory::page_size - 1);
+
+  snapshot_hart state;
+  h.save(state);
+
+  std::string tmp = fname + ".tmp";
+  std::ofstream out(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cerr << "Can't open file '" << tmp << "' for writing.\n";
+    return false;
+  }
+  out.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+  out.write(reinterpret_cast<const char *>(&state), sizeof(state));
+  out.write(reinterpret_cast<const char *>(pages.data()),
+            pages.size() * sizeof(snapshot_page));
+
+  std::vector<char> pad(hdr.data_offset - index_end, 0);
+  out.write(pad.data(), pad.size());
+  for (const snapshot_page &e : pages)
+    if (e.kind == snapshot_page::data)
+      out.write(reinterpret_cast<const char *>(mem.get_page_data(e.page)),
+                memory::page_size);
+
+  out.close();
+  if (!out || std::rename(tmp.c_str(), fname.c_str()) != 0) {
+    std::cerr << "Can't write snapshot '" << fname << "'.\n";
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Reads the memory size a snapshot was taken with.
+ * @param fname The path of the snapshot file.
+ * @param size Set to the memory size.
+ * @return true if fname is a snapshot this version can read.
+ ********************************************************************************/
+bool snapshot::read_memory_size(const std::string &fname, uint64_t &size) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Can't open file '" << fname << "' for reading.\n";
+    return false;
+  }
+  snapshot_header hdr;
+  bool ok = read_header(fd, hdr);
+  close(fd);
+  if (!ok) {
+    std::cerr << "'" << fname << "' is not a snapshot.\n";
+    return false;
+  }
+  size = hdr.memory_size;
+  return true;
+}
+
+/**
+ * @brief Restores a hart and its memory from a snapshot.
+ *
+ * The file can be closed once its pages are mapped; the mappings keep it
+ * alive until the memory is destroyed.
+ *
+ * @param fname The path of the snapshot file.
+ * @param h The hart.
+ * @param mem A memory of the snapshot's size that has not been written.
+ * @return true if the snapshot was restored.
+ ********************************************************************************/
+bool snapshot::restore(const std::string &fname, rv32i_hart &h, memory &mem) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Can't open file '" << fname << "' for reading.\n";
+    return false;
+  }
+
+  snapshot_header hdr;
+  snapshot_hart state;
+  std::vector<snapshot_page> pages;
+  bool ok = read_header(fd, hdr) && hdr.memory_size == mem.get_size() &&
+            pread(fd, &state, sizeof(state), sizeof(hdr)) ==
+                ssize_t(sizeof(state));
+  if (ok) {
+    size_t len = size_t(hdr.page_count) * sizeof(snapshot_page);
+    pages.resize(hdr.page_count);
+    ok = pread(fd, pages.data(), len, sizeof(hdr) + sizeof(state)) ==
+             ssize_t(len) &&
+         mem.load_pages(fd, hdr.data_offset, pages);
+  }
+  close(fd);
+
+  if (!ok) {
+    std::cerr << "'" << fname << "' is not a valid snapshot.\n";
+    return false;
+  }
+  h.restore(state);
+  return true;
+}
@@ -0,0 +1,59 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "memory.h"
+#include "rv32i_hart.h"
+#include <cstdint>
+#include <string>
+
+/**
+ * @class snapshot
+ * @brief Saves and restores a hart and its memory.
+ *
+ * See snapshot_format.h for the file layout. A snapshot only stores the
+ * pages that were written, and restoring one maps them from the file, so
+ * a run that took minutes to reach a point can be resumed from it at
+ * once, any number of times.
+ ********************************************************************************/
+class snapshot {
+public:
+  /**
+   * @brief Writes a snapshot of a hart and its memory.
+   *
+   * The file is written under a temporary name and renamed into place,
+   * so an older snapshot of the same name is only replaced by a complete
+   * one.
+   *
+   * @param fname The path of the snapshot file.
+   * @param h The hart.
+   * @param mem The memory the hart runs in.
+   * @return true if the snapshot was written.
+   ****************************************************************************/
+  static bool save(const std::string &fname, const rv32i_hart &h,
+                   const memory &mem);
+
+  /**
+   * @brief Reads the memory size a snapshot was taken with.
+   *
+   * The memory to restore into has to be constructed with this size.
+   *
+   * @param fname The path of the snapshot file.
+   * @param size Set to the memory size.
+   * @return true if fname is a snapshot this version can read.
+   ****************************************************************************/
+  static bool read_memory_size(const std::string &fname, uint64_t &size);
+
+  /**
+   * @brief Restores a hart and its memory from a snapshot.
+   * @param fname The path of the snapshot file.
+   * @param h The hart, which is reset first.
+   * @param mem A memory of the snapshot's size that has not been written.
+   * @return true if the snapshot was restored.
+   ****************************************************************************/
+  static bool restore(const std::string &fname, rv32i_hart &h, memory &mem);
+};
@@ -0,0 +1,84 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include <cstdint>
+
+/**
+ * @file snapshot_format.h
+ * @brief On-disk layout of simulator snapshots.
+ *
+ * A snapshot file is a snapshot_header, a snapshot_hart, page_count
+ * snapshot_page entries, and then the contents of every data page, the
+ * first one starting at a multiple of memory::page_size so the pages can
+ * be mapped straight from the file. Pages that still read as fill bytes
+ * are left out. Like traces, every field is stored in host byte order.
+ ********************************************************************************/
+
+/**
+ * @struct snapshot_header
+ * @brief Identifies a snapshot file and gives the memory's shape.
+ ********************************************************************************/
+struct snapshot_header {
+  static constexpr uint32_t current_version = 3;
+
+  char magic[8] = {'R', 'V', '3', '2', 'S', 'N', 'P', '\0'};
+  uint32_t version = current_version;
+  uint32_t page_count = 0;       // snapshot_page entries after the hart
+  uint64_t memory_size = 0;
+  uint64_t data_offset = 0;      // file offset of the first data page
+};
+
+/**
+ * @struct snapshot_hart
+ * @brief Everything about a hart that a restored run needs.
+ *
+ * The predecode and block caches are not saved; they refill as the
+ * restored hart runs.
+ ********************************************************************************/
+struct snapshot_hart {
+  uint64_t insn_counter = 0;
+  uint64_t cycle_offset = 0;     // set by writes to mcycle and minstret
+  uint64_t instret_offset = 0;
+  uint32_t mstatus = 0;          // machine-mode CSRs, as in csr_file
+  uint32_t mie = 0;
+  uint32_t mtvec = 0;
+  uint32_t mscratch = 0;
+  uint32_t mepc = 0;
+  uint32_t mcause = 0;
+  uint32_t mtval = 0;
+  uint32_t csr_pad = 0;
+  uint32_t pc = 0;
+  uint32_t mhartid = 0;
+  uint32_t regs[32] = {};
+  uint32_t reserve_addr = 0;     // LR.W reservation, if reserved
+  uint32_t reserve_value = 0;
+  uint8_t halt = 0;
+  uint8_t reserved = 0;
+  uint8_t compressed = 0;        // RV32C enabled
+  uint8_t pad = 0;
+  char halt_reason[64] = {};     // NUL-terminated
+};
+
+/**
+ * @struct snapshot_page
+ * @brief One page of memory that does not read as fill bytes.
+ *
+ * A data page's contents are in the data area, in the same order as the
+ * data entries of the index. A zero page has none.
+ ********************************************************************************/
+struct snapshot_page {
+  static constexpr uint32_t data = 0;
+  static constexpr uint32_t zero = 1;     // all zero, e.g. ELF BSS
+
+  uint32_t page = 0;             // address >> memory::page_bits
+  uint32_t kind = data;
+};
+
+static_assert(sizeof(snapshot_header) == 32,
+              "snapshot_header must stay 32 bytes");
+static_assert(sizeof(snapshot_page) == 8, "snapshot_page must stay 8 bytes");
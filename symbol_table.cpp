@@ -0,0 +1,71 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file symbol_table.cpp
+ * @brief Implementation of the guest symbol table.
+ ********************************************************************************/
+#include "symbol_table.h"
+#include "hex.h"
+#include <sstream>
+
+/**
+ * @brief Adds a symbol.
+ * @param addr The address the symbol starts at.
+ * @param size The size of the object or function in bytes, or 0.
+ * @param name The symbol's name.
+ ********************************************************************************/
+void symbol_table::add(uint32_t addr, uint32_t size, const std::string &name) {
+  symbol s;
+  s.addr = addr;
+  s.size = size;
+  s.name = name;
+  syms.emplace(addr, s);
+}
+
+/**
+ * @brief Finds the symbol that starts exactly at addr.
+ * @param addr The address to look up.
+ * @return The symbol, or nullptr if none starts there.
+ ********************************************************************************/
+const symbol *symbol_table::at(uint32_t addr) const {
+  auto it = syms.find(addr);
+  return it == syms.end() ? nullptr : &it->second;
+}
+
+/**
+ * @brief Finds the symbol whose range contains addr.
+ * @param addr The address to look up.
+ * @return The symbol, or nullptr if there is none.
+ ********************************************************************************/
+const symbol *symbol_table::containing(uint32_t addr) const {
+  auto it = syms.upper_bound(addr);
+  if (it == syms.begin())
+    return nullptr;
+
+  const symbol &s = (--it)->second;
+  if (s.size != 0 && addr - s.addr >= s.size)
+    return nullptr;
+  return &s;
+}
+
+/**
+ * @brief Formats an address as name+offset.
+ * @param addr The address to name.
+ * @return The symbolic name, or the address in hex if there is none.
+ ********************************************************************************/
+std::string symbol_table::name_of(uint32_t addr) const {
+  const symbol *s = containing(addr);
+  if (s == nullptr)
+    return hex::to_hex0x32(addr);
+  if (s->addr == addr)
+    return s->name;
+
+  std::ostringstream os;
+  os << s->name << "+0x" << std::hex << (addr - s->addr);
+  return os.str();
+}
@@ -0,0 +1,77 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * @struct symbol
+ * @brief A named address range from a program's symbol table.
+ ********************************************************************************/
+struct symbol {
+  uint32_t addr = 0;
+  uint32_t size = 0;     // 0 when the symbol table gave no size
+  std::string name;
+};
+
+/**
+ * @class symbol_table
+ * @brief Maps guest addresses back to the functions and labels at them.
+ *
+ * Filled in by the ELF loader and used to label disassembly, traces and
+ * profiles. A flat binary has an empty table.
+ ********************************************************************************/
+class symbol_table {
+public:
+  /**
+   * @brief Adds a symbol.
+   *
+   * If two symbols start at the same address the first one added is kept.
+   *
+   * @param addr The address the symbol starts at.
+   * @param size The size of the object or function in bytes, or 0.
+   * @param name The symbol's name.
+   ****************************************************************************/
+  void add(uint32_t addr, uint32_t size, const std::string &name);
+
+  /**
+   * @brief Checks if the table has no symbols.
+   * @return true if no symbols have been added.
+   ****************************************************************************/
+  bool empty() const { return syms.empty(); }
+
+  /**
+   * @brief Finds the symbol that starts exactly at addr.
+   * @param addr The address to look up.
+   * @return The symbol, or nullptr if none starts there.
+   ****************************************************************************/
+  const symbol *at(uint32_t addr) const;
+
+  /**
+   * @brief Finds the symbol whose range contains addr.
+   *
+   * A symbol without a size is taken to run up to the next symbol.
+   *
+   * @param addr The address to look up.
+   * @return The symbol, or nullptr if addr is before every symbol or past
+   * the end of a sized one.
+   ****************************************************************************/
+  const symbol *containing(uint32_t addr) const;
+
+  /**
+   * @brief Formats an address as name+offset.
+   * @param addr The address to name.
+   * @return "name" or "name+0x..." if a symbol contains addr, otherwise
+   * the address in hex.
+   ****************************************************************************/
+  std::string name_of(uint32_t addr) const;
+
+private:
+  std::map<uint32_t, symbol> syms;
+};
@@ -0,0 +1,61 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include <cstdint>
+
+/**
+ * @file trace_format.h
+ * @brief On-disk layout of binary execution traces.
+ *
+ * A trace file is a trace_header followed by one trace_record per
+ * executed instruction. Every field is stored in host byte order, which
+ * the header's magic and record size let a reader sanity check.
+ ********************************************************************************/
+
+/**
+ * @struct trace_header
+ * @brief Identifies a binary trace file.
+ ********************************************************************************/
+struct trace_header {
+  static constexpr uint32_t current_version = 1;
+
+  char magic[8] = {'R', 'V', '3', '2', 'T', 'R', 'C', '\0'};
+  uint32_t version = current_version;
+  uint32_t record_size = 0;
+};
+
+/**
+ * @struct trace_record
+ * @brief What one executed instruction did.
+ *
+ * rd_value is only meaningful with has_rd, and mem_addr/mem_value only
+ * with mem_load or mem_store. For loads mem_value is the value read,
+ * extended as it is into rd, even when rd is x0; for stores it is the
+ * value stored, truncated to mem_size bytes.
+ * AMOs set both flags and mem_value is the old value they read. A failed
+ * SC.W has no mem_store flag, and an instruction that halts the hart has
+ * no flags other than compressed.
+ ********************************************************************************/
+struct trace_record {
+  static constexpr uint8_t has_rd = 0x01;
+  static constexpr uint8_t mem_load = 0x02;
+  static constexpr uint8_t mem_store = 0x04;
+  static constexpr uint8_t compressed = 0x08;  // insn is a 16-bit RV32C one
+
+  uint32_t pc = 0;
+  uint32_t insn = 0;
+  uint32_t rd_value = 0;
+  uint32_t mem_addr = 0;
+  uint32_t mem_value = 0;
+  uint8_t rd = 0;
+  uint8_t flags = 0;
+  uint8_t mem_size = 0;     // 1, 2 or 4 for loads and stores
+  uint8_t hart = 0;         // mhartid of the hart that ran it
+};
+
+static_assert(sizeof(trace_record) == 24, "trace_record must stay 24 bytes");
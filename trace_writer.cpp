@@ -0,0 +1,59 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+/**
+ * @file trace_writer.cpp
+ * @brief Implementation of the binary trace writer.
+ ********************************************************************************/
+#include "trace_writer.h"
+
+/**
+ * @brief Opens a trace file and writes its header.
+ * @param fname The path of the trace file to create.
+ * @param async true to write the file from a separate thread.
+ * @param p What to do when the async writer falls behind.
+ ********************************************************************************/
+trace_writer::trace_writer(const std::string &fname, bool async,
+                           async_writer::policy p)
+    : out(fname, std::ios::out | std::ios::binary | std::ios::trunc) {
+  buf.reserve(buffer_records);
+
+  trace_header h;
+  h.record_size = sizeof(trace_record);
+  out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  out.flush();
+  if (async)
+    this->async.reset(new async_writer(out.rdbuf(), p));
+}
+
+/**
+ * @brief Writes any buffered records and closes the file.
+ *
+ * The async writer, if any, is drained before the file is closed.
+ ********************************************************************************/
+trace_writer::~trace_writer() {
+  flush();
+  async.reset();
+}
+
+/**
+ * @brief Writes the buffered records to the file.
+ *
+ * Records are handed to the async writer in one piece, so under the drop
+ * policy a whole buffer is dropped rather than part of a record.
+ ********************************************************************************/
+void trace_writer::flush() {
+  const char *data = reinterpret_cast<const char *>(buf.data());
+  size_t n = buf.size() * sizeof(trace_record);
+  if (async) {
+    async->write(data, n);
+  } else {
+    out.write(data, n);
+    out.flush();
+  }
+  buf.clear();
+}
@@ -0,0 +1,79 @@
+/* 	Ethan Silo
+	z1838047
+	CSCI 463-PE1
+	
+	I certify that this is my own work and where appropriate an extension 
+	of the starter code provided for the assignment.
+*/
+#pragma once
+#include "async_writer.h"
+#include "trace_format.h"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class trace_writer
+ * @brief Writes binary trace records to a file in large blocks.
+ *
+ * Records are collected in memory and written out a buffer at a time, so
+ * tracing costs a copy per instruction rather than a formatted write.
+ * With async turned on the buffers go through an async_writer, so the
+ * file I/O happens on another thread.
+ ********************************************************************************/
+class trace_writer {
+public:
+  static constexpr size_t buffer_records = 64 * 1024;
+
+  /**
+   * @brief Opens a trace file and writes its header.
+   * @param fname The path of the trace file to create.
+   * @param async true to write the file from a separate thread.
+   * @param p What to do when the async writer falls behind.
+   ****************************************************************************/
+  trace_writer(const std::string &fname, bool async = false,
+               async_writer::policy p = async_writer::block);
+
+  /**
+   * @brief Writes any buffered records and closes the file.
+   ****************************************************************************/
+  ~trace_writer();
+
+  trace_writer(const trace_writer &) = delete;
+  trace_writer &operator=(const trace_writer &) = delete;
+
+  /**
+   * @brief Checks if the file was opened and every write so far succeeded.
+   * @return true if the trace is good.
+   ****************************************************************************/
+  bool good() const { return out.good(); }
+
+  /**
+   * @brief Adds a record to the trace.
+   * @param r The record.
+   ****************************************************************************/
+  void write(const trace_record &r) {
+    buf.push_back(r);
+    if (buf.size() == buffer_records)
+      flush();
+  }
+
+  /**
+   * @brief Writes the buffered records to the file.
+   ****************************************************************************/
+  void flush();
+
+  /**
+   * @brief Gets the number of records dropped by an async writer.
+   * @return The record count, always 0 unless using the drop policy.
+   ****************************************************************************/
+  uint64_t get_dropped() const {
+    return async ? async->get_dropped() / sizeof(trace_record) : 0;
+  }
+
+private:
+  std::ofstream out;
+  std::vector<trace_record> buf;
+  std::unique_ptr<async_writer> async;
+};
@@ -0,0 +1,146 @@
+/* Ethan Silo
+    z1838047
+    CSCI 463-PE1
+
+    I certify that this is my own work and where appropriate an extension
+    of the starter code provided for the assignment.
+*/
+/**
+ * @file tracedump.cpp
+ * @brief Turns a binary execution trace back into text.
+ *
+ * Reads a trace written by rv32i -t and prints one line per instruction in
+ * the same layout as rv32i -i: address, instruction word, disassembly and
+ * a comment with the register and memory values the instruction produced.
+ ********************************************************************************/
+#include "hex.h"
+#include "rv32i_decode.h"
+#include "trace_format.h"
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+static constexpr int instruction_width = 35;
+
+/**
+ * @brief Prints the usage instructions and exits.
+ ********************************************************************************/
+static void usage() {
+  std::cerr << "Usage : tracedump tracefile\n";
+  exit(1);
+}
+
+/**
+ * @brief Checks if the records in a trace come from more than one hart.
+ *
+ * Reads records until a second hart ID turns up, then puts the stream
+ * back at the first one.
+ *
+ * @param in The trace, positioned just after its header.
+ * @return true if the records hold more than one hart ID.
+ ********************************************************************************/
+static bool has_several_harts(std::istream &in) {
+  std::streampos first = in.tellg();
+  std::vector<trace_record> buf(64 * 1024);
+  bool seen = false, several = false;
+  uint8_t hart = 0;
+  while (!several && in.read(reinterpret_cast<char *>(buf.data()),
+                             buf.size() * sizeof(trace_record)).gcount()) {
+    size_t n = in.gcount() / sizeof(trace_record);
+    for (size_t i = 0; i < n && !several; ++i) {
+      several = seen && buf[i].hart != hart;
+      hart = buf[i].hart;
+      seen = true;
+    }
+  }
+  in.clear();
+  in.seekg(first);
+  return several;
+}
+
+/**
+ * @brief Prints one trace record.
+ *
+ * With several harts in the trace each line starts with the hart's ID,
+ * as with -i.
+ *
+ * @param r The record.
+ * @param show_hart true to prefix the line with "[hart] ".
+ ********************************************************************************/
+static void print_record(const trace_record &r, bool show_hart) {
+  if (show_hart)
+    std::cout << '[' << std::dec << unsigned(r.hart) << "] ";
+  if (r.flags & trace_record::compressed)
+    std::cout << hex::to_hex32(r.pc) << ": " << hex::to_hex16(r.insn)
+              << "      " << std::setw(instruction_width) << std::setfill(' ')
+              << std::left << rv32i_decode::decode_compressed(r.pc, r.insn);
+  else
+    std::cout << hex::to_hex32(r.pc) << ": " << hex::to_hex32(r.insn) << "  "
+              << std::setw(instruction_width) << std::setfill(' ')
+              << std::left << rv32i_decode::decode(r.pc, r.insn);
+
+  std::string mem = "m" + std::to_string(8 * r.mem_size) + "(" +
+                    hex::to_hex0x32(r.mem_addr) + ")";
+  if ((r.flags & trace_record::mem_store) &&
+      !(r.flags & trace_record::mem_load)) {
+    std::cout << "// " << mem << " = " << hex::to_hex0x32(r.mem_value);
+    if (r.flags & trace_record::has_rd)
+      std::cout << ", x" << std::dec << unsigned(r.rd) << " = "
+                << hex::to_hex0x32(r.rd_value);
+  } else if (r.flags & trace_record::has_rd) {
+    // a load into x0 still shows what it read
+    std::cout << "// x" << std::dec << unsigned(r.rd) << " = ";
+    if (r.flags & trace_record::mem_load)
+      std::cout << mem << " = " << hex::to_hex0x32(r.mem_value);
+    else
+      std::cout << hex::to_hex0x32(r.rd_value);
+  }
+  std::cout << '\n';
+}
+
+/**
+ * @brief Main execution function.
+ *
+ * Checks the trace header and then decodes the records a block at a time.
+ *
+ * @param argc Argument count.
+ * @param argv Argument values.
+ * @return Returns 0 on success, or 1 if the trace can't be read.
+ ********************************************************************************/
+int main(int argc, char **argv) {
+  if (argc != 2)
+    usage();
+
+  std::ifstream in(argv[1], std::ios::in | std::ios::binary);
+  if (!in) {
+    std::cerr << "Can't open file '" << argv[1] << "' for reading.\n";
+    return 1;
+  }
+
+  trace_header h, expect;
+  if (!in.read(reinterpret_cast<char *>(&h), sizeof(h)) ||
+      std::memcmp(h.magic, expect.magic, sizeof(h.magic)) != 0 ||
+      h.version != trace_header::current_version ||
+      h.record_size != sizeof(trace_record)) {
+    std::cerr << "'" << argv[1] << "' is not a binary trace.\n";
+    return 1;
+  }
+
+  bool show_hart = has_several_harts(in);
+  std::vector<trace_record> buf(64 * 1024);
+  uint64_t count = 0;
+  for (;;) {
+    in.read(reinterpret_cast<char *>(buf.data()),
+            buf.size() * sizeof(trace_record));
+    size_t n = in.gcount() / sizeof(trace_record);
+    for (size_t i = 0; i < n; ++i)
+      print_record(buf[i], show_hart);
+    count += n;
+    if (n < buf.size())
+      break;
+  }
+  std::cout << count << " instructions traced" << std::endl;
+  return 0;
+}